@@ -0,0 +1,74 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+namespace Vulkan {
+    namespace Benchmark {
+        double percentile(std::vector<double> values, double percent) {
+            if (values.empty()) {
+                return 0.0;
+            }
+            size_t rank = static_cast<size_t>(std::ceil((percent / 100.0) * values.size()));
+            rank = std::clamp<size_t>(rank, 1, values.size()) - 1;
+            std::nth_element(values.begin(), values.begin() + rank, values.end());
+            return values[rank];
+        }
+
+        Summary summarize(const std::vector<double>& values) {
+            Summary summary{};
+            if (values.empty()) {
+                return summary;
+            }
+            auto [min_it, max_it] = std::minmax_element(values.begin(), values.end());
+            summary.min = *min_it;
+            summary.max = *max_it;
+            summary.mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+            summary.p50 = percentile(values, 50.0);
+            summary.p95 = percentile(values, 95.0);
+            summary.p99 = percentile(values, 99.0);
+            return summary;
+        }
+
+        void printFrames(const Run& run) {
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "frame, cpu_ms, gpu_ms" << std::endl;
+            for (const FrameSample& sample : run.samples) {
+                std::cout << sample.frame << ", " << sample.cpu_ms << ", " << sample.gpu_ms << std::endl;
+            }
+        }
+
+        Summary summarizeCpu(const Run& run) {
+            std::vector<double> cpu;
+            for (size_t i = run.warmup_frames; i < run.samples.size(); i++) {
+                cpu.push_back(run.samples[i].cpu_ms);
+            }
+            return summarize(cpu);
+        }
+
+        void printSummary(std::string_view label, const Run& run) {
+            std::vector<double> cpu;
+            std::vector<double> gpu;
+            for (size_t i = run.warmup_frames; i < run.samples.size(); i++) {
+                cpu.push_back(run.samples[i].cpu_ms);
+                gpu.push_back(run.samples[i].gpu_ms);
+            }
+
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << label << ": " << cpu.size() << " frames (" << run.warmup_frames << " warm up skipped)"
+                      << std::endl;
+            printTimes("cpu", cpu);
+            printTimes("gpu", gpu);
+        }
+
+        void printTimes(std::string_view name, const std::vector<double>& values) {
+            Summary summary = summarize(values);
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "  " << name << " mean " << summary.mean << " min " << summary.min << " max "
+                      << summary.max << " p50 " << summary.p50 << " p95 " << summary.p95 << " p99 "
+                      << summary.p99 << " (ms)" << std::endl;
+        }
+    }
+}
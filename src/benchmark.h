@@ -0,0 +1,40 @@
+#pragma once
+
+#include "vulkan_common.h"
+
+#include <string_view>
+
+namespace Vulkan {
+    namespace Benchmark {
+        struct FrameSample {
+            uint64_t frame{0};
+            double cpu_ms{0.0};
+            double gpu_ms{0.0};
+        };
+
+        struct Summary {
+            double mean{0.0};
+            double min{0.0};
+            double max{0.0};
+            double p50{0.0};
+            double p95{0.0};
+            double p99{0.0};
+        };
+
+        struct Run {
+            std::vector<FrameSample> samples;
+            // Frames at the start of the run that are left out of the summary, first frames pay for pipeline and cache warm up
+            uint32_t warmup_frames{0};
+        };
+
+        // Nearest rank percentile, values does not need to be sorted
+        double percentile(std::vector<double> values, double percent);
+        Summary summarize(const std::vector<double>& values);
+        void printFrames(const Run& run);
+        void printSummary(std::string_view label, const Run& run);
+        // One summary line for any set of millisecond timings
+        void printTimes(std::string_view name, const std::vector<double>& values);
+        // Summary of the cpu times past the warm up frames
+        Summary summarizeCpu(const Run& run);
+    }
+}
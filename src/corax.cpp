@@ -7,26 +7,60 @@
 
 #include <array>
 #include <chrono>
+#include <thread>
 
 namespace Vulkan {
 
     void CoraxRenderer::run() {
         init();
-        mainLoop();
+        if (options.load_benchmark_runs > 0) {
+            runLoadBenchmark();
+        } else if (options.benchmark_frames > 0 && options.thread_sweep) {
+            runThreadSweep();
+        } else if (options.benchmark_frames > 0) {
+            runBenchmark(options.headless ? "headless" : "windowed", true);
+        } else {
+            mainLoop();
+        }
         destroy();
     }
 
     void CoraxRenderer::init() {
-        glfw_window.create(1200, 1000, "vulkan");
+        if (!options.headless) {
+            glfw_window.create(options.width, options.height, "vulkan");
+        }
+        instance.headless = options.headless;
         instance.create();
-        instance.createSurface(glfw_window);
+        if (!options.headless) {
+            instance.createSurface(glfw_window);
+        }
         device.create(instance);
 
         transfer_pool = CommandPool::createPool(device);
         allocator = MemoryAllocator::createAllocator(instance, device);
-        swap_chain.create(device, glfw_window, instance);
+        Upload::create(device, uploader);
+        Geometry::create(device, allocator, geometry, VkDeviceSize(options.vertex_arena_mb) * 1024 * 1024,
+                         VkDeviceSize(options.index_arena_mb) * 1024 * 1024,
+                         options.compact_vertices ? Geometry::VertexLayout::COMPACT : Geometry::VertexLayout::FULL);
+        Jobs::create(loader_pool, options.loader_threads > 0 ? options.loader_threads
+                                                            : std::max(1u, std::thread::hardware_concurrency()));
+        if (options.headless) {
+            // There is no swap chain, but pipelines, the depth image and the projection all size themselves from it
+            swap_chain.extent = {options.width, options.height};
+            swap_chain.image_format = VK_FORMAT_B8G8R8A8_SRGB;
+            initOffscreenImage();
+        } else {
+            swap_chain.create(device, glfw_window, instance);
+        }
         initDepthImage();
-        frame_sync.create(device);
+        frame_sync.create(device, options.frames_in_flight);
+        TextureStreaming::Settings stream_settings{};
+        stream_settings.enabled = options.texture_streaming;
+        stream_settings.resident_size = std::max(options.texture_resident_size, 1u);
+        stream_settings.frames_in_flight = static_cast<uint32_t>(frame_sync.frames.size());
+        TextureStreaming::create(device, loader_pool, stream_settings, texture_streamer);
+        TextureCache::create(texture_cache, textureStreamer());
+        setRecordThreads(options.record_threads);
 
         Descriptors::initPool(global_descriptor_allocator, device);
 
@@ -36,12 +70,25 @@ namespace Vulkan {
                                       (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT));
         Descriptors::buildLayout(global_layout, device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
-        Descriptors::addLayoutBinding(scene_layout, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        Descriptors::addLayoutBinding(scene_layout, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
                                       (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT));
         Descriptors::buildLayout(scene_layout, device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
+        // Scene constants live in one ring for every frame in flight, the set is written once and each frame
+        // only picks its slot with the dynamic offset
+        scene_ring = Buffer::createRing(device, allocator, sizeof(Scene),
+                                        static_cast<uint32_t>(frame_sync.frames.size()));
+        scene_descriptor = Descriptors::allocate(global_descriptor_allocator, device, scene_layout.layout_handle);
+        Descriptors::writeBuffer(descriptor_write, 0, scene_ring.buffer.buffer, sizeof(Scene), 0,
+                                 VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+        Descriptors::updateSet(descriptor_write, device, scene_descriptor);
 
-        MaterialOperation::buildPipelines(device, swap_chain, material_operations, pipeline_cache, scene_layout);
+
+        Pipeline::createCache(device, options.pipeline_cache ? options.pipeline_cache_file : std::string{},
+                              pipeline_cache);
+        MaterialOperation::buildPipelines(device, swap_chain, material_operations, pipeline_cache, scene_layout,
+                                          geometry.vertex_layout, loader_pool, options.shader_dir);
+        Pipeline::logStats(pipeline_cache);
 
         VkSamplerCreateInfo sampl = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
 
@@ -50,21 +97,24 @@ namespace Vulkan {
 
         vkCreateSampler(device.logical_handle, &sampl, nullptr, &default_sampler_nearest);
 
+        // Stands in for gltf textures without a sampler, which are mipmapped
         sampl.magFilter = VK_FILTER_LINEAR;
         sampl.minFilter = VK_FILTER_LINEAR;
+        sampl.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        sampl.maxLod = VK_LOD_CLAMP_NONE;
         vkCreateSampler(device.logical_handle, &sampl, nullptr, &default_linear_sampler);
 
 
         uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
-        default_white_image = Texture::upload(device, allocator, transfer_pool, (void*)&white, VkExtent3D{1, 1, 1},
+        default_white_image = Texture::upload(device, allocator, uploader, (void*)&white, VkExtent3D{1, 1, 1},
                                       VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
         uint32_t grey = glm::packUnorm4x8(glm::vec4(0.66f, 0.66f, 0.66f, 1));
-        default_grey_image = Texture::upload(device, allocator, transfer_pool, (void*)&grey, VkExtent3D{1, 1, 1},
+        default_grey_image = Texture::upload(device, allocator, uploader, (void*)&grey, VkExtent3D{1, 1, 1},
                                      VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
         uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 0));
-        default_black_image = Texture::upload(device, allocator, transfer_pool, (void*)&black, VkExtent3D{1, 1, 1},
+        default_black_image = Texture::upload(device, allocator, uploader, (void*)&black, VkExtent3D{1, 1, 1},
                                       VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
         uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
@@ -75,19 +125,43 @@ namespace Vulkan {
             }
         }
         error_checkerboard_image =
-            Texture::upload(device, allocator, transfer_pool, pixels.data(), VkExtent3D{16, 16, 1},
+            Texture::upload(device, allocator, uploader, pixels.data(), VkExtent3D{16, 16, 1},
                             VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
-        MaterialOperation::MaterialResources material_resources;
-        material_resources.color_image = default_white_image;
-        material_resources.color_sampler = default_linear_sampler;
-        material_resources.metal_rough_image = default_white_image;
-        material_resources.metal_rough_sampler = default_linear_sampler;
+        default_material_resources.color_image = default_white_image;
+        default_material_resources.color_sampler = default_linear_sampler;
+        default_material_resources.metal_rough_image = default_white_image;
+        default_material_resources.metal_rough_sampler = default_linear_sampler;
+
+        if (options.gpu_driven && !device.gpu_driven_supported) {
+            std::cout << "Indirect count draws not supported, falling back to cpu culling" << std::endl;
+            options.gpu_driven = false;
+        }
 
-        auto scene_resources = ResourceManagement::loadGLTF(
-            device, "C:/Users/bgarner/Documents/repos/Corax/third-party/glTF-Sample-Assets/Models/DamagedHelmet/glTF-Binary/DamagedHelmet.glb", allocator, transfer_pool,
-            error_checkerboard_image, material_resources, material_operations, pipeline_cache);
-        loaded_scenes["structure"] = scene_resources.value();
+        // Benchmarks time frames of the whole scene and the gpu driven table is built once from it, those wait.
+        // Otherwise the loop starts straight away and the scene shows up once it's on the gpu
+        if (options.async_load && options.benchmark_frames == 0 && options.load_benchmark_runs == 0 &&
+            !options.gpu_driven) {
+            loadSceneAsync("structure", options.scene_path);
+        } else {
+            auto scene_resources = ResourceManagement::loadGLTF(
+                device, options.scene_path, allocator, uploader, geometry, loader_pool, meshCacheSettings(),
+                error_checkerboard_image, default_material_resources, material_operations, pipeline_cache,
+                texture_cache, textureStreamer());
+            loaded_scenes["structure"] = scene_resources.value();
+        }
+
+        if (options.gpu_driven) {
+            // The node transforms are fixed after load, so the surface table only has to be walked once
+            MaterialOperation::DrawContext static_context;
+            loaded_scenes["structure"]->Draw(glm::mat4{1.f}, static_context);
+            GpuDriven::build(device, allocator, uploader, static_context.opaque_surfaces, gpu_scene);
+            indirect_pipeline = Pipeline::getPipelineFromCache(material_operations.opaque_indirect_pipeline_config,
+                                                               pipeline_cache);
+            // Nothing else draws the indirect path, so the first frame has to have it
+            Pipeline::waitForPipeline(pipeline_cache, indirect_pipeline);
+            cull_pipeline = Pipeline::getComputeFromCache("cull_pipeline", pipeline_cache);
+        }
 
         AllocatedBuffer materialConstants =
             Buffer::allocateBuffer(allocator, sizeof(MaterialOperation::MaterialResources),
@@ -96,13 +170,17 @@ namespace Vulkan {
             static_cast<MaterialOperation::MaterialConstants*>(materialConstants.info.pMappedData);
         sceneUniformData->color_factors = glm::vec4{1, 1, 1, 1};
         sceneUniformData->metal_factors = 1.0f;
+        sceneUniformData->min_lod = glm::vec4{0.0f};
         // My idea here is to give the structs constructors and destructors
         // But assert on the destructo function not being set so that any objects that
         // need explicit resource clean up always have that setup
         main_deletion_queue.pushDeleter([=, this]() { Buffer::destroyBuffer(allocator, materialConstants); });
 
-        material_resources.data_buffer = materialConstants.buffer;
-        material_resources.data_buffer_offset = 0;
+        default_material_resources.data_buffer = materialConstants.buffer;
+        default_material_resources.data_buffer_offset = 0;
+
+        // Anything recorded after the scene's batch, the frame submits are queued behind it
+        Upload::submit(device, uploader);
     }
 
     void CoraxRenderer::updateScene(float delta_time) {
@@ -110,13 +188,9 @@ namespace Vulkan {
         main_draw_context.transparent_surfaces.clear();
         Camera::updatePosition(fps_camera, delta_time);
 
-
-        if (loaded_scenes["structure"] != nullptr)
-        {
-            loaded_scenes["structure"]->Draw(glm::mat4{ 1.f }, main_draw_context);
-        }
-        else{
-            std::cout << "null structure" << std::endl;
+        // Scenes still loading aren't in here yet
+        for (auto& [name, scene] : loaded_scenes) {
+            scene->Draw(glm::mat4{1.f}, main_draw_context);
         }
 
         static float angle = 0.0f;
@@ -135,6 +209,80 @@ namespace Vulkan {
         scene_data.ambient_color = glm::vec4(5.0f, 5.0f, 5.0f, 5.0f);
         scene_data.camera_position = glm::vec4(Camera::getPosition(fps_camera));
         scene_data.light_position = glm::vec4(1.0f, 1.0f, 5.0f, 10.0f);
+
+        // Pixels per world unit at distance 1, what the streamer turns bounds into on screen sizes
+        float projection_scale = std::abs(scene_data.projection[1][1]) * 0.5f * swap_chain.extent.height;
+        glm::vec3 camera_position = glm::vec3(scene_data.camera_position);
+
+        // The gpu driven path already has the opaque surfaces on the gpu, only transparent goes through here.
+        // Its visibility is only known on the gpu, so every opaque surface counts towards texture demand
+        if (options.gpu_driven) {
+            if (options.texture_streaming) {
+                TextureStreaming::gatherDemand(texture_streamer, main_draw_context.opaque_surfaces,
+                                               camera_position, projection_scale);
+            }
+            main_draw_context.opaque_surfaces.clear();
+        }
+
+        cull_stats = {};
+        view_frustum = Culling::extractFrustum(scene_data.view_projection);
+        if (options.frustum_cull) {
+            Culling::cullSurfaces(cull_batch, view_frustum, main_draw_context.opaque_surfaces, cull_stats);
+            Culling::cullSurfaces(cull_batch, view_frustum, main_draw_context.transparent_surfaces, cull_stats);
+        }
+
+        if (options.texture_streaming) {
+            TextureStreaming::gatherDemand(texture_streamer, main_draw_context.opaque_surfaces, camera_position,
+                                           projection_scale);
+            TextureStreaming::gatherDemand(texture_streamer, main_draw_context.transparent_surfaces,
+                                           camera_position, projection_scale);
+            TextureStreaming::update(device, allocator, uploader, texture_streamer);
+        }
+
+        // Transparent keeps scene order, blending cares about it and the list is short
+        if (options.sort_draws) {
+            Draw::sortSurfaces(draw_sorter, main_draw_context.opaque_surfaces);
+        }
+    }
+
+    void CoraxRenderer::loadSceneAsync(const std::string& name, const std::string& filepath) {
+        SceneLoad load;
+        load.name = name;
+        load.handle = ResourceManagement::beginLoad(device, filepath, loader_pool, meshCacheSettings(),
+                                                    texture_cache, textureStreamer());
+        scene_loads.push_back(std::move(load));
+    }
+
+    void CoraxRenderer::pollSceneLoads() {
+        for (size_t i = 0; i < scene_loads.size();) {
+            SceneLoad& load = scene_loads[i];
+            std::shared_ptr<MaterialOperation::LoadedGLTF> scene = ResourceManagement::pollLoad(
+                load.handle, device, allocator, uploader, geometry, error_checkerboard_image,
+                default_material_resources, material_operations, pipeline_cache, texture_cache, textureStreamer());
+            ResourceManagement::LoadProgress progress = ResourceManagement::loadProgress(load.handle);
+            if (progress.stage == ResourceManagement::LoadStage::DECODING &&
+                progress.images_decoded != load.images_decoded) {
+                load.images_decoded = progress.images_decoded;
+                std::cout << load.name << ": " << progress.images_decoded << "/" << progress.image_count
+                          << " images decoded" << std::endl;
+            }
+
+            if (scene != nullptr) {
+                // Replacing a scene of the same name, frames in flight may still be drawing the old one
+                auto old = loaded_scenes.find(load.name);
+                if (old != loaded_scenes.end()) {
+                    vkDeviceWaitIdle(device.logical_handle);
+                    old->second->onDestroy();
+                }
+                loaded_scenes[load.name] = scene;
+            } else if (progress.stage == ResourceManagement::LoadStage::FAILED) {
+                std::cout << load.name << " failed to load" << std::endl;
+            } else {
+                i++;
+                continue;
+            }
+            scene_loads.erase(scene_loads.begin() + i);
+        }
     }
 
     void CoraxRenderer::updateRenderingInfo() {
@@ -151,7 +299,8 @@ namespace Vulkan {
 
         color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
         color_attachment_info.pNext = nullptr;
-        color_attachment_info.imageView = swap_chain.image_views[current_index];
+        color_attachment_info.imageView =
+            options.headless ? offscreen_image.imageView : swap_chain.image_views[current_index];
         color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -171,23 +320,31 @@ namespace Vulkan {
 
     void CoraxRenderer::beginFrame(float delta_time) {
 
+        frame_cpu_start = std::chrono::high_resolution_clock::now();
         updateScene(delta_time);
-        vkWaitForFences(device.logical_handle, 1, &frame_sync.frames[last_frame_index].in_flight_fence, VK_TRUE,
-                        UINT64_MAX);
-        frame_sync.frames[last_frame_index].deletion.flush();
+        auto wait_start = std::chrono::high_resolution_clock::now();
         FrameResources& frame = frame_sync.frames[last_frame_index];
+        Timelines::wait(device, frame_sync.graphics_timeline, frame.timeline_value);
+        frame.deletion.flush();
+        frame_sync.collectGarbage(device);
+        Upload::collect(device, allocator, uploader);
+        pollSceneLoads();
+        Pipeline::collect(device, pipeline_cache);
+        readFrameTimestamps(frame);
         Descriptors::clearPools(frame_sync.frames[last_frame_index].frame_descriptor_allocator, device);
 
-        VkResult result = vkAcquireNextImageKHR(device.logical_handle, swap_chain.swap_chain, UINT64_MAX,
-                                                frame_sync.frames[last_frame_index].image_available_semaphore,
-                                                VK_NULL_HANDLE, &current_index);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            recreateSwapChain();
-            return;
-        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-            throw std::runtime_error("failed to acquire swap chain image!");
+        if (!options.headless) {
+            VkResult result = vkAcquireNextImageKHR(device.logical_handle, swap_chain.swap_chain, UINT64_MAX,
+                                                    frame_sync.frames[last_frame_index].image_available_semaphore,
+                                                    VK_NULL_HANDLE, &current_index);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                recreateSwapChain();
+                return;
+            } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+                throw std::runtime_error("failed to acquire swap chain image!");
+            }
         }
-        vkResetFences(device.logical_handle, 1, &frame_sync.frames[last_frame_index].in_flight_fence);
+        frame_cpu_wait = std::chrono::high_resolution_clock::now() - wait_start;
         vkResetCommandPool(device.logical_handle, frame_sync.frames[last_frame_index].command_pool, 0);
 
         VkCommandBufferBeginInfo begin_info{};
@@ -197,19 +354,90 @@ namespace Vulkan {
 
         vkCheck(vkBeginCommandBuffer(frame_sync.frames[last_frame_index].command_buffer, &begin_info));
 
+        Profiler::resetQueries(frame.command_buffer, frame.gpu_queries);
+        frame_scope = Profiler::beginScope(frame.command_buffer, frame.gpu_queries, "frame");
+        frame.frame_number = frame_sync.current_frame;
+
         updateRenderingInfo();
-        Transition::image(frame_sync.frames[last_frame_index].command_buffer, swap_chain.images[current_index],
-                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
-                          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+        uint32_t transition_scope = Profiler::beginScope(frame.command_buffer, frame.gpu_queries, "layout_transitions");
+        if (options.headless) {
+            // The offscreen target is shared by every frame in flight, so wait on the previous frames writes to it
+            Transition::image(frame.command_buffer, offscreen_image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+        } else {
+            Transition::image(frame_sync.frames[last_frame_index].command_buffer, swap_chain.images[current_index],
+                              VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+        }
 
         Transition::image(frame_sync.frames[last_frame_index].command_buffer, depth_image.image,
                           VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
                           VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 0,
                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+        Profiler::endScope(frame.command_buffer, frame.gpu_queries, transition_scope);
 
-        vkCmdBeginRenderingKHR(frame_sync.frames[last_frame_index].command_buffer, &render_info);
+        // The timeline has passed this slot's last submit, so the gpu is done reading its part of the ring
+        uint32_t scene_offset = Buffer::writeRing(allocator, scene_ring, static_cast<uint32_t>(last_frame_index),
+                                                  &scene_data, sizeof(Scene));
+
+        if (options.gpu_driven) {
+            Profiler::ScopedZone zone(frame.command_buffer, frame.gpu_queries, "gpu_cull");
+            GpuDriven::cull(frame.command_buffer, *cull_pipeline, gpu_scene, view_frustum);
+        }
 
+        // With the opaque draws down to one call per bucket there is nothing worth spreading over threads,
+        // so the gpu driven path always records into the primary
+        if (options.record_threads > 0 && !options.gpu_driven) {
+            // Secondaries can't be timed from the primary inside the rendering scope, so the parallel path only
+            // gets one scope around all of the draws
+            Profiler::ScopedZone zone(frame.command_buffer, frame.gpu_queries, "draws");
+            render_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+            vkCmdBeginRenderingKHR(frame.command_buffer, &render_info);
+            recordParallel(frame, scene_offset);
+            Vulkan::vkCmdEndRenderingKHR(frame.command_buffer);
+        } else {
+            render_info.flags = 0;
+            vkCmdBeginRenderingKHR(frame.command_buffer, &render_info);
+            setViewportScissor(frame.command_buffer);
+            Draw::Recorder recorder;
+            Draw::begin(recorder, frame.command_buffer, scene_descriptor, scene_offset);
+            {
+                Profiler::ScopedZone zone(frame.command_buffer, frame.gpu_queries, "opaque");
+                if (options.gpu_driven) {
+                    GpuDriven::draw(frame.command_buffer, *indirect_pipeline, gpu_scene, scene_descriptor,
+                                    scene_offset);
+                }
+                for (const MaterialOperation::RenderObject& render_obj : main_draw_context.opaque_surfaces) {
+                    Draw::record(recorder, render_obj);
+                }
+            }
+
+            {
+                Profiler::ScopedZone zone(frame.command_buffer, frame.gpu_queries, "transparent");
+                for (const MaterialOperation::RenderObject& render_obj : main_draw_context.transparent_surfaces) {
+                    Draw::record(recorder, render_obj);
+                }
+            }
+            Vulkan::vkCmdEndRenderingKHR(frame.command_buffer);
+            draw_stats = recorder.stats;
+        }
+
+        if (!options.headless) {
+            // Same name as the begin of frame transitions, the profiler sums them into one bucket
+            Profiler::ScopedZone zone(frame.command_buffer, frame.gpu_queries, "layout_transitions");
+            Transition::image(frame_sync.frames[last_frame_index].command_buffer, swap_chain.images[current_index],
+                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0);
+        }
+
+        endFrame(frame);
+    }
+
+    void CoraxRenderer::setViewportScissor(VkCommandBuffer cmd) {
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
@@ -217,74 +445,126 @@ namespace Vulkan {
         viewport.height = static_cast<float>(swap_chain.extent.height);
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(frame_sync.frames[last_frame_index].command_buffer, 0, 1, &viewport);
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
 
         VkRect2D scissor{};
         scissor.offset = {0, 0};
         scissor.extent = swap_chain.extent;
-        vkCmdSetScissor(frame_sync.frames[last_frame_index].command_buffer, 0, 1, &scissor);
-
-        AllocatedBuffer gpuSceneDataBuffer = Buffer::allocateBuffer(
-            allocator, sizeof(Scene), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-        frame_sync.frames[last_frame_index].deletion.pushDeleter(
-            [=, this]() { Buffer::destroyBuffer(allocator, gpuSceneDataBuffer); });
-
-        Scene* sceneUniformData = (Scene*)gpuSceneDataBuffer.info.pMappedData;
-        *sceneUniformData = scene_data;
-        VkDescriptorSet globalDescriptor = Descriptors::allocate(
-            frame_sync.frames[last_frame_index].frame_descriptor_allocator, device, scene_layout.layout_handle);
-        assert(globalDescriptor != VK_NULL_HANDLE);
-        {
-            Descriptors::writeBuffer(descriptor_write, 0, gpuSceneDataBuffer.buffer, sizeof(Scene), 0,
-                                     VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-            Descriptors::updateSet(descriptor_write, device, globalDescriptor);
-        }
-
-        auto draw = [&](const MaterialOperation::RenderObject& draw) {
-            vkCmdBindPipeline(frame_sync.frames[last_frame_index].command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              draw.material->pipeline->handle);
-            vkCmdBindDescriptorSets(frame_sync.frames[last_frame_index].command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    draw.material->pipeline->layout_handle, 0, 1, &globalDescriptor, 0, nullptr);
-            vkCmdBindDescriptorSets(frame_sync.frames[last_frame_index].command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    draw.material->pipeline->layout_handle, 1, 1, &draw.material->material_set, 0,
-                                    nullptr);
-
-            vkCmdBindIndexBuffer(frame_sync.frames[last_frame_index].command_buffer, draw.index_buffer, 0,
-                                 VK_INDEX_TYPE_UINT32);
-
-            GPUDrawPushConstants pushConstants;
-            pushConstants.vertexBuffer = draw.vertex_buffer_address;
-            pushConstants.worldMatrix = draw.transform;
-            vkCmdPushConstants(frame_sync.frames[last_frame_index].command_buffer,
-                               draw.material->pipeline->layout_handle, VK_SHADER_STAGE_VERTEX_BIT, 0,
-                               sizeof(GPUDrawPushConstants), &pushConstants);
-
-            vkCmdDrawIndexed(frame_sync.frames[last_frame_index].command_buffer, draw.index_ount, 1, draw.first_index,
-                             0, 0);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+    }
+
+    void CoraxRenderer::recordParallel(FrameResources& frame, uint32_t scene_offset) {
+        const std::vector<MaterialOperation::RenderObject>& opaque = main_draw_context.opaque_surfaces;
+        const std::vector<MaterialOperation::RenderObject>& transparent = main_draw_context.transparent_surfaces;
+        uint32_t slots = static_cast<uint32_t>(frame.thread_commands.size());
+
+        // Contiguous chunks, slot i always gets the i'th chunk so executing the slots in order keeps draw order
+        auto chunk = [slots](size_t count, uint32_t slot) {
+            return std::pair<size_t, size_t>{count * slot / slots, count * (slot + 1) / slots};
         };
 
-        for (const MaterialOperation::RenderObject& render_obj : main_draw_context.opaque_surfaces) {
-            draw(render_obj);
-        }
+        VkCommandBufferInheritanceRenderingInfo inheritance_rendering{};
+        inheritance_rendering.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+        inheritance_rendering.colorAttachmentCount = 1;
+        inheritance_rendering.pColorAttachmentFormats = &swap_chain.image_format;
+        inheritance_rendering.depthAttachmentFormat = depth_image.imageFormat;
+        inheritance_rendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-        for (const MaterialOperation::RenderObject& render_obj : main_draw_context.transparent_surfaces) {
-            draw(render_obj);
-        }
+        VkCommandBufferInheritanceInfo inheritance{};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.pNext = &inheritance_rendering;
 
-        Vulkan::vkCmdEndRenderingKHR(frame_sync.frames[last_frame_index].command_buffer);
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags =
+            VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        begin_info.pInheritanceInfo = &inheritance;
+
+        // Each slot writes only its own stats, summed once every slot is done
+        std::vector<Draw::Stats> slot_stats(slots);
+        auto record = [&](VkCommandBuffer cmd, const std::vector<MaterialOperation::RenderObject>& objects,
+                          std::pair<size_t, size_t> range, Draw::Stats& stats) {
+            vkCheck(vkBeginCommandBuffer(cmd, &begin_info));
+            // Dynamic state and bound state are not inherited from the primary
+            setViewportScissor(cmd);
+            Draw::Recorder recorder;
+            Draw::begin(recorder, cmd, scene_descriptor, scene_offset);
+            for (size_t i = range.first; i < range.second; i++) {
+                Draw::record(recorder, objects[i]);
+            }
+            vkCheck(vkEndCommandBuffer(cmd));
+            Draw::accumulate(stats, recorder.stats);
+        };
 
-        Transition::image(frame_sync.frames[last_frame_index].command_buffer, swap_chain.images[current_index],
-                          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-                          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0);
+        Jobs::parallelFor(record_pool, slots, [&](uint32_t slot) {
+            ThreadCommands& commands = frame.thread_commands[slot];
+            vkResetCommandPool(device.logical_handle, commands.pool, 0);
+            record(commands.opaque, opaque, chunk(opaque.size(), slot), slot_stats[slot]);
+            record(commands.transparent, transparent, chunk(transparent.size(), slot), slot_stats[slot]);
+        });
 
-        endFrame(frame);
+        draw_stats = {};
+        for (const Draw::Stats& stats : slot_stats) {
+            Draw::accumulate(draw_stats, stats);
+        }
+
+        std::vector<VkCommandBuffer> secondaries;
+        secondaries.reserve(slots * 2);
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            auto [first, last] = chunk(opaque.size(), slot);
+            if (first != last) {
+                secondaries.push_back(frame.thread_commands[slot].opaque);
+            }
+        }
+        for (uint32_t slot = 0; slot < slots; slot++) {
+            auto [first, last] = chunk(transparent.size(), slot);
+            if (first != last) {
+                secondaries.push_back(frame.thread_commands[slot].transparent);
+            }
+        }
+        if (!secondaries.empty()) {
+            vkCmdExecuteCommands(frame.command_buffer, static_cast<uint32_t>(secondaries.size()),
+                                 secondaries.data());
+        }
+    }
+
+    void CoraxRenderer::setRecordThreads(uint32_t thread_count) {
+        vkDeviceWaitIdle(device.logical_handle);
+        frame_sync.destroyThreadCommands(device);
+        Jobs::destroy(record_pool);
+        options.record_threads = thread_count;
+        if (thread_count > 0) {
+            Jobs::create(record_pool, thread_count);
+            frame_sync.createThreadCommands(device, thread_count);
+        }
     }
 
     void CoraxRenderer::endFrame(FrameResources& frame) {
+        Profiler::endScope(frame.command_buffer, frame.gpu_queries, frame_scope);
         vkCheck(vkEndCommandBuffer(frame_sync.frames[last_frame_index].command_buffer));
 
+        frame.timeline_value = Timelines::nextValue(frame_sync.graphics_timeline);
+
+        if (options.headless) {
+            // Nothing to acquire or present, the timeline is all the pacing needed
+            VkTimelineSemaphoreSubmitInfo timeline_info{};
+            timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timeline_info.signalSemaphoreValueCount = 1;
+            timeline_info.pSignalSemaphoreValues = &frame.timeline_value;
+
+            VkSubmitInfo submit_info{};
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit_info.pNext = &timeline_info;
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &frame.command_buffer;
+            submit_info.signalSemaphoreCount = 1;
+            submit_info.pSignalSemaphores = &frame_sync.graphics_timeline.semaphore;
+            vkCheck(vkQueueSubmit(device.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+            recordFrameCpuTime(frame);
+            last_frame_index = frame_sync.advanceFrame();
+            return;
+        }
+
         VkSubmitInfo submit_info{};
         submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -296,11 +576,23 @@ namespace Vulkan {
         submit_info.commandBufferCount = 1;
         submit_info.pCommandBuffers = &frame_sync.frames[last_frame_index].command_buffer;
 
-        VkSemaphore signal_semaphores[] = {frame_sync.frames[last_frame_index].render_finished_semaphore};
-        submit_info.signalSemaphoreCount = 1;
+        // Binary semaphores ignore their entry in the value arrays, only the timeline one is read
+        VkSemaphore signal_semaphores[] = {frame_sync.frames[last_frame_index].render_finished_semaphore,
+                                           frame_sync.graphics_timeline.semaphore};
+        uint64_t wait_values[] = {0};
+        uint64_t signal_values[] = {0, frame.timeline_value};
+        VkTimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = 1;
+        timeline_info.pWaitSemaphoreValues = wait_values;
+        timeline_info.signalSemaphoreValueCount = 2;
+        timeline_info.pSignalSemaphoreValues = signal_values;
+        submit_info.pNext = &timeline_info;
+        submit_info.signalSemaphoreCount = 2;
         submit_info.pSignalSemaphores = signal_semaphores;
 
-        vkQueueSubmit(device.graphics_queue, 1, &submit_info, frame_sync.frames[last_frame_index].in_flight_fence);
+        vkCheck(vkQueueSubmit(device.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+        recordFrameCpuTime(frame);
 
         VkPresentInfoKHR present_info{};
         present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -323,6 +615,203 @@ namespace Vulkan {
         last_frame_index = frame_sync.advanceFrame();
     }
 
+    void CoraxRenderer::recordFrameCpuTime(const FrameResources& frame) {
+        if (!benchmark_active || frame.frame_number < benchmark_first_frame) {
+            return;
+        }
+        size_t sample = static_cast<size_t>(frame.frame_number - benchmark_first_frame);
+        if (sample < benchmark_run.samples.size()) {
+            std::chrono::duration<double, std::milli> total = std::chrono::high_resolution_clock::now() - frame_cpu_start;
+            benchmark_run.samples[sample].cpu_ms = (total - frame_cpu_wait).count();
+        }
+    }
+
+    void CoraxRenderer::readFrameTimestamps(FrameResources& frame) {
+        if (!frame.gpu_queries.pending) {
+            return;
+        }
+        Profiler::collect(device, frame.gpu_queries, gpu_profile);
+
+        if (options.profile_log_interval > 0 && frame.frame_number % options.profile_log_interval == 0) {
+            Profiler::log(gpu_profile);
+            Draw::log(draw_stats);
+            Culling::log(cull_stats);
+            TextureStreaming::log(texture_streamer);
+            Upload::log(uploader);
+        }
+
+        if (!benchmark_active || frame.frame_number < benchmark_first_frame) {
+            return;
+        }
+        size_t sample = static_cast<size_t>(frame.frame_number - benchmark_first_frame);
+        if (sample < benchmark_run.samples.size()) {
+            benchmark_run.samples[sample].gpu_ms = Profiler::lastMs(frame.gpu_queries, "frame");
+        }
+    }
+
+    void CoraxRenderer::runBenchmark(std::string_view label, bool print_frames) {
+        const float delta_time = 1.0f / 60.0f;
+        benchmark_run = {};
+        benchmark_run.samples.resize(options.benchmark_frames);
+        benchmark_run.warmup_frames = std::min(options.warmup_frames, options.benchmark_frames);
+        benchmark_first_frame = frame_sync.current_frame;
+        benchmark_active = true;
+
+        Camera::FirstPerson& camera = std::get<Camera::FirstPerson>(fps_camera);
+        for (uint32_t i = 0; i < options.benchmark_frames; i++) {
+            // One full orbit around the origin looking at the centre, the same views every run
+            float angle = glm::radians(360.0f) * (static_cast<float>(i) / options.benchmark_frames);
+            camera.position = glm::vec3(std::sin(angle) * options.benchmark_orbit_radius, 0.0f,
+                                        std::cos(angle) * options.benchmark_orbit_radius);
+            camera.velocity = glm::vec3(0.0f);
+            camera.yaw = -angle;
+            camera.pitch = 0.0f;
+
+            benchmark_run.samples[i].frame = i;
+            if (!options.headless) {
+                glfwPollEvents();
+            }
+            beginFrame(delta_time);
+        }
+
+        vkDeviceWaitIdle(device.logical_handle);
+        for (FrameResources& frame : frame_sync.frames) {
+            readFrameTimestamps(frame);
+        }
+        benchmark_active = false;
+
+        if (print_frames) {
+            Benchmark::printFrames(benchmark_run);
+        }
+        Benchmark::printSummary(label, benchmark_run);
+        Profiler::log(gpu_profile);
+        Draw::log(draw_stats);
+        Culling::log(cull_stats);
+        TextureStreaming::log(texture_streamer);
+        TextureCache::log(texture_cache);
+        Upload::log(uploader);
+        Pipeline::logStats(pipeline_cache);
+    }
+
+    void CoraxRenderer::runThreadSweep() {
+        uint32_t max_threads = options.record_threads > 0 ? options.record_threads
+                                                           : std::max(1u, std::thread::hardware_concurrency());
+        // 0 is the old single threaded path straight into the primary, then powers of two up to the max
+        std::vector<uint32_t> counts{0};
+        for (uint32_t count = 1; count < max_threads; count *= 2) {
+            counts.push_back(count);
+        }
+        counts.push_back(max_threads);
+
+        std::vector<std::pair<uint32_t, Benchmark::Summary>> results;
+        for (uint32_t count : counts) {
+            setRecordThreads(count);
+            std::string label = count == 0 ? "serial" : std::to_string(count) + " recording threads";
+            runBenchmark(label, false);
+            results.push_back({count, Benchmark::summarizeCpu(benchmark_run)});
+        }
+
+        double base_ms = results.size() > 1 ? results[1].second.mean : 0.0;
+        std::cout << "threads, cpu_mean_ms, cpu_p95_ms, speedup_vs_1" << std::endl;
+        for (const auto& [count, summary] : results) {
+            double speedup = summary.mean > 0.0 ? base_ms / summary.mean : 0.0;
+            std::cout << count << ", " << summary.mean << ", " << summary.p95 << ", " << speedup << std::endl;
+        }
+    }
+
+    MeshCache::Settings CoraxRenderer::meshCacheSettings() const {
+        MeshCache::Settings settings{};
+        settings.directory = options.mesh_cache_dir;
+        settings.read = options.mesh_cache;
+        settings.write = options.mesh_cache;
+        return settings;
+    }
+
+    TextureStreaming::Streamer* CoraxRenderer::textureStreamer() {
+        return options.texture_streaming ? &texture_streamer : nullptr;
+    }
+
+    void CoraxRenderer::runLoadBenchmark() {
+        // Cold runs ignore the cache but still rewrite it, so every warm run after one is a hit
+        MeshCache::Settings cold = meshCacheSettings();
+        cold.read = false;
+        cold.write = true;
+        MeshCache::Settings warm = meshCacheSettings();
+        warm.read = true;
+        warm.write = false;
+
+        // Timed until the uploads are done on the gpu, that's when the scene could first be drawn
+        auto measure = [&](const MeshCache::Settings& settings, std::vector<double>& times) {
+            auto start = std::chrono::high_resolution_clock::now();
+            auto scene = ResourceManagement::loadGLTF(device, options.scene_path, allocator, uploader, geometry,
+                                                      loader_pool, settings, error_checkerboard_image,
+                                                      default_material_resources, material_operations, pipeline_cache,
+                                                      texture_cache, textureStreamer());
+            if (!scene.has_value()) {
+                throw std::runtime_error("load benchmark couldn't load " + options.scene_path);
+            }
+            Upload::wait(device, uploader, scene.value()->upload_ready);
+            std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+            times.push_back(ms.count());
+
+            vkDeviceWaitIdle(device.logical_handle);
+            scene.value()->onDestroy();
+            Upload::collect(device, allocator, uploader);
+        };
+
+        // The same warm load in the background, polled the way the frame loop does. The longest poll is
+        // what a frame would have stalled for
+        auto measure_async = [&](const MeshCache::Settings& settings, std::vector<double>& times,
+                                 std::vector<double>& stalls) {
+            auto start = std::chrono::high_resolution_clock::now();
+            ResourceManagement::LoadHandle load = ResourceManagement::beginLoad(
+                device, options.scene_path, loader_pool, settings, texture_cache, textureStreamer());
+            std::shared_ptr<MaterialOperation::LoadedGLTF> scene;
+            double longest_poll = 0.0;
+            while (scene == nullptr) {
+                auto poll_start = std::chrono::high_resolution_clock::now();
+                scene = ResourceManagement::pollLoad(load, device, allocator, uploader, geometry,
+                                                     error_checkerboard_image, default_material_resources,
+                                                     material_operations, pipeline_cache, texture_cache,
+                                                     textureStreamer());
+                std::chrono::duration<double, std::milli> poll_ms =
+                    std::chrono::high_resolution_clock::now() - poll_start;
+                longest_poll = std::max(longest_poll, poll_ms.count());
+                if (ResourceManagement::loadProgress(load).stage == ResourceManagement::LoadStage::FAILED) {
+                    throw std::runtime_error("load benchmark couldn't load " + options.scene_path);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+            times.push_back(ms.count());
+            stalls.push_back(longest_poll);
+
+            vkDeviceWaitIdle(device.logical_handle);
+            scene->onDestroy();
+            Upload::collect(device, allocator, uploader);
+        };
+
+        std::vector<double> cold_ms;
+        std::vector<double> warm_ms;
+        std::vector<double> async_ms;
+        std::vector<double> async_stall_ms;
+        for (uint32_t i = 0; i < options.load_benchmark_runs; i++) {
+            measure(cold, cold_ms);
+            measure(warm, warm_ms);
+            measure_async(warm, async_ms, async_stall_ms);
+        }
+
+        std::cout << "scene load " << options.scene_path << ": " << options.load_benchmark_runs << " runs"
+                  << std::endl;
+        Benchmark::printTimes("cold", cold_ms);
+        Benchmark::printTimes("warm", warm_ms);
+        double cold_mean = Benchmark::summarize(cold_ms).mean;
+        double warm_mean = Benchmark::summarize(warm_ms).mean;
+        std::cout << "  speedup " << (warm_mean > 0.0 ? cold_mean / warm_mean : 0.0) << "x" << std::endl;
+        Benchmark::printTimes("warm async", async_ms);
+        Benchmark::printTimes("  longest poll", async_stall_ms);
+    }
+
     void CoraxRenderer::processInputKeyEvent(GLFWwindow* window, int key, int scancode, int action, int mods) {
         Camera::Type* fps_camera_context = static_cast<Camera::Type*>(glfwGetWindowUserPointer(window));
         Camera::updateVelocityFromEvent(*fps_camera_context, key, scancode, action, mods);
@@ -356,10 +845,23 @@ namespace Vulkan {
         
 
         vkDeviceWaitIdle(device.logical_handle);
+        // Builds still on the loader pool read the material layout and shader modules torn down below, and
+        // add to the driver cache that is saved at the end
+        Pipeline::waitForBuilds(pipeline_cache);
         main_deletion_queue.flush();
         for (auto& n : loaded_scenes) {
             n.second->onDestroy();
         }
+        // A load that got as far as recording owns gpu resources already
+        for (auto& load : scene_loads) {
+            std::shared_ptr<MaterialOperation::LoadedGLTF> scene = ResourceManagement::abandonLoad(load.handle);
+            if (scene != nullptr) {
+                scene->onDestroy();
+            }
+        }
+        scene_loads.clear();
+        TextureCache::destroy(device, allocator, texture_cache);
+        TextureStreaming::destroy(texture_streamer);
         vkDestroySampler(device.logical_handle, default_sampler_nearest, nullptr);
         vkDestroySampler(device.logical_handle, default_linear_sampler, nullptr);
         Texture::destroy(device, allocator, default_white_image);
@@ -370,14 +872,26 @@ namespace Vulkan {
         Descriptors::clearLayoutBindings(global_layout);
         Descriptors::destroyLayout(device, scene_layout);
         Descriptors::clearLayoutBindings(scene_layout);
+        Buffer::destroyRing(allocator, scene_ring);
+        GpuDriven::destroy(allocator, gpu_scene);
+        Upload::destroy(device, allocator, uploader);
+        Geometry::destroy(allocator, geometry);
         Descriptors::destroyPools(global_descriptor_allocator, device);
         MaterialOperation::destroyResources(device, material_operations);
         Pipeline::destroyShaderModule(device, mesh_vertex);
         Pipeline::destroyShaderModule(device, mesh_fragment);
+        Pipeline::saveCache(device, pipeline_cache);
         Pipeline::clearCache(device, pipeline_cache);
+        Jobs::destroy(record_pool);
+        Jobs::destroy(loader_pool);
         frame_sync.destroy(device);
         vkDestroyImage(device.logical_handle, depth_image.image, nullptr);
         vkDestroyImageView(device.logical_handle, depth_image.imageView, nullptr);
+        if (options.headless) {
+            vkDestroyImageView(device.logical_handle, offscreen_image.imageView, nullptr);
+            vkDestroyImage(device.logical_handle, offscreen_image.image, nullptr);
+            vkFreeMemory(device.logical_handle, offscreen_image.memory, nullptr);
+        }
         CommandPool::destroyPool(device, transfer_pool);
         swap_chain.destroy(device);
         MemoryAllocator::destroyAllocator(allocator);
@@ -464,4 +978,51 @@ namespace Vulkan {
         vkCheck(vkCreateImageView(device.logical_handle, &dview_info, nullptr, &depth_image.imageView));
     }
 
+    void CoraxRenderer::initOffscreenImage() {
+        offscreen_image.imageFormat = swap_chain.image_format;
+        offscreen_image.imageExtent = {swap_chain.extent.width, swap_chain.extent.height, 1};
+
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = offscreen_image.imageFormat;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.extent = offscreen_image.imageExtent;
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        vkCheck(vkCreateImage(device.logical_handle, &image_info, nullptr, &offscreen_image.image));
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device.logical_handle, offscreen_image.image, &memRequirements);
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex =
+            findMemoryType(memRequirements.memoryTypeBits, VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+
+        if (vkAllocateMemory(device.logical_handle, &allocInfo, nullptr, &offscreen_image.memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate offscreen image memory!");
+        }
+
+        vkBindImageMemory(device.logical_handle, offscreen_image.image, offscreen_image.memory, 0);
+
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.format = offscreen_image.imageFormat;
+        view_info.image = offscreen_image.image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+
+        vkCheck(vkCreateImageView(device.logical_handle, &view_info, nullptr, &offscreen_image.imageView));
+    }
+
 };  // namespace Vulkan
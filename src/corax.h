@@ -47,9 +47,85 @@
 #include "resource_manager.h"
 #include "material.h"
 #include "camera.h"
+#include "benchmark.h"
+#include "thread_pool.h"
+#include "draw.h"
+#include "culling.h"
+#include "gpu_driven.h"
+#include "upload.h"
+#include "geometry.h"
+#include "mesh_cache.h"
+#include "texture_streaming.h"
+#include "texture_cache.h"
+
+#include <chrono>
+
+// Set by the build, these fallbacks are relative to the working directory
+#ifndef CORAX_SHADER_DIR
+#define CORAX_SHADER_DIR "shaders"
+#endif
+#ifndef CORAX_DEFAULT_SCENE
+#define CORAX_DEFAULT_SCENE "DamagedHelmet.glb"
+#endif
 
 namespace Vulkan 
 {
+    struct RendererOptions {
+        // Render into an offscreen target with no window, surface or swap chain
+        bool headless{false};
+        uint32_t width{1200};
+        uint32_t height{1000};
+        // Non zero runs that many frames over a fixed camera path and prints the timings instead of the interactive loop
+        uint32_t benchmark_frames{0};
+        uint32_t warmup_frames{10};
+        float benchmark_orbit_radius{3.0f};
+        // Non zero dumps the rolling gpu scope averages every that many frames
+        uint32_t profile_log_interval{0};
+        // Number of threads recording secondary command buffers, 0 records everything into the primary on this thread
+        uint32_t record_threads{0};
+        // Threads decoding images while a scene loads, 0 uses every core
+        uint32_t loader_threads{0};
+        // Clamped to 1 to MAX_FRAMES_IN_FLIGHT when the frame sync is created
+        uint32_t frames_in_flight{2};
+        // Repeats the benchmark from the single threaded path up to record_threads (or every core) and prints the scaling
+        bool thread_sweep{false};
+        // Sort the opaque list by pipeline, material and index buffer so the recorder can skip repeated binds
+        bool sort_draws{true};
+        bool frustum_cull{true};
+        // Opaque surfaces are culled by a compute pass and drawn with indirect count draws, ignored when the
+        // device is missing the features for it
+        bool gpu_driven{false};
+        // Sizes of the vertex and index arenas every mesh is suballocated from, they don't grow
+        uint32_t vertex_arena_mb{static_cast<uint32_t>(Geometry::default_vertex_bytes / (1024 * 1024))};
+        uint32_t index_arena_mb{static_cast<uint32_t>(Geometry::default_index_bytes / (1024 * 1024))};
+        // Meshes are imported as 24 byte quantized vertices instead of the 64 byte float layout
+        bool compact_vertices{false};
+        // Cooked scene files keyed by source content, a warm load maps one instead of parsing the gltf
+        bool mesh_cache{true};
+        std::string mesh_cache_dir{"mesh_cache"};
+        // Driver pipeline cache kept on disk between runs, off compiles every pipeline from scratch
+        bool pipeline_cache{true};
+        std::string pipeline_cache_file{"pipeline_cache.bin"};
+        // Scene textures go up with only their coarse mips, finer ones are streamed in as draws get close
+        bool texture_streaming{true};
+        uint32_t texture_resident_size{TextureStreaming::default_resident_size};
+        // Interactive runs load the scene in the background and draw it once it's on the gpu
+        bool async_load{true};
+        // Non zero loads the scene this many times cold and warm, prints both and skips rendering
+        uint32_t load_benchmark_runs{0};
+        std::string scene_path{CORAX_DEFAULT_SCENE};
+        // Compiled .spv files, a missing one fails startup
+        std::string shader_dir{CORAX_SHADER_DIR};
+    };
+
+    // A scene loading in the background, added to loaded_scenes under name once it's ready
+    struct SceneLoad {
+        std::string name;
+        ResourceManagement::LoadHandle handle;
+        // Last count printed, progress is only logged when it moves
+        uint32_t images_decoded{0};
+    };
+
     struct CoraxRenderer {
         void run();
         void init();
@@ -60,11 +136,26 @@ namespace Vulkan
         void destroy();
         void recreateSwapChain();
         void initDepthImage();
+        void initOffscreenImage();
+        void runBenchmark(std::string_view label, bool print_frames);
+        void runThreadSweep();
+        void runLoadBenchmark();
+        MeshCache::Settings meshCacheSettings() const;
+        TextureStreaming::Streamer* textureStreamer();
+        void loadSceneAsync(const std::string& name, const std::string& filepath);
+        // Once a frame, moves finished loads into loaded_scenes
+        void pollSceneLoads();
+        void setRecordThreads(uint32_t thread_count);
+        void setViewportScissor(VkCommandBuffer cmd);
+        void recordParallel(FrameResources& frame, uint32_t scene_offset);
+        void readFrameTimestamps(FrameResources& frame);
+        void recordFrameCpuTime(const FrameResources& frame);
         uint32_t findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties);
         void updateScene(float delta_time);
         static void processInputKeyEvent(GLFWwindow* window, int key, int scancode, int action, int mods);
         static void processInputMouseEvent(GLFWwindow* window, double xpos, double ypos);
 
+        RendererOptions options{};
         Window glfw_window{};
         Instance instance{};
         Device device{};
@@ -86,19 +177,25 @@ namespace Vulkan
         uint32_t current_index{0};
         MeshBuffer rectangle;
         AllocatedImage depth_image;
+        AllocatedImage offscreen_image{};
         uint64_t last_frame_index{0};
 
         VkCommandPool transfer_pool;
+        Upload::Context uploader{};
+        Geometry::Buffers geometry{};
         VmaAllocator allocator;
 
         Scene scene_data;
         DescriptorLayout global_layout;
         DescriptorLayout scene_layout;
         DescriptorWrite descriptor_write;
+        UniformRing scene_ring{};
+        VkDescriptorSet scene_descriptor{VK_NULL_HANDLE};
         DescriptorAllocation global_descriptor_allocator{.pool_size_ratios = { 
 			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 },
 			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
 			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
 			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
         }, .num_pools = 1, .sets_per_pool = 1000};
 
@@ -117,6 +214,34 @@ namespace Vulkan
 
         MaterialOperation::DrawContext main_draw_context;
         std::unordered_map<std::string, std::shared_ptr<MaterialOperation::LoadedGLTF>> loaded_scenes;
+        std::vector<SceneLoad> scene_loads;
+        // Fallback images and samplers for materials without their own, background loads read them late
+        MaterialOperation::MaterialResources default_material_resources;
         Camera::Type fps_camera;
+
+        Benchmark::Run benchmark_run{};
+        bool benchmark_active{false};
+        uint64_t benchmark_first_frame{0};
+        std::chrono::high_resolution_clock::time_point frame_cpu_start{};
+        std::chrono::duration<double, std::milli> frame_cpu_wait{};
+
+        Profiler::Stats gpu_profile{};
+        ThreadPool record_pool;
+        // Asset loading work, image decoding for now
+        ThreadPool loader_pool;
+        TextureStreaming::Streamer texture_streamer;
+        // Textures and samplers shared by every loaded scene
+        TextureCache::Cache texture_cache;
+        Draw::Sorter draw_sorter;
+        // Bind and draw counts from the last recorded frame
+        Draw::Stats draw_stats{};
+        Culling::BoundsBatch cull_batch;
+        // Visible and culled surface counts for the last updated frame
+        Culling::Stats cull_stats{};
+        Culling::Frustum view_frustum{};
+        GpuDriven::Scene gpu_scene{};
+        Pipeline::Object* indirect_pipeline{nullptr};
+        Pipeline::ComputeObject* cull_pipeline{nullptr};
+        uint32_t frame_scope{UINT32_MAX};
     };
 }
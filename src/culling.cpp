@@ -0,0 +1,141 @@
+#include "culling.h"
+
+#include <algorithm>
+
+namespace Vulkan {
+    namespace Culling {
+        MaterialOperation::Bounds computeBounds(std::span<const Vertex> vertices) {
+            MaterialOperation::Bounds bounds{};
+            if (vertices.empty()) {
+                return bounds;
+            }
+
+            glm::vec3 min_pos = vertices[0].position;
+            glm::vec3 max_pos = vertices[0].position;
+            for (const Vertex& vertex : vertices) {
+                min_pos = glm::min(min_pos, vertex.position);
+                max_pos = glm::max(max_pos, vertex.position);
+            }
+            bounds.origin = (max_pos + min_pos) * 0.5f;
+            bounds.extents = (max_pos - min_pos) * 0.5f;
+
+            // Sphere around the box centre, sized by the furthest vertex rather than the box corner so it stays tight
+            float radius_sq = 0.0f;
+            for (const Vertex& vertex : vertices) {
+                glm::vec3 offset = vertex.position - bounds.origin;
+                radius_sq = std::max(radius_sq, glm::dot(offset, offset));
+            }
+            bounds.sphere_radius = std::sqrt(radius_sq);
+            return bounds;
+        }
+
+        Frustum extractFrustum(const glm::mat4& view_projection) {
+            // Gribb/Hartmann, glm is column major so row i is m[0][i], m[1][i], m[2][i], m[3][i]
+            auto row = [&view_projection](int i) {
+                return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i],
+                                 view_projection[3][i]);
+            };
+
+            Frustum frustum{};
+            frustum.planes[0] = row(3) + row(0);  // left
+            frustum.planes[1] = row(3) - row(0);  // right
+            frustum.planes[2] = row(3) + row(1);  // bottom
+            frustum.planes[3] = row(3) - row(1);  // top
+            // -1 to 1 depth near plane, with a 0 to 1 projection this sits a little behind the real one which is
+            // only ever more conservative
+            frustum.planes[4] = row(3) + row(2);  // near
+            frustum.planes[5] = row(3) - row(2);  // far
+
+            for (glm::vec4& plane : frustum.planes) {
+                plane /= glm::length(glm::vec3(plane));
+            }
+            return frustum;
+        }
+
+        static void gatherBounds(BoundsBatch& batch, const std::vector<MaterialOperation::RenderObject>& surfaces) {
+            size_t count = surfaces.size();
+            batch.center_x.resize(count);
+            batch.center_y.resize(count);
+            batch.center_z.resize(count);
+            batch.radius.resize(count);
+            batch.extent_x.resize(count);
+            batch.extent_y.resize(count);
+            batch.extent_z.resize(count);
+            batch.visible.resize(count);
+
+            for (size_t i = 0; i < count; i++) {
+                const glm::mat4& transform = surfaces[i].transform;
+                const MaterialOperation::Bounds& bounds = surfaces[i].bounds;
+
+                glm::vec3 center = glm::vec3(transform * glm::vec4(bounds.origin, 1.0f));
+                // Non uniform scale stretches the sphere, the largest axis keeps it conservative
+                float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+                                        glm::length(glm::vec3(transform[2]))});
+                // Extents of the world aligned box around the transformed box
+                glm::mat3 abs_basis(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])),
+                                    glm::abs(glm::vec3(transform[2])));
+                glm::vec3 extents = abs_basis * bounds.extents;
+
+                batch.center_x[i] = center.x;
+                batch.center_y[i] = center.y;
+                batch.center_z[i] = center.z;
+                batch.radius[i] = bounds.sphere_radius * scale;
+                batch.extent_x[i] = extents.x;
+                batch.extent_y[i] = extents.y;
+                batch.extent_z[i] = extents.z;
+                batch.visible[i] = 1;
+            }
+        }
+
+        static void testPlanes(BoundsBatch& batch, const Frustum& frustum) {
+            const size_t count = batch.visible.size();
+            const float* cx = batch.center_x.data();
+            const float* cy = batch.center_y.data();
+            const float* cz = batch.center_z.data();
+            const float* r = batch.radius.data();
+            const float* ex = batch.extent_x.data();
+            const float* ey = batch.extent_y.data();
+            const float* ez = batch.extent_z.data();
+            uint8_t* visible = batch.visible.data();
+
+            // Plane outer, surface inner, the inner loop is branch free over plain arrays so it vectorizes
+            for (const glm::vec4& plane : frustum.planes) {
+                const float nx = plane.x, ny = plane.y, nz = plane.z, d = plane.w;
+                const float ax = std::abs(nx), ay = std::abs(ny), az = std::abs(nz);
+                for (size_t i = 0; i < count; i++) {
+                    float distance = nx * cx[i] + ny * cy[i] + nz * cz[i] + d;
+                    float box_reach = ax * ex[i] + ay * ey[i] + az * ez[i];
+                    // Outside if either the sphere or the box is fully behind the plane
+                    uint8_t inside = static_cast<uint8_t>((distance + r[i] >= 0.0f) & (distance + box_reach >= 0.0f));
+                    visible[i] &= inside;
+                }
+            }
+        }
+
+        void cullSurfaces(BoundsBatch& batch, const Frustum& frustum,
+                          std::vector<MaterialOperation::RenderObject>& surfaces, Stats& stats) {
+            gatherBounds(batch, surfaces);
+            testPlanes(batch, frustum);
+
+            size_t kept = 0;
+            for (size_t i = 0; i < surfaces.size(); i++) {
+                if (batch.visible[i]) {
+                    if (kept != i) {
+                        surfaces[kept] = surfaces[i];
+                    }
+                    kept++;
+                }
+            }
+
+            stats.tested += static_cast<uint32_t>(surfaces.size());
+            stats.visible += static_cast<uint32_t>(kept);
+            stats.culled += static_cast<uint32_t>(surfaces.size() - kept);
+            surfaces.resize(kept);
+        }
+
+        void log(const Stats& stats) {
+            std::cout << "culling tested " << stats.tested << " visible " << stats.visible << " culled "
+                      << stats.culled << std::endl;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "material.h"
+
+#include <array>
+
+namespace Vulkan {
+    namespace Culling {
+        // Planes are (normal, distance) with normals pointing inwards, a point is inside when dot(n, p) + d >= 0
+        struct Frustum {
+            std::array<glm::vec4, 6> planes;
+        };
+
+        // World space bounds for a batch of surfaces, one array per component so the plane tests run
+        // over contiguous floats and the compiler can vectorize them
+        struct BoundsBatch {
+            std::vector<float> center_x;
+            std::vector<float> center_y;
+            std::vector<float> center_z;
+            std::vector<float> radius;
+            std::vector<float> extent_x;
+            std::vector<float> extent_y;
+            std::vector<float> extent_z;
+            std::vector<uint8_t> visible;
+        };
+
+        struct Stats {
+            uint32_t tested{0};
+            uint32_t visible{0};
+            uint32_t culled{0};
+        };
+
+        MaterialOperation::Bounds computeBounds(std::span<const Vertex> vertices);
+        Frustum extractFrustum(const glm::mat4& view_projection);
+        // Tests every surface against the frustum and compacts the visible ones to the front, order is kept
+        void cullSurfaces(BoundsBatch& batch, const Frustum& frustum,
+                          std::vector<MaterialOperation::RenderObject>& surfaces, Stats& stats);
+        void log(const Stats& stats);
+    }
+}
@@ -4,6 +4,7 @@
 #include "vulkan_utils.h"
 #include "window.h"
 
+#include <cstring>
 #include <exception>
 #include <set>
 
@@ -14,12 +15,19 @@ Device::Device(Device&& other) noexcept
     : physical_handle(std::move(other.physical_handle)),
       logical_handle(std::move(other.logical_handle)),
       suitability(std::move(other.suitability)),
+      properties(other.properties),
+      gpu_driven_supported(other.gpu_driven_supported),
+      sampler_anisotropy(other.sampler_anisotropy),
+      texture_compression_bc(other.texture_compression_bc),
       graphics_queue(std::move(other.graphics_queue)),
-      present_queue(std::move(other.present_queue)) {
+      present_queue(std::move(other.present_queue)),
+      transfer_queue(std::move(other.transfer_queue)),
+      dedicated_transfer(other.dedicated_transfer) {
     other.physical_handle = VK_NULL_HANDLE;
     other.logical_handle = VK_NULL_HANDLE;
     other.graphics_queue = VK_NULL_HANDLE;
     other.present_queue = VK_NULL_HANDLE;
+    other.transfer_queue = VK_NULL_HANDLE;
 }
 
 Device& Device::operator=(Device&& other) noexcept {
@@ -28,11 +36,18 @@ Device& Device::operator=(Device&& other) noexcept {
         logical_handle = std::move(other.logical_handle);
         graphics_queue = std::move(other.graphics_queue);
         present_queue = std::move(other.present_queue);
+        transfer_queue = std::move(other.transfer_queue);
+        dedicated_transfer = other.dedicated_transfer;
         suitability = std::move(other.suitability);
+        properties = other.properties;
+        gpu_driven_supported = other.gpu_driven_supported;
+        sampler_anisotropy = other.sampler_anisotropy;
+        texture_compression_bc = other.texture_compression_bc;
         other.physical_handle = VK_NULL_HANDLE;
         other.logical_handle = VK_NULL_HANDLE;
         other.graphics_queue = VK_NULL_HANDLE;
         other.present_queue = VK_NULL_HANDLE;
+        other.transfer_queue = VK_NULL_HANDLE;
     }
     return *this;
 }
@@ -51,31 +66,43 @@ void Device::initLogical(const Instance& instance) {
 
     std::cout << "suitability.queue_fam_indexes.size(): "
               << suitability.queue_fam_indexes.size() << std::endl;
-    std::map<std::string, uint32_t>::iterator it;
-    uint32_t last_queue_index{0};
-    uint32_t queue_count{1};
-    for (it = suitability.queue_fam_indexes.begin();
-         it != suitability.queue_fam_indexes.end(); it++) {
+    // Several roles can share a family, but each family may only be asked for once
+    std::set<uint32_t> unique_families;
+    for (const auto& [name, family] : suitability.queue_fam_indexes) {
+        unique_families.insert(family);
+    }
+    static const float priority = 1.0f;
+    for (uint32_t family : unique_families) {
         VkDeviceQueueCreateInfo queue_information{};
         queue_information.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        std::cout << "queue_information.queueFamilyIndex: " << it->second
+        std::cout << "queue_information.queueFamilyIndex: " << family
                   << std::endl;
-        if (last_queue_index != it->second) {
-            queue_count++;
-        }
-        queue_information.queueFamilyIndex = it->second;
+        queue_information.queueFamilyIndex = family;
         queue_information.queueCount = 1;
-        float priority = 1.0f;
         queue_information.pQueuePriorities = &priority;
         device_queue_information.push_back(queue_information);
-        last_queue_index = it->second;
     }
+    uint32_t queue_count = static_cast<uint32_t>(device_queue_information.size());
 
     suitability.vulkan12_features.sType =
         VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
     suitability.vulkan12_features.bufferDeviceAddress = VK_TRUE;
     suitability.vulkan12_features.pNext = nullptr;
     suitability.vulkan12_features.descriptorIndexing = VK_TRUE;
+    suitability.vulkan12_features.timelineSemaphore = VK_TRUE;
+
+    // Optional features for the gpu driven path, only switched on when the device has them
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physical_handle, &supported);
+    gpu_driven_supported = supported12.drawIndirectCount && supported.features.multiDrawIndirect &&
+                           supported.features.drawIndirectFirstInstance;
+    suitability.vulkan12_features.drawIndirectCount = gpu_driven_supported;
+    sampler_anisotropy = supported.features.samplerAnisotropy;
+    texture_compression_bc = supported.features.textureCompressionBC;
 
     VkPhysicalDeviceDynamicRenderingFeaturesKHR
         dynamic_rendering_info{};  // Zero initialize
@@ -103,12 +130,16 @@ void Device::initLogical(const Instance& instance) {
     }
     VkPhysicalDeviceFeatures features{};
     features.depthClamp = VK_TRUE;
+    features.multiDrawIndirect = gpu_driven_supported;
+    features.drawIndirectFirstInstance = gpu_driven_supported;
+    features.samplerAnisotropy = sampler_anisotropy;
+    features.textureCompressionBC = texture_compression_bc;
     // features.
     device_information.pEnabledFeatures = &features;
+    std::vector<const char*> extensions = enabledExtensions(instance);
     device_information.enabledExtensionCount =
-        static_cast<uint32_t>(required_device_extensions.size());
-    device_information.ppEnabledExtensionNames =
-        required_device_extensions.data();
+        static_cast<uint32_t>(extensions.size());
+    device_information.ppEnabledExtensionNames = extensions.data();
 
     vkCheck(vkCreateDevice(physical_handle, &device_information, nullptr,
                            &logical_handle));
@@ -124,10 +155,13 @@ void Device::initPhysical(const Instance& instance) {
     std::vector<VkPhysicalDevice> devices(num_device_found);
     vkEnumeratePhysicalDevices(instance.handle, &num_device_found,
                                devices.data());
+    suitability.headless = instance.headless;
     for (const auto& device : devices) {
         checkDeviceSuitability(device, suitability, instance);
         checkDeviceExtensions(device, instance);
-        querySwapChainSupport(device, instance);
+        if (!instance.headless) {
+            querySwapChainSupport(device, instance);
+        }
         if (suitability.result()) {
             physical_handle = device;
             std::cout << "Device chosen" << std::endl;
@@ -139,6 +173,9 @@ void Device::initPhysical(const Instance& instance) {
         throw std::runtime_error("failed to find a suitable GPU!");
     }
 
+    vkGetPhysicalDeviceProperties(physical_handle, &properties);
+    std::cout << "Using device: " << properties.deviceName << std::endl;
+
     VkFormatProperties formatProperties;
     vkGetPhysicalDeviceFormatProperties(physical_handle, VK_FORMAT_D32_SFLOAT, &formatProperties);
     if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)) {
@@ -153,7 +190,11 @@ void Device::initPhysical(const Instance& instance) {
     vkGetPhysicalDeviceProperties2(physical_handle, &deviceProps);
 
     if (!(depthResolveProps.supportedDepthResolveModes & VK_RESOLVE_MODE_MAX_BIT)) {
-        throw std::runtime_error("Depth resolve mode is not supported.");
+        // Software ICDs like lavapipe dont expose max resolve, nothing uses it yet so dont refuse to run headless
+        if (!instance.headless) {
+            throw std::runtime_error("Depth resolve mode is not supported.");
+        }
+        std::cout << "Depth resolve mode max is not supported" << std::endl;
     }
 
 }
@@ -169,7 +210,8 @@ void Device::checkDeviceSuitability(const VkPhysicalDevice& device,
     suitability.properties_suitable =
         suitability.properties_suitable |
         (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) |
-        (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU);
+        (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) |
+        (instance.headless && properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU);
 
     uint32_t num_queue_families{0};
     vkGetPhysicalDeviceQueueFamilyProperties(device, &num_queue_families,
@@ -200,6 +242,14 @@ void Device::checkDeviceSuitability(const VkPhysicalDevice& device,
             suitability.queue_fam_indexes["draw"] = i;
             suitability.queue_fam_total++;
         }
+        if (instance.headless) {
+            // Nothing is presented, keep the present slot pointing at the draw family so lookups stay valid
+            if (suitability.queue_fam_draw_suitable) {
+                suitability.queue_fam_indexes["present"] = i;
+            }
+            i++;
+            continue;
+        }
         uint32_t present_support{0};
         vkCheck(vkGetPhysicalDeviceSurfaceSupportKHR(
             device, i, instance.surface, &present_support));
@@ -210,6 +260,29 @@ void Device::checkDeviceSuitability(const VkPhysicalDevice& device,
         }
         i++;
     }
+
+    // A transfer only family is the copy engine on discrete cards and runs alongside graphics. Failing that
+    // take any non graphics family with transfer, and last of all just share the draw family
+    int dedicated_family{-1};
+    int separate_family{-1};
+    for (uint32_t family = 0; family < num_queue_families; family++) {
+        VkQueueFlags flags = queue_fams[family].queueFlags;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
+        }
+        if (!(flags & VK_QUEUE_COMPUTE_BIT) && dedicated_family < 0) {
+            dedicated_family = static_cast<int>(family);
+        } else if (separate_family < 0) {
+            separate_family = static_cast<int>(family);
+        }
+    }
+    if (dedicated_family >= 0) {
+        suitability.queue_fam_indexes["transfer"] = static_cast<uint32_t>(dedicated_family);
+    } else if (separate_family >= 0) {
+        suitability.queue_fam_indexes["transfer"] = static_cast<uint32_t>(separate_family);
+    } else {
+        suitability.queue_fam_indexes["transfer"] = suitability.queue_fam_indexes["draw"];
+    }
 }
 
 void Device::checkDeviceExtensions(const VkPhysicalDevice& device,
@@ -222,8 +295,9 @@ void Device::checkDeviceExtensions(const VkPhysicalDevice& device,
     vkEnumerateDeviceExtensionProperties(device, nullptr, &num_extensions,
                                          extensions_found.data());
 
+    std::vector<const char*> enabled_extensions = enabledExtensions(instance);
     std::set<std::string> required_extensions(
-        required_device_extensions.begin(), required_device_extensions.end());
+        enabled_extensions.begin(), enabled_extensions.end());
     uint32_t found_required{0};
     for (const auto& extension : extensions_found) {
         auto it = required_extensions.find(extension.extensionName);
@@ -264,11 +338,28 @@ void Device::querySwapChainSupport(const VkPhysicalDevice& device,
     }
 }
 
+std::vector<const char*> Device::enabledExtensions(const Instance& instance) const {
+    std::vector<const char*> extensions;
+    for (const char* extension : required_device_extensions) {
+        if (instance.headless && strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
+            continue;
+        }
+        extensions.push_back(extension);
+    }
+    return extensions;
+}
+
 void Device::initQueues() {
     vkGetDeviceQueue(logical_handle, suitability.queue_fam_indexes["draw"], 0,
                      &graphics_queue);
     vkGetDeviceQueue(logical_handle, suitability.queue_fam_indexes["present"],
                      0, &present_queue);
+    vkGetDeviceQueue(logical_handle, suitability.queue_fam_indexes["transfer"],
+                     0, &transfer_queue);
+    dedicated_transfer = suitability.queue_fam_indexes["transfer"] !=
+                         suitability.queue_fam_indexes["draw"];
+    std::cout << "Transfer queue family " << suitability.queue_fam_indexes["transfer"]
+              << (dedicated_transfer ? " (dedicated)" : " (shared with draw)") << std::endl;
     std::cout << "Initialized queues" << std::endl;
 }
 
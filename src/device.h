@@ -22,6 +22,7 @@ struct DeviceSuitability {
     VkBool32 queue_fam_draw_suitable{false};
     VkBool32 queue_fam_present_suitable{false};
     uint32_t queue_fam_draw_index{0};
+    VkBool32 headless{false};
     VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address_features{};
     VkPhysicalDeviceVulkan12Features vulkan12_features{};
 
@@ -30,9 +31,9 @@ struct DeviceSuitability {
         result = result && (properties_suitable && true);
         result = result && (features_suitable | true);
         result = result && (queue_fam_draw_suitable | true);
-        result = result && (queue_fam_present_suitable && true);
+        result = result && (queue_fam_present_suitable || headless);
         result = result && (extension_suitable && true);
-        result = result && (!formats.empty() && !present_modes.empty());
+        result = result && ((!formats.empty() && !present_modes.empty()) || headless);
         return result;
     }
 };
@@ -53,12 +54,19 @@ struct Device {
     void checkDeviceExtensions(const VkPhysicalDevice& device, const Instance& instance);
     void querySwapChainSupport(const VkPhysicalDevice& device, const Instance& instance);
     void initQueues();
+    std::vector<const char*> enabledExtensions(const Instance& instance) const;
     void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
     
 
     VkPhysicalDevice physical_handle{VK_NULL_HANDLE};
     VkDevice logical_handle{VK_NULL_HANDLE};
     DeviceSuitability suitability;
+    VkPhysicalDeviceProperties properties{};
+    // drawIndirectCount, multiDrawIndirect and drawIndirectFirstInstance are all there, the gpu driven path needs them
+    bool gpu_driven_supported{false};
+    // samplerAnisotropy and textureCompressionBC, each switched on when the device has it
+    bool sampler_anisotropy{false};
+    bool texture_compression_bc{false};
     const std::vector<const char*> required_device_extensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
@@ -68,6 +76,9 @@ struct Device {
 
     VkQueue graphics_queue;
     VkQueue present_queue;
+    // Same queue as graphics_queue when the device has no separate transfer family
+    VkQueue transfer_queue{VK_NULL_HANDLE};
+    bool dedicated_transfer{false};
 
 };
 }
@@ -0,0 +1,147 @@
+#include "draw.h"
+
+#include <array>
+
+namespace Vulkan {
+    namespace Draw {
+        static uint32_t idFor(std::unordered_map<const void*, uint32_t>& ids, const void* handle, uint32_t bits) {
+            auto it = ids.find(handle);
+            if (it != ids.end()) {
+                return it->second;
+            }
+            // Out of ids just folds the overflow onto existing ones, the sort gets worse but stays correct
+            uint32_t id = static_cast<uint32_t>(ids.size()) & ((1u << bits) - 1);
+            ids.emplace(handle, id);
+            return id;
+        }
+
+        uint64_t makeKey(KeyTable& table, const MaterialOperation::RenderObject& object) {
+            uint64_t pass = static_cast<uint64_t>(object.material->pass_type) & 0x3;
+            uint64_t pipeline = idFor(table.pipelines, object.material->pipeline, pipeline_bits);
+            uint64_t material = idFor(table.materials, object.material->material_set, material_bits);
+            uint64_t index_buffer = idFor(table.index_buffers, object.index_buffer, index_buffer_bits);
+
+            return (pass << 62) | (pipeline << (material_bits + index_buffer_bits)) |
+                   (material << index_buffer_bits) | index_buffer;
+        }
+
+        void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch) {
+            scratch.resize(entries.size());
+            if (entries.size() < 2) {
+                return;
+            }
+
+            // All eight histograms in one read over the keys
+            std::array<std::array<uint32_t, 256>, 8> counts{};
+            for (const SortEntry& entry : entries) {
+                for (uint32_t digit = 0; digit < 8; digit++) {
+                    counts[digit][(entry.key >> (digit * 8)) & 0xff]++;
+                }
+            }
+
+            const uint32_t count = static_cast<uint32_t>(entries.size());
+            for (uint32_t digit = 0; digit < 8; digit++) {
+                std::array<uint32_t, 256>& histogram = counts[digit];
+                // Every key shares this byte, the pass would be a plain copy
+                if (histogram[(entries[0].key >> (digit * 8)) & 0xff] == count) {
+                    continue;
+                }
+
+                uint32_t offset = 0;
+                for (uint32_t& bucket : histogram) {
+                    uint32_t size = bucket;
+                    bucket = offset;
+                    offset += size;
+                }
+
+                for (const SortEntry& entry : entries) {
+                    scratch[histogram[(entry.key >> (digit * 8)) & 0xff]++] = entry;
+                }
+                entries.swap(scratch);
+            }
+        }
+
+        void sortSurfaces(Sorter& sorter, std::vector<MaterialOperation::RenderObject>& surfaces) {
+            sorter.entries.resize(surfaces.size());
+            for (uint32_t i = 0; i < surfaces.size(); i++) {
+                sorter.entries[i] = {makeKey(sorter.keys, surfaces[i]), i};
+            }
+            radixSort(sorter.entries, sorter.scratch);
+
+            sorter.sorted.resize(surfaces.size());
+            for (uint32_t i = 0; i < sorter.entries.size(); i++) {
+                sorter.sorted[i] = surfaces[sorter.entries[i].index];
+            }
+            surfaces.swap(sorter.sorted);
+        }
+
+        void begin(Recorder& recorder, VkCommandBuffer cmd, VkDescriptorSet scene_set, uint32_t scene_offset) {
+            recorder = {};
+            recorder.cmd = cmd;
+            recorder.scene_set = scene_set;
+            recorder.scene_offset = scene_offset;
+        }
+
+        void record(Recorder& recorder, const MaterialOperation::RenderObject& object) {
+            // Still compiling without anything to stand in, the surface just isn't drawn this frame
+            const Pipeline::Object* pipeline = Pipeline::resolve(object.material->pipeline);
+            if (pipeline == nullptr) {
+                recorder.stats.skipped++;
+                return;
+            }
+
+            if (pipeline->handle != recorder.pipeline) {
+                vkCmdBindPipeline(recorder.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->handle);
+                recorder.pipeline = pipeline->handle;
+                recorder.stats.pipeline_binds++;
+            }
+
+            // A new layout might not be compatible with what was bound, so both sets go again
+            if (pipeline->layout_handle != recorder.layout) {
+                vkCmdBindDescriptorSets(recorder.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout_handle, 0, 1,
+                                        &recorder.scene_set, 1, &recorder.scene_offset);
+                recorder.layout = pipeline->layout_handle;
+                recorder.material_set = VK_NULL_HANDLE;
+                recorder.stats.descriptor_binds++;
+            }
+
+            if (object.material->material_set != recorder.material_set) {
+                vkCmdBindDescriptorSets(recorder.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout_handle, 1, 1,
+                                        &object.material->material_set, 0, nullptr);
+                recorder.material_set = object.material->material_set;
+                recorder.stats.descriptor_binds++;
+            }
+
+            if (object.index_buffer != recorder.index_buffer) {
+                vkCmdBindIndexBuffer(recorder.cmd, object.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+                recorder.index_buffer = object.index_buffer;
+                recorder.stats.index_binds++;
+            }
+
+            GPUDrawPushConstants push_constants;
+            push_constants.vertexBuffer = object.vertex_buffer_address;
+            push_constants.worldMatrix = object.transform;
+            vkCmdPushConstants(recorder.cmd, pipeline->layout_handle, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(GPUDrawPushConstants), &push_constants);
+            recorder.stats.push_constants++;
+
+            vkCmdDrawIndexed(recorder.cmd, object.index_ount, 1, object.first_index, 0, 0);
+            recorder.stats.draws++;
+        }
+
+        void accumulate(Stats& total, const Stats& stats) {
+            total.draws += stats.draws;
+            total.pipeline_binds += stats.pipeline_binds;
+            total.descriptor_binds += stats.descriptor_binds;
+            total.index_binds += stats.index_binds;
+            total.push_constants += stats.push_constants;
+            total.skipped += stats.skipped;
+        }
+
+        void log(const Stats& stats) {
+            std::cout << "draws " << stats.draws << " pipeline binds " << stats.pipeline_binds << " descriptor binds "
+                      << stats.descriptor_binds << " index binds " << stats.index_binds << " skipped "
+                      << stats.skipped << std::endl;
+        }
+    }
+}
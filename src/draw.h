@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "material.h"
+
+#include <unordered_map>
+
+namespace Vulkan {
+    namespace Draw {
+        // Key layout, most significant first so sorting groups by the most expensive state change:
+        // [63:62] pass, [61:48] pipeline, [47:24] material set, [23:0] index buffer
+        constexpr uint32_t pipeline_bits{14};
+        constexpr uint32_t material_bits{24};
+        constexpr uint32_t index_buffer_bits{24};
+
+        // Hands out small dense ids for handles so they fit in the key. Ids stay stable across frames,
+        // a handle being reused after a free just means its draws sort with whatever owned it before
+        struct KeyTable {
+            std::unordered_map<const void*, uint32_t> pipelines;
+            std::unordered_map<const void*, uint32_t> materials;
+            std::unordered_map<const void*, uint32_t> index_buffers;
+        };
+
+        struct SortEntry {
+            uint64_t key;
+            uint32_t index;
+        };
+
+        // Key ids plus scratch kept between frames so sorting does not allocate once the scene settles
+        struct Sorter {
+            KeyTable keys;
+            std::vector<SortEntry> entries;
+            std::vector<SortEntry> scratch;
+            std::vector<MaterialOperation::RenderObject> sorted;
+        };
+
+        struct Stats {
+            uint32_t draws{0};
+            uint32_t pipeline_binds{0};
+            uint32_t descriptor_binds{0};
+            uint32_t index_binds{0};
+            uint32_t push_constants{0};
+            // Surfaces whose pipeline wasn't built yet and had no fallback
+            uint32_t skipped{0};
+        };
+
+        // Tracks what is currently bound on one command buffer so repeated state is skipped
+        struct Recorder {
+            VkCommandBuffer cmd{VK_NULL_HANDLE};
+            VkPipeline pipeline{VK_NULL_HANDLE};
+            VkPipelineLayout layout{VK_NULL_HANDLE};
+            VkDescriptorSet material_set{VK_NULL_HANDLE};
+            VkBuffer index_buffer{VK_NULL_HANDLE};
+            VkDescriptorSet scene_set{VK_NULL_HANDLE};
+            uint32_t scene_offset{0};
+            Stats stats{};
+        };
+
+        uint64_t makeKey(KeyTable& table, const MaterialOperation::RenderObject& object);
+        // LSD radix sort on 8 bit digits, passes where every key has the same digit are skipped
+        void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+        // Reorders the surfaces by key, only meant for the opaque list, transparent order is left to the caller
+        void sortSurfaces(Sorter& sorter, std::vector<MaterialOperation::RenderObject>& surfaces);
+
+        void begin(Recorder& recorder, VkCommandBuffer cmd, VkDescriptorSet scene_set, uint32_t scene_offset);
+        void record(Recorder& recorder, const MaterialOperation::RenderObject& object);
+        void accumulate(Stats& total, const Stats& stats);
+        void log(const Stats& stats);
+    }
+}
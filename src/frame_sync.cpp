@@ -4,6 +4,8 @@
 #include "device.h"
 #include "vulkan_operations.h"
 
+#include <algorithm>
+
 namespace Vulkan {
     FrameSync::FrameSync()
     {  
@@ -23,13 +25,66 @@ namespace Vulkan {
         {
             std::swap(frames, other.frames);
             std::swap(current_frame, other.current_frame);
+            std::swap(graphics_timeline, other.graphics_timeline);
+            std::swap(deferred_deletion, other.deferred_deletion);
         }
         return *this;
     }
 
-    void FrameSync::create(const Device& device) 
+    namespace Timelines {
+        void create(const Device& device, Timeline& timeline) {
+            VkSemaphoreTypeCreateInfo type_info{};
+            type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            type_info.initialValue = 0;
+
+            VkSemaphoreCreateInfo sem_info{};
+            sem_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            sem_info.pNext = &type_info;
+            vkCheck(vkCreateSemaphore(device.logical_handle, &sem_info, nullptr, &timeline.semaphore));
+            timeline.last_submitted = 0;
+        }
+
+        void destroy(const Device& device, Timeline& timeline) {
+            if (timeline.semaphore) {
+                vkDestroySemaphore(device.logical_handle, timeline.semaphore, nullptr);
+                timeline.semaphore = VK_NULL_HANDLE;
+            }
+        }
+
+        uint64_t nextValue(Timeline& timeline) {
+            return ++timeline.last_submitted;
+        }
+
+        uint64_t completedValue(const Device& device, const Timeline& timeline) {
+            uint64_t value{0};
+            vkCheck(vkGetSemaphoreCounterValue(device.logical_handle, timeline.semaphore, &value));
+            return value;
+        }
+
+        bool isComplete(const Device& device, const Timeline& timeline, uint64_t value) {
+            return value == 0 || completedValue(device, timeline) >= value;
+        }
+
+        void wait(const Device& device, const Timeline& timeline, uint64_t value, uint64_t timeout) {
+            if (value == 0) {
+                return;
+            }
+            VkSemaphoreWaitInfo wait_info{};
+            wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            wait_info.semaphoreCount = 1;
+            wait_info.pSemaphores = &timeline.semaphore;
+            wait_info.pValues = &value;
+            vkCheck(vkWaitSemaphores(device.logical_handle, &wait_info, timeout));
+        }
+    }
+
+    void FrameSync::create(const Device& device, uint32_t frames_in_flight) 
     {
-        for (size_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+        frames.resize(std::clamp(frames_in_flight, 1u, MAX_FRAMES_IN_FLIGHT));
+        Timelines::create(device, graphics_timeline);
+
+        for (size_t i = 0; i < frames.size(); i++)
         {
 
             VkCommandPoolCreateInfo pool_info{};
@@ -54,20 +109,73 @@ namespace Vulkan {
             vkCheck(vkCreateSemaphore(device.logical_handle, &sem_info, nullptr, 
                                     &frames[i].render_finished_semaphore));
 
-            VkFenceCreateInfo fence_info{};
-            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-            vkCheck(vkCreateFence(device.logical_handle, &fence_info, nullptr, 
-                                &frames[i].in_flight_fence));
+            Profiler::createQueries(device, frames[i].gpu_queries);
 
             Descriptors::initPool(frames[i].frame_descriptor_allocator, device);
         }
     }
         
+    void FrameSync::createThreadCommands(const Device& device, uint32_t thread_count)
+    {
+        for (auto& frame : frames)
+        {
+            frame.thread_commands.resize(thread_count);
+            for (ThreadCommands& commands : frame.thread_commands)
+            {
+                VkCommandPoolCreateInfo pool_info{};
+                pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                pool_info.queueFamilyIndex = device.suitability.queue_fam_indexes.at("draw");
+                pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                vkCheck(vkCreateCommandPool(device.logical_handle, &pool_info, nullptr, &commands.pool));
+
+                VkCommandBuffer buffers[2]{};
+                VkCommandBufferAllocateInfo alloc_info{};
+                alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                alloc_info.commandPool = commands.pool;
+                alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                alloc_info.commandBufferCount = 2;
+                vkCheck(vkAllocateCommandBuffers(device.logical_handle, &alloc_info, buffers));
+                commands.opaque = buffers[0];
+                commands.transparent = buffers[1];
+            }
+        }
+    }
+
+    void FrameSync::destroyThreadCommands(const Device& device)
+    {
+        for (auto& frame : frames)
+        {
+            for (ThreadCommands& commands : frame.thread_commands)
+            {
+                vkDestroyCommandPool(device.logical_handle, commands.pool, nullptr);
+            }
+            frame.thread_commands.clear();
+        }
+    }
+
     uint64_t FrameSync::advanceFrame()
     {
         current_frame++;
-        return (current_frame % FRAMES_IN_FLIGHT);
+        return (current_frame % frames.size());
+    }
+
+    void FrameSync::deferDestroy(std::function<void()>&& function)
+    {
+        deferred_deletion.emplace_back(graphics_timeline.last_submitted + 1, std::move(function));
+    }
+
+    void FrameSync::collectGarbage(const Device& device)
+    {
+        if (deferred_deletion.empty())
+        {
+            return;
+        }
+        uint64_t completed = Timelines::completedValue(device, graphics_timeline);
+        while (!deferred_deletion.empty() && deferred_deletion.front().first <= completed)
+        {
+            deferred_deletion.front().second();
+            deferred_deletion.pop_front();
+        }
     }
 
     // Maybe add a dynamic clear here, clean out any frame data from the not in use frames
@@ -75,6 +183,7 @@ namespace Vulkan {
     void FrameSync::destroy(const Device& device) {
 
         vkDeviceWaitIdle(device.logical_handle);  // ensure no GPU operations are pending
+        destroyThreadCommands(device);
 
         for (auto& frame : frames)
         {
@@ -97,13 +206,17 @@ namespace Vulkan {
                 vkDestroySemaphore(device.logical_handle, frame.render_finished_semaphore, nullptr);
                 frame.render_finished_semaphore = VK_NULL_HANDLE;
             }
-            if (frame.in_flight_fence)
-            {
-                vkDestroyFence(device.logical_handle, frame.in_flight_fence, nullptr);
-                frame.in_flight_fence = VK_NULL_HANDLE;
-            }
+
+            Profiler::destroyQueries(device, frame.gpu_queries);
 
             Descriptors::destroyPools(frame.frame_descriptor_allocator, device);
         }
+
+        for (auto& [value, function] : deferred_deletion)
+        {
+            function();
+        }
+        deferred_deletion.clear();
+        Timelines::destroy(device, graphics_timeline);
     }
 }
\ No newline at end of file
@@ -1,13 +1,39 @@
 #pragma once
 
 #include "vulkan_common.h"
+#include "profiler.h"
 
-#include <array>
+#include <deque>
+#include <functional>
 
 namespace Vulkan {
 
     struct Device;
-    constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+    constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+    // One per queue. Every submit on the queue signals the next value, so asking whether gpu work N is done
+    // is just comparing against the counter
+    struct Timeline {
+        VkSemaphore semaphore{VK_NULL_HANDLE};
+        uint64_t last_submitted{0};
+    };
+
+    namespace Timelines {
+        void create(const Device& device, Timeline& timeline);
+        void destroy(const Device& device, Timeline& timeline);
+        // Value the next submit should signal, bumps last_submitted
+        uint64_t nextValue(Timeline& timeline);
+        uint64_t completedValue(const Device& device, const Timeline& timeline);
+        bool isComplete(const Device& device, const Timeline& timeline, uint64_t value);
+        void wait(const Device& device, const Timeline& timeline, uint64_t value, uint64_t timeout = UINT64_MAX);
+    }
+
+    // Pools can only be touched by one thread at a time, so every recording slot gets its own pool per frame
+    struct ThreadCommands {
+        VkCommandPool pool{VK_NULL_HANDLE};
+        VkCommandBuffer opaque{VK_NULL_HANDLE};
+        VkCommandBuffer transparent{VK_NULL_HANDLE};
+    };
 
     struct FrameResources {
         VkCommandPool command_pool{VK_NULL_HANDLE};
@@ -15,7 +41,14 @@ namespace Vulkan {
 
         VkSemaphore image_available_semaphore{VK_NULL_HANDLE};
         VkSemaphore render_finished_semaphore{VK_NULL_HANDLE};
-        VkFence in_flight_fence{VK_NULL_HANDLE};
+        // Graphics timeline value signalled by the last submit from this slot, 0 if it was never submitted
+        uint64_t timeline_value{0};
+
+        std::vector<ThreadCommands> thread_commands;
+
+        // Gpu timestamp scopes recorded this frame, read back once the timeline has passed this slot's value
+        Profiler::FrameQueries gpu_queries;
+        uint64_t frame_number{0};
 
         DescriptorAllocation frame_descriptor_allocator{.pool_size_ratios = { 
 			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 },
@@ -35,11 +68,18 @@ namespace Vulkan {
         FrameSync(FrameSync &&other) noexcept;
         FrameSync &operator=(FrameSync &&other) noexcept;
 
-        void create(const Device& device);
+        void create(const Device& device, uint32_t frames_in_flight);
         void destroy(const Device& device);
+        // Runs function once the gpu has finished everything submitted so far plus the frame being recorded
+        void deferDestroy(std::function<void()>&& function);
+        void collectGarbage(const Device& device);
+        void createThreadCommands(const Device& device, uint32_t thread_count);
+        void destroyThreadCommands(const Device& device);
         uint64_t advanceFrame();
         
         uint32_t current_frame{0};
-        std::array<FrameResources, FRAMES_IN_FLIGHT> frames;
+        std::vector<FrameResources> frames;
+        Timeline graphics_timeline{};
+        std::deque<std::pair<uint64_t, std::function<void()>>> deferred_deletion;
     };
 }
\ No newline at end of file
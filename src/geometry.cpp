@@ -0,0 +1,124 @@
+#include "geometry.h"
+#include "device.h"
+#include "vulkan_operations.h"
+
+#include <algorithm>
+#include <string>
+
+namespace Vulkan {
+    namespace Geometry {
+        static void createArena(const Device& device, VmaAllocator allocator, Arena& arena, VkDeviceSize size,
+                                VkDeviceSize granularity, VkBufferUsageFlags usage) {
+            arena.buffer = Buffer::allocateBuffer(allocator, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                  VMA_MEMORY_USAGE_GPU_ONLY);
+            if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+                VkBufferDeviceAddressInfo address_info{.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                                                       .buffer = arena.buffer.buffer};
+                arena.address = vkGetBufferDeviceAddress(device.logical_handle, &address_info);
+            }
+            initFreeList(arena.ranges, size, granularity);
+        }
+
+        void create(const Device& device, VmaAllocator allocator, Buffers& geometry, VkDeviceSize vertex_bytes,
+                    VkDeviceSize index_bytes, VertexLayout vertex_layout) {
+            geometry.vertex_layout = vertex_layout;
+            createArena(device, allocator, geometry.vertices, vertex_bytes, vertex_granularity,
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+            createArena(device, allocator, geometry.indices, index_bytes, index_granularity,
+                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+            std::cout << "geometry arenas: " << vertex_bytes / (1024 * 1024) << " MB vertices, "
+                      << index_bytes / (1024 * 1024) << " MB indices, "
+                      << (vertex_layout == VertexLayout::COMPACT ? "compact" : "full") << " vertices" << std::endl;
+        }
+
+        void destroy(VmaAllocator allocator, Buffers& geometry) {
+            Buffer::destroyBuffer(allocator, geometry.vertices.buffer);
+            Buffer::destroyBuffer(allocator, geometry.indices.buffer);
+            geometry.vertices = {};
+            geometry.indices = {};
+        }
+
+        void initFreeList(FreeList& list, VkDeviceSize capacity, VkDeviceSize granularity) {
+            list.capacity = capacity - capacity % granularity;
+            list.granularity = granularity;
+            list.used = 0;
+            list.free.clear();
+            list.free.push_back({0, list.capacity});
+        }
+
+        Range allocate(FreeList& list, VkDeviceSize size) {
+            if (size == 0) {
+                return {};
+            }
+            size = (size + list.granularity - 1) / list.granularity * list.granularity;
+
+            for (size_t i = 0; i < list.free.size(); i++) {
+                Range& candidate = list.free[i];
+                if (candidate.size < size) {
+                    continue;
+                }
+                Range range{candidate.offset, size};
+                candidate.offset += size;
+                candidate.size -= size;
+                if (candidate.size == 0) {
+                    list.free.erase(list.free.begin() + i);
+                }
+                list.used += size;
+                return range;
+            }
+            return {};
+        }
+
+        void release(FreeList& list, Range range) {
+            if (range.size == 0) {
+                return;
+            }
+            auto next = std::lower_bound(list.free.begin(), list.free.end(), range.offset,
+                                         [](const Range& r, VkDeviceSize offset) { return r.offset < offset; });
+            list.used -= range.size;
+
+            // Merge into the free range before and/or after it when they touch
+            bool joins_prev = next != list.free.begin() && (next - 1)->offset + (next - 1)->size == range.offset;
+            bool joins_next = next != list.free.end() && range.offset + range.size == next->offset;
+            if (joins_prev && joins_next) {
+                (next - 1)->size += range.size + next->size;
+                list.free.erase(next);
+            } else if (joins_prev) {
+                (next - 1)->size += range.size;
+            } else if (joins_next) {
+                next->offset = range.offset;
+                next->size += range.size;
+            } else {
+                list.free.insert(next, range);
+            }
+        }
+
+        static Range allocateFrom(Arena& arena, VkDeviceSize size, const char* name) {
+            Range range = allocate(arena.ranges, size);
+            if (range.size == 0 && size != 0) {
+                throw std::runtime_error(std::string("geometry arena out of space for ") + name + ": " +
+                                         std::to_string(size) + " bytes requested, " +
+                                         std::to_string(arena.ranges.capacity - arena.ranges.used) + " free in " +
+                                         std::to_string(arena.ranges.free.size()) + " ranges");
+            }
+            return range;
+        }
+
+        Range allocateVertices(Buffers& geometry, VkDeviceSize size) {
+            return allocateFrom(geometry.vertices, size, "vertices");
+        }
+
+        Range allocateIndices(Buffers& geometry, VkDeviceSize size) {
+            return allocateFrom(geometry.indices, size, "indices");
+        }
+
+        void logUsage(const Buffers& geometry) {
+            auto mb = [](VkDeviceSize bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+            std::cout << "geometry arenas: vertices " << mb(geometry.vertices.ranges.used) << "/"
+                      << mb(geometry.vertices.ranges.capacity) << " MB in "
+                      << geometry.vertices.ranges.free.size() << " free ranges, indices "
+                      << mb(geometry.indices.ranges.used) << "/" << mb(geometry.indices.ranges.capacity)
+                      << " MB in " << geometry.indices.ranges.free.size() << " free ranges" << std::endl;
+        }
+    }
+}
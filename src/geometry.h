@@ -0,0 +1,67 @@
+#pragma once
+
+#include "vulkan_common.h"
+
+namespace Vulkan {
+
+    struct Device;
+
+    namespace Geometry {
+        constexpr VkDeviceSize default_vertex_bytes{256ull * 1024 * 1024};
+        constexpr VkDeviceSize default_index_bytes{64ull * 1024 * 1024};
+        // Every vertex range starts on this so the range's device address suits any vertex layout
+        constexpr VkDeviceSize vertex_granularity{64};
+        constexpr VkDeviceSize index_granularity{sizeof(uint32_t)};
+
+        // What every mesh in the arenas was imported as, the vertex shaders are specialized to match
+        enum class VertexLayout {
+            FULL,
+            COMPACT
+        };
+
+        struct Range {
+            VkDeviceSize offset{0};
+            VkDeviceSize size{0};
+        };
+
+        // Free ranges kept sorted by offset. Allocation is first fit and sizes are rounded up to the
+        // granularity, so freeing a range can always merge it with its neighbours
+        struct FreeList {
+            VkDeviceSize capacity{0};
+            VkDeviceSize granularity{1};
+            VkDeviceSize used{0};
+            std::vector<Range> free;
+        };
+
+        // One big buffer that meshes take ranges out of. It never grows since that would move every address
+        // already handed out
+        struct Arena {
+            AllocatedBuffer buffer{};
+            VkDeviceAddress address{0};
+            FreeList ranges{};
+        };
+
+        // Every mesh lives in these two, so a whole scene binds one index buffer and vertex pulling only
+        // needs the address of the mesh's range
+        struct Buffers {
+            Arena vertices{};
+            Arena indices{};
+            VertexLayout vertex_layout{VertexLayout::FULL};
+        };
+
+        void create(const Device& device, VmaAllocator allocator, Buffers& geometry, VkDeviceSize vertex_bytes,
+                    VkDeviceSize index_bytes, VertexLayout vertex_layout);
+        void destroy(VmaAllocator allocator, Buffers& geometry);
+
+        void initFreeList(FreeList& list, VkDeviceSize capacity, VkDeviceSize granularity);
+        // Returns an empty range when nothing big enough is free
+        Range allocate(FreeList& list, VkDeviceSize size);
+        void release(FreeList& list, Range range);
+
+        // Throws when the arena is full, the arena sizes are options so the fix is a bigger arena
+        Range allocateVertices(Buffers& geometry, VkDeviceSize size);
+        Range allocateIndices(Buffers& geometry, VkDeviceSize size);
+
+        void logUsage(const Buffers& geometry);
+    }
+}
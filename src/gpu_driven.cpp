@@ -0,0 +1,199 @@
+#include "gpu_driven.h"
+#include "vulkan_operations.h"
+
+#include <map>
+
+namespace Vulkan {
+    namespace GpuDriven {
+        static VkDeviceAddress addressOf(const Device& device, const AllocatedBuffer& buffer) {
+            VkBufferDeviceAddressInfo address_info{.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                                                   .buffer = buffer.buffer};
+            return vkGetBufferDeviceAddress(device.logical_handle, &address_info);
+        }
+
+        template <typename T>
+        static AllocatedBuffer upload(const Device& device, VmaAllocator allocator, Upload::Context& uploader,
+                                      const std::vector<T>& data, VkBufferUsageFlags usage) {
+            return Upload::buffer(device, allocator, uploader, data.data(), sizeof(T) * data.size(),
+                                  usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+        }
+
+        void build(const Device& device, VmaAllocator allocator, Upload::Context& uploader,
+                   const std::vector<MaterialOperation::RenderObject>& surfaces, Scene& scene) {
+            destroy(allocator, scene);
+            if (surfaces.empty()) {
+                return;
+            }
+
+            // Bucket per material and index buffer, ordered so the draw walks them in a stable order
+            std::map<std::pair<const void*, const void*>, uint32_t> bucket_ids;
+            std::vector<uint32_t> surface_buckets(surfaces.size());
+            for (size_t i = 0; i < surfaces.size(); i++) {
+                const MaterialOperation::RenderObject& object = surfaces[i];
+                std::pair<const void*, const void*> key{object.material, object.index_buffer};
+                auto it = bucket_ids.find(key);
+                if (it == bucket_ids.end()) {
+                    it = bucket_ids.emplace(key, static_cast<uint32_t>(scene.buckets.size())).first;
+                    scene.buckets.push_back({object.material, object.index_buffer, 0, 0});
+                }
+                surface_buckets[i] = it->second;
+                scene.buckets[it->second].capacity++;
+            }
+
+            std::vector<uint32_t> bucket_bases(scene.buckets.size());
+            uint32_t command_count = 0;
+            for (size_t i = 0; i < scene.buckets.size(); i++) {
+                scene.buckets[i].first_command = command_count;
+                bucket_bases[i] = command_count;
+                command_count += scene.buckets[i].capacity;
+            }
+
+            // Transforms are per surface for now, the nodes don't move after load so there is nothing to share yet
+            std::vector<GPUSurface> gpu_surfaces(surfaces.size());
+            std::vector<glm::mat4> transforms(surfaces.size());
+            for (size_t i = 0; i < surfaces.size(); i++) {
+                const MaterialOperation::RenderObject& object = surfaces[i];
+                GPUSurface& surface = gpu_surfaces[i];
+                surface.sphere = glm::vec4(object.bounds.origin, object.bounds.sphere_radius);
+                surface.extents = glm::vec4(object.bounds.extents, 0.0f);
+                surface.first_index = object.first_index;
+                surface.index_count = object.index_ount;
+                surface.transform_index = static_cast<uint32_t>(i);
+                surface.bucket = surface_buckets[i];
+                surface.vertex_buffer = object.vertex_buffer_address;
+                surface.padding = 0;
+                transforms[i] = object.transform;
+            }
+
+            scene.surface_count = static_cast<uint32_t>(surfaces.size());
+            scene.surfaces = upload(device, allocator, uploader, gpu_surfaces, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            scene.transforms = upload(device, allocator, uploader, transforms, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            scene.bucket_bases = upload(device, allocator, uploader, bucket_bases, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+            // Written by the cull pass every frame, nothing to upload
+            scene.commands = Buffer::allocateBuffer(
+                allocator, sizeof(VkDrawIndexedIndirectCommand) * command_count,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY);
+            scene.counts = Buffer::allocateBuffer(
+                allocator, sizeof(uint32_t) * scene.buckets.size(),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY);
+
+            scene.surfaces_address = addressOf(device, scene.surfaces);
+            scene.transforms_address = addressOf(device, scene.transforms);
+
+            std::vector<CullTables> tables{{
+                .surfaces = scene.surfaces_address,
+                .transforms = scene.transforms_address,
+                .commands = addressOf(device, scene.commands),
+                .counts = addressOf(device, scene.counts),
+                .bucket_bases = addressOf(device, scene.bucket_bases),
+            }};
+            scene.tables = upload(device, allocator, uploader, tables, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            scene.tables_address = addressOf(device, scene.tables);
+            Upload::submit(device, uploader);
+
+            std::cout << "gpu driven scene: " << scene.surface_count << " surfaces in " << scene.buckets.size()
+                      << " buckets" << std::endl;
+        }
+
+        void destroy(VmaAllocator allocator, Scene& scene) {
+            Buffer::destroyBuffer(allocator, scene.surfaces);
+            Buffer::destroyBuffer(allocator, scene.transforms);
+            Buffer::destroyBuffer(allocator, scene.commands);
+            Buffer::destroyBuffer(allocator, scene.counts);
+            Buffer::destroyBuffer(allocator, scene.bucket_bases);
+            Buffer::destroyBuffer(allocator, scene.tables);
+            scene = {};
+        }
+
+        static void bufferBarrier(VkCommandBuffer cmd, VkBuffer buffer, VkPipelineStageFlags src_stage,
+                                  VkPipelineStageFlags dst_stage, VkAccessFlags src_access, VkAccessFlags dst_access) {
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = src_access;
+            barrier.dstAccessMask = dst_access;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = buffer;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            vkCmdPipelineBarrier(cmd, src_stage, dst_stage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+
+        void cull(VkCommandBuffer cmd, const Pipeline::ComputeObject& pipeline, const Scene& scene,
+                  const Culling::Frustum& frustum) {
+            if (scene.surface_count == 0) {
+                return;
+            }
+
+            // Every frame in flight shares the command and count buffers, the previous frame's indirect
+            // reads have to be done before they get cleared
+            bufferBarrier(cmd, scene.counts.buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+            vkCmdFillBuffer(cmd, scene.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+            bufferBarrier(cmd, scene.counts.buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            bufferBarrier(cmd, scene.commands.buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                          VK_ACCESS_SHADER_WRITE_BIT);
+
+            CullPushConstants push_constants{};
+            for (size_t i = 0; i < frustum.planes.size(); i++) {
+                push_constants.planes[i] = frustum.planes[i];
+            }
+            push_constants.tables = scene.tables_address;
+            push_constants.surface_count = scene.surface_count;
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.handle);
+            vkCmdPushConstants(cmd, pipeline.layout_handle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants),
+                               &push_constants);
+            vkCmdDispatch(cmd, (scene.surface_count + cull_group_size - 1) / cull_group_size, 1, 1);
+
+            bufferBarrier(cmd, scene.counts.buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+            bufferBarrier(cmd, scene.commands.buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        }
+
+        void draw(VkCommandBuffer cmd, const Pipeline::Object& pipeline, const Scene& scene,
+                  VkDescriptorSet scene_set, uint32_t scene_offset) {
+            if (scene.surface_count == 0) {
+                return;
+            }
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout_handle, 0, 1, &scene_set, 1,
+                                    &scene_offset);
+
+            DrawPushConstants push_constants{scene.surfaces_address, scene.transforms_address};
+            vkCmdPushConstants(cmd, pipeline.layout_handle, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants),
+                               &push_constants);
+
+            VkDescriptorSet material_set{VK_NULL_HANDLE};
+            VkBuffer index_buffer{VK_NULL_HANDLE};
+            for (size_t i = 0; i < scene.buckets.size(); i++) {
+                const Bucket& bucket = scene.buckets[i];
+                if (bucket.material->material_set != material_set) {
+                    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout_handle, 1, 1,
+                                            &bucket.material->material_set, 0, nullptr);
+                    material_set = bucket.material->material_set;
+                }
+                if (bucket.index_buffer != index_buffer) {
+                    vkCmdBindIndexBuffer(cmd, bucket.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+                    index_buffer = bucket.index_buffer;
+                }
+                vkCmdDrawIndexedIndirectCount(cmd, scene.commands.buffer,
+                                              sizeof(VkDrawIndexedIndirectCommand) * bucket.first_command,
+                                              scene.counts.buffer, sizeof(uint32_t) * i, bucket.capacity,
+                                              sizeof(VkDrawIndexedIndirectCommand));
+            }
+        }
+    }
+}
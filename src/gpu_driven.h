@@ -0,0 +1,81 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "material.h"
+#include "culling.h"
+#include "upload.h"
+
+namespace Vulkan {
+    namespace GpuDriven {
+        constexpr uint32_t cull_group_size{64};
+
+        // Matches Surface in cull.comp and mesh_indirect.vert, std430 so keep it at 64 bytes
+        struct GPUSurface {
+            glm::vec4 sphere;
+            glm::vec4 extents;
+            uint32_t first_index;
+            uint32_t index_count;
+            uint32_t transform_index;
+            uint32_t bucket;
+            VkDeviceAddress vertex_buffer;
+            uint64_t padding;
+        };
+        static_assert(sizeof(GPUSurface) == 64);
+
+        // Device addresses of every buffer the cull shader touches, uploaded once so the push constants
+        // only carry the one pointer to it
+        struct CullTables {
+            VkDeviceAddress surfaces;
+            VkDeviceAddress transforms;
+            VkDeviceAddress commands;
+            VkDeviceAddress counts;
+            VkDeviceAddress bucket_bases;
+        };
+
+        struct CullPushConstants {
+            glm::vec4 planes[6];
+            VkDeviceAddress tables;
+            uint32_t surface_count;
+            uint32_t padding;
+        };
+
+        struct DrawPushConstants {
+            VkDeviceAddress surfaces;
+            VkDeviceAddress transforms;
+        };
+
+        // Surfaces sharing a material and index buffer, their commands sit in one contiguous range so the
+        // whole group is a single indirect count draw
+        struct Bucket {
+            MaterialOperation::MaterialInstance* material;
+            VkBuffer index_buffer;
+            uint32_t first_command;
+            uint32_t capacity;
+        };
+
+        struct Scene {
+            AllocatedBuffer surfaces{};
+            AllocatedBuffer transforms{};
+            AllocatedBuffer commands{};
+            AllocatedBuffer counts{};
+            AllocatedBuffer bucket_bases{};
+            AllocatedBuffer tables{};
+            VkDeviceAddress tables_address{0};
+            VkDeviceAddress surfaces_address{0};
+            VkDeviceAddress transforms_address{0};
+            std::vector<Bucket> buckets;
+            uint32_t surface_count{0};
+        };
+
+        // Surfaces are taken as they are now, anything that moves after this needs a rebuild
+        void build(const Device& device, VmaAllocator allocator, Upload::Context& uploader,
+                   const std::vector<MaterialOperation::RenderObject>& surfaces, Scene& scene);
+        void destroy(VmaAllocator allocator, Scene& scene);
+        // Outside of rendering, resets the counts and writes this frame's visible commands
+        void cull(VkCommandBuffer cmd, const Pipeline::ComputeObject& pipeline, const Scene& scene,
+                  const Culling::Frustum& frustum);
+        // Inside rendering, one indirect count draw per bucket
+        void draw(VkCommandBuffer cmd, const Pipeline::Object& pipeline, const Scene& scene,
+                  VkDescriptorSet scene_set, uint32_t scene_offset);
+    }
+}
@@ -77,9 +77,12 @@ namespace Vulkan {
             std::cout << "No validation layers found" << std::endl;
         }
 
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        std::vector<const char*> extensions;
+        if (!headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
         extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
         extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
@@ -165,7 +168,9 @@ namespace Vulkan {
 
     void Instance::destroy()
     {
-        vkDestroySurfaceKHR(handle, surface, nullptr);
+        if (surface) {
+            vkDestroySurfaceKHR(handle, surface, nullptr);
+        }
         auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
             handle, "vkDestroyDebugUtilsMessengerEXT");
         if (func != nullptr) {
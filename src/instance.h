@@ -19,9 +19,11 @@ namespace Vulkan {
     const std::vector<const char *> validation_layers = {
         "VK_LAYER_KHRONOS_validation"};
     const bool enable_validation{true};
+    // No window system at all, so no glfw extensions and no surface
+    bool headless{false};
     VkInstance handle;
     VkDebugUtilsMessengerEXT debug_messenger;
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface{VK_NULL_HANDLE};
   };
 
   void createInstance(Instance& instance);
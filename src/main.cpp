@@ -1,10 +1,79 @@
 #include "corax.h"
 
+#include <string_view>
 
-int main() {
+static void parseOptions(int argc, char** argv, Vulkan::RendererOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && has_value) {
+            options.benchmark_frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup_frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--width" && has_value) {
+            options.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--height" && has_value) {
+            options.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--scene" && has_value) {
+            options.scene_path = argv[++i];
+        } else if (arg == "--shader-dir" && has_value) {
+            options.shader_dir = argv[++i];
+        } else if (arg == "--frames-in-flight" && has_value) {
+            options.frames_in_flight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--threads" && has_value) {
+            options.record_threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--loader-threads" && has_value) {
+            options.loader_threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--no-cull") {
+            options.frustum_cull = false;
+        } else if (arg == "--gpu-driven") {
+            options.gpu_driven = true;
+        } else if (arg == "--vertex-arena-mb" && has_value) {
+            options.vertex_arena_mb = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--index-arena-mb" && has_value) {
+            options.index_arena_mb = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--compact-vertices") {
+            options.compact_vertices = true;
+        } else if (arg == "--no-mesh-cache") {
+            options.mesh_cache = false;
+        } else if (arg == "--mesh-cache-dir" && has_value) {
+            options.mesh_cache_dir = argv[++i];
+        } else if (arg == "--no-pipeline-cache") {
+            options.pipeline_cache = false;
+        } else if (arg == "--pipeline-cache-file" && has_value) {
+            options.pipeline_cache_file = argv[++i];
+        } else if (arg == "--no-texture-streaming") {
+            options.texture_streaming = false;
+        } else if (arg == "--texture-resident-size" && has_value) {
+            options.texture_resident_size = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--sync-load") {
+            options.async_load = false;
+        } else if (arg == "--load-benchmark" && has_value) {
+            options.load_benchmark_runs = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--no-sort") {
+            options.sort_draws = false;
+        } else if (arg == "--thread-sweep") {
+            options.thread_sweep = true;
+        } else if (arg == "--profile-log" && has_value) {
+            options.profile_log_interval = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else {
+            throw std::runtime_error("unknown argument: " + std::string(arg));
+        }
+    }
+
+    // Headless has no event loop to sit in, it only makes sense as a benchmark run
+    if (options.headless && options.benchmark_frames == 0) {
+        options.benchmark_frames = 300;
+    }
+}
+
+int main(int argc, char** argv) {
     Vulkan::CoraxRenderer app;
 
     try {
+        parseOptions(argc, argv, app.options);
         app.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -1,11 +1,26 @@
 #include "material.h"
+#include "gpu_driven.h"
 #include "vulkan_operations.h"
 
 namespace Vulkan {
     namespace MaterialOperation {
+        // Throws instead of handing an empty module to the pipeline
+        static Pipeline::Shader loadShaderModule(const Device& device, const std::string& shader_dir,
+                                                 const char* name) {
+            Pipeline::Shader shader{};
+            shader.filename = (std::filesystem::path(shader_dir) / name).string();
+            if (!Pipeline::loadShader(shader) || shader.spirv_binary.empty()) {
+                throw std::runtime_error("failed to load shader " + shader.filename);
+            }
+            Pipeline::createShaderModule(device, shader);
+            return shader;
+        }
+
         void buildPipelines(const Device& device, const SwapChain& swap_chain,
                             GLTFOperations& gltf_material,
-                            Pipeline::Cache& pipeline_cache, DescriptorLayout& scene_layout) {
+                            Pipeline::Cache& pipeline_cache, DescriptorLayout& scene_layout,
+                            Geometry::VertexLayout vertex_layout, ThreadPool& workers,
+                            const std::string& shader_dir) {
 
             /*
             I suspect this isnt the best approach, but i dont think i have enough exposure to the use cases
@@ -27,19 +42,8 @@ namespace Vulkan {
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
             Descriptors::buildLayout(gltf_material.material_layout, device);
 
-            Pipeline::Shader mesh_vertex{};
-            mesh_vertex.filename =
-                "C:/Users/bgarner/Documents/repos/Corax/build/shaders/"
-                "mesh.vert.spv";
-            Pipeline::loadShader(mesh_vertex);
-            Pipeline::createShaderModule(device, mesh_vertex);
-
-            Pipeline::Shader mesh_fragment{};
-            mesh_fragment.filename =
-                "C:/Users/bgarner/Documents/repos/Corax/build/shaders/"
-                "mesh.frag.spv";
-            Pipeline::loadShader(mesh_fragment);
-            Pipeline::createShaderModule(device, mesh_fragment);
+            Pipeline::Shader mesh_vertex = loadShaderModule(device, shader_dir, "mesh.vert.spv");
+            Pipeline::Shader mesh_fragment = loadShaderModule(device, shader_dir, "mesh.frag.spv");
 
             VkPipelineShaderStageCreateInfo frag_info{};
             frag_info.sType =
@@ -48,55 +52,119 @@ namespace Vulkan {
             frag_info.module = mesh_fragment.module;
             frag_info.pName = "main";
 
+            // constant_id 0 in vertex_fetch.glsl, shared by every mesh vertex shader
+            gltf_material.compact_vertices =
+                vertex_layout == Geometry::VertexLayout::COMPACT ? VK_TRUE : VK_FALSE;
+            gltf_material.vertex_layout_entry = {0, 0, sizeof(VkBool32)};
+            gltf_material.vertex_specialization.mapEntryCount = 1;
+            gltf_material.vertex_specialization.pMapEntries = &gltf_material.vertex_layout_entry;
+            gltf_material.vertex_specialization.dataSize = sizeof(VkBool32);
+            gltf_material.vertex_specialization.pData = &gltf_material.compact_vertices;
+
             VkPipelineShaderStageCreateInfo vertex_info{};
             vertex_info.sType =
                 VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
             vertex_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
             vertex_info.module = mesh_vertex.module;
             vertex_info.pName = "main";
+            vertex_info.pSpecializationInfo = &gltf_material.vertex_specialization;
 
             VkDescriptorSetLayout layouts[] = {scene_layout.layout_handle,
             gltf_material.material_layout.layout_handle};
+            const DescriptorLayout* layout_bindings[] = {&scene_layout, &gltf_material.material_layout};
+
+            // Keyed while the layouts and shader code above are alive, a config whose state is already in the
+            // cache shares that pipeline. The opaque one is built here and is what every other mesh pipeline
+            // draws with until its own has compiled on the workers
+            Pipeline::Object* default_pipeline = nullptr;
+            auto build = [&](Pipeline::Configuration& config, const Pipeline::Object* fallback) {
+                config.key = Pipeline::hashConfiguration(config);
+                if (default_pipeline == nullptr) {
+                    default_pipeline = Pipeline::getPipelineFromCache(config, pipeline_cache);
+                    if (default_pipeline == nullptr) {
+                        Pipeline::addPipelineToCache(config, pipeline_cache,
+                                                     Pipeline::createPipelineObject(device, config, pipeline_cache));
+                        default_pipeline = Pipeline::getPipelineFromCache(config, pipeline_cache);
+                    }
+                    return;
+                }
+                Pipeline::queuePipeline(device, config, pipeline_cache, workers, fallback);
+            };
 
             gltf_material.opaque_pipeline_config.name = "opaque_pipeline";
             gltf_material.opaque_pipeline_config.vertex_stages = vertex_info;
             gltf_material.opaque_pipeline_config.fragment_stages = frag_info;
+            gltf_material.opaque_pipeline_config.vertex_code = mesh_vertex.spirv_binary;
+            gltf_material.opaque_pipeline_config.fragment_code = mesh_fragment.spirv_binary;
             gltf_material.opaque_pipeline_config.format =
                 swap_chain.image_format;
             gltf_material.opaque_pipeline_config.extent = swap_chain.extent;
             gltf_material.opaque_pipeline_config.descriptor_set_layout = layouts;
-            gltf_material.opaque_pipeline_config.num_descriptor_sets = 3;
+            gltf_material.opaque_pipeline_config.num_descriptor_sets = 2;
+            gltf_material.opaque_pipeline_config.descriptor_layouts = layout_bindings;
             gltf_material.opaque_pipeline_config.enable_blend = VK_FALSE;
             gltf_material.opaque_pipeline_config.enable_depth = VK_TRUE;
-
-            auto opaque_pipeline = Pipeline::createPipelineObject(
-                device, gltf_material.opaque_pipeline_config);
-            Pipeline::addPipelineToCache(gltf_material.opaque_pipeline_config,
-                                         pipeline_cache,
-                                         std::move(opaque_pipeline));
+            build(gltf_material.opaque_pipeline_config, nullptr);
 
             gltf_material.transparent_pipeline_config.name =
                 "transparent_pipeline";
             gltf_material.transparent_pipeline_config.vertex_stages = vertex_info;
             gltf_material.transparent_pipeline_config.fragment_stages =
                 frag_info;
+            gltf_material.transparent_pipeline_config.vertex_code = mesh_vertex.spirv_binary;
+            gltf_material.transparent_pipeline_config.fragment_code = mesh_fragment.spirv_binary;
             gltf_material.transparent_pipeline_config.format =
                 swap_chain.image_format;
             gltf_material.transparent_pipeline_config.extent =
                 swap_chain.extent;
             gltf_material.transparent_pipeline_config.descriptor_set_layout = layouts;
-            gltf_material.transparent_pipeline_config.num_descriptor_sets = 3;
+            gltf_material.transparent_pipeline_config.num_descriptor_sets = 2;
+            gltf_material.transparent_pipeline_config.descriptor_layouts = layout_bindings;
             gltf_material.transparent_pipeline_config.enable_blend = VK_TRUE;
             gltf_material.transparent_pipeline_config.enable_depth = VK_TRUE;
+            build(gltf_material.transparent_pipeline_config, default_pipeline);
 
-            auto transparent_pipeline = Pipeline::createPipelineObject(
-                device, gltf_material.transparent_pipeline_config);
-            Pipeline::addPipelineToCache(
-                gltf_material.transparent_pipeline_config, pipeline_cache,
-                std::move(transparent_pipeline));
+            // Only built when the device can run the gpu driven path, the shaders need indirect count draws
+            if (device.gpu_driven_supported) {
+                Pipeline::Shader indirect_vertex = loadShaderModule(device, shader_dir, "mesh_indirect.vert.spv");
+
+                VkPipelineShaderStageCreateInfo indirect_vertex_info = vertex_info;
+                indirect_vertex_info.module = indirect_vertex.module;
+
+                gltf_material.opaque_indirect_pipeline_config = gltf_material.opaque_pipeline_config;
+                gltf_material.opaque_indirect_pipeline_config.name = "opaque_indirect_pipeline";
+                gltf_material.opaque_indirect_pipeline_config.vertex_stages = indirect_vertex_info;
+                gltf_material.opaque_indirect_pipeline_config.vertex_code = indirect_vertex.spirv_binary;
+                gltf_material.opaque_indirect_pipeline_config.push_constant_size =
+                    sizeof(GpuDriven::DrawPushConstants);
+                // Its push constants differ, nothing can stand in for it and the renderer waits on it instead
+                build(gltf_material.opaque_indirect_pipeline_config, nullptr);
+
+                Pipeline::Shader cull_compute = loadShaderModule(device, shader_dir, "cull.comp.spv");
+
+                VkPipelineShaderStageCreateInfo compute_info{};
+                compute_info.sType =
+                    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+                compute_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+                compute_info.module = cull_compute.module;
+                compute_info.pName = "main";
+
+                gltf_material.cull_pipeline_config.name = "cull_pipeline";
+                gltf_material.cull_pipeline_config.compute_stage = compute_info;
+                gltf_material.cull_pipeline_config.push_constant_size =
+                    sizeof(GpuDriven::CullPushConstants);
+
+                auto cull_pipeline = Pipeline::createComputeObject(
+                    device, gltf_material.cull_pipeline_config, pipeline_cache);
+                Pipeline::addComputeToCache(gltf_material.cull_pipeline_config,
+                                            pipeline_cache, std::move(cull_pipeline));
+
+                Pipeline::retireShaderModule(device, pipeline_cache, indirect_vertex);
+                Pipeline::destroyShaderModule(device, cull_compute);
+            }
 
-            Pipeline::destroyShaderModule(device, mesh_vertex);
-            Pipeline::destroyShaderModule(device, mesh_fragment);
+            Pipeline::retireShaderModule(device, pipeline_cache, mesh_vertex);
+            Pipeline::retireShaderModule(device, pipeline_cache, mesh_fragment);
         }
 
         void destroyResources(const Device& device, GLTFOperations& material_operator) {
@@ -159,12 +227,13 @@ namespace Vulkan {
             for (auto& s : mesh->surfaces) {
                 RenderObject def;
                 def.index_ount = s.count;
-                def.first_index = s.start_index;
-                def.index_buffer = mesh->mesh_buffers.index_buffer.buffer;
+                def.first_index = mesh->mesh_buffers.first_index + s.start_index;
+                def.index_buffer = mesh->mesh_buffers.index_buffer;
                 def.material = s.material.get();
 
                 def.transform = nodeMatrix;
                 def.vertex_buffer_address = mesh->mesh_buffers.vertex_buffer_address;
+                def.bounds = s.bounds;
                 if (def.material->pass_type == MaterialPass::MAINCOLOUR)
                 {
                     ctx.opaque_surfaces.push_back(def);
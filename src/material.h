@@ -2,8 +2,12 @@
 
 #include "pipeline.h"
 #include "vulkan_common.h"
+#include "geometry.h"
 
 namespace Vulkan {
+
+    struct ThreadPool;
+
     namespace MaterialOperation {
         // Not thrilled with some of the naming, going to make another pass on that once i totally get an understanding of the needs
         enum class MaterialPass {
@@ -16,6 +20,14 @@ namespace Vulkan {
             Pipeline::Object* pipeline;
             VkDescriptorSet material_set;
             MaterialPass pass_type;
+            // Slot in the texture streamer the draws report their screen size to, none when nothing is streamed
+            uint32_t stream_slot{UINT32_MAX};
+        };
+
+        struct Bounds {
+            glm::vec3 origin;
+            float sphere_radius;
+            glm::vec3 extents;
         };
 
         struct RenderObject {
@@ -27,6 +39,8 @@ namespace Vulkan {
 
             glm::mat4 transform;
             VkDeviceAddress vertex_buffer_address;
+            // Object space, filled from the surface at import
+            Bounds bounds;
         };
 
         struct DrawContext {
@@ -39,12 +53,6 @@ namespace Vulkan {
             virtual void Draw(const glm::mat4& topMatrix, DrawContext& ctx) = 0;
         };
 
-        struct Bounds {
-            glm::vec3 origin;
-            float sphere_radius;
-            glm::vec3 extents;
-        };
-
         struct GeoSurface {
             uint32_t start_index;
             uint32_t count;
@@ -97,8 +105,10 @@ namespace Vulkan {
             float rough_factors;
             float ao;
             uint32_t has_metal_rough_texture{0};
+            // Finest level the shader may sample for color, metal rough and normal, moved by the texture streamer
+            glm::vec4 min_lod{0.0f};
             //Something about padding, the alignas should do it, but perhaps that doesnt work for GPU memory?
-            glm::vec4 extra[14];// turns out both are good
+            glm::vec4 extra[13];// turns out both are good
         };
 
         struct MaterialResources {
@@ -121,10 +131,17 @@ namespace Vulkan {
         struct GLTFOperations {
             Pipeline::Configuration opaque_pipeline_config{};
             Pipeline::Configuration transparent_pipeline_config{};
+            // Opaque variant for the gpu driven path, pulls transforms and vertices from the surface table
+            Pipeline::Configuration opaque_indirect_pipeline_config{};
+            Pipeline::ComputeConfiguration cull_pipeline_config{};
             Pipeline::Object opaque_pipeline{};
             Pipeline::Object transparent_pipeline{};
             DescriptorLayout material_layout{};
             DescriptorWrite writer{};
+            // Vertex stage specialization for the geometry arena's vertex layout, the configs point at these
+            VkBool32 compact_vertices{VK_FALSE};
+            VkSpecializationMapEntry vertex_layout_entry{};
+            VkSpecializationInfo vertex_specialization{};
 
         };
 
@@ -133,6 +150,7 @@ namespace Vulkan {
             // storage for all the data on a given glTF file
             std::vector<std::shared_ptr<MeshAsset>> meshes;
             std::vector<std::shared_ptr<Node>> nodes;
+            // References into the renderer's texture cache, not owned
             std::vector<AllocatedTexture> textures;
             std::vector<std::shared_ptr<MaterialInstance>> materials;
 
@@ -147,6 +165,10 @@ namespace Vulkan {
             }, .num_pools = 1, .sets_per_pool = 1000};
 
             AllocatedBuffer material_data_buffer;
+            // Upload timeline value the file's buffers and textures are ready on the graphics queue at
+            uint64_t upload_ready{0};
+            // Streamer material slots handed back when the file is destroyed, streamed textures go with the cache
+            std::vector<uint32_t> stream_slots;
 
             std::function<void()> onDestroy;
 
@@ -162,7 +184,9 @@ namespace Vulkan {
         
         void buildPipelines(const Device& device, const SwapChain& swap_chain,
                         GLTFOperations& gltf_material,
-                        Pipeline::Cache& pipeline_cache, DescriptorLayout& scene_layout);
+                        Pipeline::Cache& pipeline_cache, DescriptorLayout& scene_layout,
+                        Geometry::VertexLayout vertex_layout, ThreadPool& workers,
+                        const std::string& shader_dir);
         void destroyResources(const Device& device, GLTFOperations& material_operator);
         MaterialInstance writeMaterial(
                         const Device& device, MaterialPass pass,
@@ -6,6 +6,10 @@
 #include <glm/gtx/projection.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 namespace Vulkan {
 
     // Mesh::Mesh() {}
@@ -78,54 +82,224 @@ namespace Vulkan {
 
     namespace MeshOperations {
 
+        // Octahedral mapping of a unit vector onto [-1, 1]^2
+        static glm::vec2 octEncode(glm::vec3 v) {
+            float length = glm::length(v);
+            if (length < 1e-6f) {
+                return {1.0f, 0.0f};
+            }
+            v /= std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+            glm::vec2 e{v.x, v.y};
+            if (v.z < 0.0f) {
+                e = (1.0f - glm::abs(glm::vec2{v.y, v.x})) *
+                    glm::vec2{v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f};
+            }
+            return e;
+        }
+
+        void compressVertices(std::span<const Vertex> vertices, CompactVertexHeader& header,
+                              std::span<CompactVertex> compact) {
+            if (vertices.empty()) {
+                header = {};
+                return;
+            }
+
+            glm::vec3 min_pos = vertices[0].position;
+            glm::vec3 max_pos = vertices[0].position;
+            for (const Vertex& vertex : vertices) {
+                min_pos = glm::min(min_pos, vertex.position);
+                max_pos = glm::max(max_pos, vertex.position);
+            }
+            glm::vec3 scale = max_pos - min_pos;
+            // A flat axis keeps a zero scale, every vertex then decodes to the offset on it
+            glm::vec3 inverse_scale{scale.x > 0.0f ? 1.0f / scale.x : 0.0f, scale.y > 0.0f ? 1.0f / scale.y : 0.0f,
+                                    scale.z > 0.0f ? 1.0f / scale.z : 0.0f};
+            header.position_offset = glm::vec4(min_pos, 0.0f);
+            header.position_scale = glm::vec4(scale, 0.0f);
+
+            for (size_t i = 0; i < vertices.size(); i++) {
+                const Vertex& vertex = vertices[i];
+                glm::vec3 unit = glm::clamp((vertex.position - min_pos) * inverse_scale, 0.0f, 1.0f);
+                compact[i].position_xy = glm::packUnorm2x16(glm::vec2(unit.x, unit.y));
+                compact[i].position_z = glm::packUnorm2x16(glm::vec2(unit.z, 0.0f));
+                compact[i].normal = glm::packSnorm2x16(octEncode(vertex.normal));
+                compact[i].tangent = glm::packSnorm2x16(octEncode(vertex.tangent));
+                compact[i].uv = glm::packHalf2x16(glm::vec2(vertex.uv_x, vertex.uv_y));
+                compact[i].color = glm::packUnorm4x8(glm::clamp(vertex.color, 0.0f, 1.0f));
+            }
+        }
+
+        void generateTangents(std::span<const uint32_t> indices, std::span<Vertex> vertices) {
+            size_t triangle_count = indices.size() / 3;
+            size_t vertex_count = vertices.size();
+            if (triangle_count == 0 || vertex_count == 0) {
+                return;
+            }
+
+            // Edges and uv deltas gathered into flat arrays, the maths then runs branch free over them so the
+            // compiler vectorizes it. The tangent ends up back in the first edge's arrays
+            std::vector<float> edges(triangle_count * 10);
+            float* e1x = edges.data();
+            float* e1y = e1x + triangle_count;
+            float* e1z = e1y + triangle_count;
+            float* e2x = e1z + triangle_count;
+            float* e2y = e2x + triangle_count;
+            float* e2z = e2y + triangle_count;
+            float* du1 = e2z + triangle_count;
+            float* dv1 = du1 + triangle_count;
+            float* du2 = dv1 + triangle_count;
+            float* dv2 = du2 + triangle_count;
+            for (size_t t = 0; t < triangle_count; t++) {
+                const Vertex& v0 = vertices[indices[t * 3]];
+                const Vertex& v1 = vertices[indices[t * 3 + 1]];
+                const Vertex& v2 = vertices[indices[t * 3 + 2]];
+                e1x[t] = v1.position.x - v0.position.x;
+                e1y[t] = v1.position.y - v0.position.y;
+                e1z[t] = v1.position.z - v0.position.z;
+                e2x[t] = v2.position.x - v0.position.x;
+                e2y[t] = v2.position.y - v0.position.y;
+                e2z[t] = v2.position.z - v0.position.z;
+                du1[t] = v1.uv_x - v0.uv_x;
+                dv1[t] = v1.uv_y - v0.uv_y;
+                du2[t] = v2.uv_x - v0.uv_x;
+                dv2[t] = v2.uv_y - v0.uv_y;
+            }
+
+            for (size_t t = 0; t < triangle_count; t++) {
+                float r = du1[t] * dv2[t] - dv1[t] * du2[t];
+                // Degenerate uvs, the direction is still usable and the length only weights the average
+                r = std::abs(r) < 1e-6f ? 1.0f : r;
+                float inverse = 1.0f / r;
+                e1x[t] = (e1x[t] * dv2[t] - e2x[t] * dv1[t]) * inverse;
+                e1y[t] = (e1y[t] * dv2[t] - e2y[t] * dv1[t]) * inverse;
+                e1z[t] = (e1z[t] * dv2[t] - e2z[t] * dv1[t]) * inverse;
+            }
+
+            // Accumulated tangent and normal per vertex, same flat layout for the orthogonalize pass
+            std::vector<float> frames(vertex_count * 6, 0.0f);
+            float* tx = frames.data();
+            float* ty = tx + vertex_count;
+            float* tz = ty + vertex_count;
+            float* nx = tz + vertex_count;
+            float* ny = nx + vertex_count;
+            float* nz = ny + vertex_count;
+            for (size_t t = 0; t < triangle_count; t++) {
+                for (size_t c = 0; c < 3; c++) {
+                    uint32_t v = indices[t * 3 + c];
+                    tx[v] += e1x[t];
+                    ty[v] += e1y[t];
+                    tz[v] += e1z[t];
+                }
+            }
+            for (size_t v = 0; v < vertex_count; v++) {
+                nx[v] = vertices[v].normal.x;
+                ny[v] = vertices[v].normal.y;
+                nz[v] = vertices[v].normal.z;
+            }
+
+            for (size_t v = 0; v < vertex_count; v++) {
+                float n_inverse = 1.0f / std::sqrt(std::max(nx[v] * nx[v] + ny[v] * ny[v] + nz[v] * nz[v], 1e-20f));
+                float n_x = nx[v] * n_inverse;
+                float n_y = ny[v] * n_inverse;
+                float n_z = nz[v] * n_inverse;
+
+                // Gram-Schmidt
+                float d = n_x * tx[v] + n_y * ty[v] + n_z * tz[v];
+                float t_x = tx[v] - n_x * d;
+                float t_y = ty[v] - n_y * d;
+                float t_z = tz[v] - n_z * d;
+
+                // Unreferenced vertices and ones whose tangents cancelled out get any axis perpendicular to the
+                // normal rather than a nan
+                float a_x = std::abs(n_x) < 0.9f ? 1.0f : 0.0f;
+                float a_y = 1.0f - a_x;
+                float a_d = n_x * a_x + n_y * a_y;
+                float f_x = a_x - n_x * a_d;
+                float f_y = a_y - n_y * a_d;
+                float f_z = -n_z * a_d;
+
+                float length2 = t_x * t_x + t_y * t_y + t_z * t_z;
+                bool degenerate = length2 < 1e-12f;
+                t_x = degenerate ? f_x : t_x;
+                t_y = degenerate ? f_y : t_y;
+                t_z = degenerate ? f_z : t_z;
+                length2 = degenerate ? f_x * f_x + f_y * f_y + f_z * f_z : length2;
+
+                float t_inverse = 1.0f / std::sqrt(std::max(length2, 1e-20f));
+                tx[v] = t_x * t_inverse;
+                ty[v] = t_y * t_inverse;
+                tz[v] = t_z * t_inverse;
+            }
+
+            for (size_t v = 0; v < vertex_count; v++) {
+                vertices[v].tangent = glm::vec3(tx[v], ty[v], tz[v]);
+            }
+        }
+
         void createMeshVertexBuffer(Device& device, VmaAllocator allocator_handle,
-                                VkCommandPool pool_handle,
-                                std::span<Vertex> vertices,
+                                Upload::Context& uploader,
+                                Geometry::Buffers& geometry,
+                                std::span<const Vertex> vertices,
                                 MeshBuffer& upload_buffer) {
+            if (geometry.vertex_layout == Geometry::VertexLayout::COMPACT) {
+                VkDeviceSize vertex_bytes = sizeof(CompactVertex) * vertices.size();
+                VkDeviceSize range_bytes = sizeof(CompactVertexHeader) + vertex_bytes;
+
+                // Quantized straight into staging, header first, there's no copy of the packed vertices
+                Geometry::Range range = Geometry::allocateVertices(geometry, range_bytes);
+                unsigned char* staged = static_cast<unsigned char*>(Upload::stageToBuffer(
+                    device, allocator_handle, uploader, range_bytes, geometry.vertices.buffer.buffer, range.offset));
+                CompactVertexHeader header{};
+                compressVertices(vertices, header,
+                                 {reinterpret_cast<CompactVertex*>(staged + sizeof(header)), vertices.size()});
+                memcpy(staged, &header, sizeof(header));
+                upload_buffer.vertex_offset = range.offset;
+                upload_buffer.vertex_size = range.size;
+                upload_buffer.vertex_buffer_address = geometry.vertices.address + range.offset;
+                return;
+            }
+
             VkDeviceSize buffer_size = sizeof(vertices[0]) * vertices.size();
 
-            upload_buffer.vertex_buffer = Immediate::uploadBuffer<Vertex>(
-                vertices, allocator_handle, pool_handle, device,
-                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                VMA_MEMORY_USAGE_GPU_ONLY);
-            VkBufferDeviceAddressInfo deviceAdressInfo{
-                .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-                .buffer = upload_buffer.vertex_buffer.buffer};
-            upload_buffer.vertex_buffer_address = vkGetBufferDeviceAddress(
-                device.logical_handle, &deviceAdressInfo);
+            Geometry::Range range = Geometry::allocateVertices(geometry, buffer_size);
+            Upload::copyToBuffer(device, allocator_handle, uploader, vertices.data(), buffer_size,
+                                 geometry.vertices.buffer.buffer, range.offset);
+            upload_buffer.vertex_offset = range.offset;
+            upload_buffer.vertex_size = range.size;
+            upload_buffer.vertex_buffer_address = geometry.vertices.address + range.offset;
         }
 
         void createMeshIndexBuffer(Device& device, VmaAllocator allocator_handle,
-                               VkCommandPool pool_handle,
-                               std::span<uint32_t> indices,
-                               MeshBuffer& upload_buffer, uint32_t offset) {
+                               Upload::Context& uploader,
+                               Geometry::Buffers& geometry,
+                               std::span<const uint32_t> indices,
+                               MeshBuffer& upload_buffer) {
             VkDeviceSize buffer_size = sizeof(indices[0]) * indices.size();
-            upload_buffer.index_buffer = Immediate::uploadBuffer<uint32_t>(
-                indices, allocator_handle, pool_handle, device,
-                VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                VMA_MEMORY_USAGE_GPU_ONLY, offset);
+
+            Geometry::Range range = Geometry::allocateIndices(geometry, buffer_size);
+            Upload::copyToBuffer(device, allocator_handle, uploader, indices.data(), buffer_size,
+                                 geometry.indices.buffer.buffer, range.offset);
+            upload_buffer.index_buffer = geometry.indices.buffer.buffer;
+            upload_buffer.index_offset = range.offset;
+            upload_buffer.index_size = range.size;
+            upload_buffer.first_index = static_cast<uint32_t>(range.offset / sizeof(uint32_t));
         }
 
         MeshBuffer uploadMeshData(Device& device, VmaAllocator allocator_handle,
-                    VkCommandPool pool_handle, std::span<uint32_t> indices,
-                    std::span<Vertex> vertices) {
+                    Upload::Context& uploader, Geometry::Buffers& geometry, std::span<const uint32_t> indices,
+                    std::span<const Vertex> vertices) {
             MeshBuffer upload_buffer;
-            createMeshVertexBuffer(device, allocator_handle, pool_handle, vertices,
+            createMeshVertexBuffer(device, allocator_handle, uploader, geometry, vertices,
                                upload_buffer);
-            createMeshIndexBuffer(device, allocator_handle, pool_handle, indices,
-                              upload_buffer,
-                              (sizeof(vertices[0]) * vertices.size()));
+            createMeshIndexBuffer(device, allocator_handle, uploader, geometry, indices,
+                              upload_buffer);
             return upload_buffer;
         }
 
-        void destroyMesh(VmaAllocator allocator_handle,
-                         MeshBuffer mesh_buffer) {
-            
-            Buffer::destroyBuffer(allocator_handle, mesh_buffer.vertex_buffer);
-            Buffer::destroyBuffer(allocator_handle, mesh_buffer.index_buffer);
+        void destroyMesh(Geometry::Buffers& geometry, MeshBuffer& mesh_buffer) {
+            Geometry::release(geometry.vertices.ranges, {mesh_buffer.vertex_offset, mesh_buffer.vertex_size});
+            Geometry::release(geometry.indices.ranges, {mesh_buffer.index_offset, mesh_buffer.index_size});
+            mesh_buffer = {};
         }
     }  // namespace MeshOperations
 }  // namespace Vulkan
\ No newline at end of file
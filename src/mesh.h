@@ -1,6 +1,8 @@
 #pragma once
 
 #include "vulkan_common.h"
+#include "upload.h"
+#include "geometry.h"
 
 namespace Vulkan {
 
@@ -37,21 +39,32 @@ namespace Vulkan {
     // };
 
     namespace MeshOperations {
+        // Quantizes against the vertices' own box, which goes in header. compact holds one entry per vertex
+        void compressVertices(std::span<const Vertex> vertices, CompactVertexHeader& header,
+                              std::span<CompactVertex> compact);
+        // Averages each triangle's uv aligned tangent onto its corners and orthogonalizes against the normal.
+        // Indices are relative to vertices, only the tangents are written
+        void generateTangents(std::span<const uint32_t> indices, std::span<Vertex> vertices);
+        // Each takes a range out of its geometry arena and records the copy into it in the uploader's current
+        // batch, the mesh is usable once that batch is submitted. Vertices go in the arena's layout
         void createMeshVertexBuffer(Device& device,
                                     VmaAllocator allocator_handle,
-                                    VkCommandPool pool_handle,
-                                    std::span<Vertex> vertices,
+                                    Upload::Context& uploader,
+                                    Geometry::Buffers& geometry,
+                                    std::span<const Vertex> vertices,
                                     MeshBuffer& upload_buffer);
         void createMeshIndexBuffer(Device& device,
                                    VmaAllocator allocator_handle,
-                                   VkCommandPool pool_handle,
-                                   std::span<uint32_t> indices,
-                                   MeshBuffer& upload_buffer,
-                                   uint32_t offset = 0);
+                                   Upload::Context& uploader,
+                                   Geometry::Buffers& geometry,
+                                   std::span<const uint32_t> indices,
+                                   MeshBuffer& upload_buffer);
         MeshBuffer uploadMeshData(Device& device, VmaAllocator allocator_handle,
-                              VkCommandPool pool_handle,
-                              std::span<uint32_t> indices,
-                              std::span<Vertex> vertices);
-        void destroyMesh(VmaAllocator allocator_handle, MeshBuffer mesh_buffer);
+                              Upload::Context& uploader,
+                              Geometry::Buffers& geometry,
+                              std::span<const uint32_t> indices,
+                              std::span<const Vertex> vertices);
+        // Hands the ranges back to the arenas, the gpu must be done with them
+        void destroyMesh(Geometry::Buffers& geometry, MeshBuffer& mesh_buffer);
     }
 }
\ No newline at end of file
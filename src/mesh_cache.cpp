@@ -0,0 +1,334 @@
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "mesh_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace Vulkan {
+    namespace MeshCache {
+        // Bytes per record of each section, a section whose size isn't a multiple is a broken file
+        static constexpr size_t record_sizes[SECTION_COUNT] = {
+            sizeof(SamplerRecord), sizeof(ImageRecord),   1,
+            sizeof(MaterialRecord), sizeof(MeshRecord),    sizeof(SurfaceRecord),
+            sizeof(Vertex),         sizeof(uint32_t),      sizeof(NodeRecord),
+            sizeof(uint32_t),       1,                     sizeof(DependencyRecord),
+        };
+
+        View view(const Data& data) {
+            return View{
+                .samplers = data.samplers,
+                .images = data.images,
+                .image_bytes = data.image_bytes,
+                .materials = data.materials,
+                .meshes = data.meshes,
+                .surfaces = data.surfaces,
+                .vertices = data.vertices,
+                .indices = data.indices,
+                .nodes = data.nodes,
+                .children = data.children,
+                .names = data.names,
+                .dependencies = data.dependencies,
+            };
+        }
+
+        bool map(const std::filesystem::path& path, Mapping& mapping) {
+            mapping = {};
+#ifdef _WIN32
+            HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+                CloseHandle(file);
+                return false;
+            }
+            HANDLE file_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (file_mapping == nullptr) {
+                return false;
+            }
+            // The view keeps the mapping alive on its own
+            void* address = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(file_mapping);
+            if (address == nullptr) {
+                return false;
+            }
+            mapping.data = static_cast<const unsigned char*>(address);
+            mapping.size = static_cast<size_t>(size.QuadPart);
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd == -1) {
+                return false;
+            }
+            struct stat info{};
+            if (fstat(fd, &info) != 0 || info.st_size == 0) {
+                ::close(fd);
+                return false;
+            }
+            void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (address == MAP_FAILED) {
+                return false;
+            }
+            madvise(address, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            mapping.data = static_cast<const unsigned char*>(address);
+            mapping.size = static_cast<size_t>(info.st_size);
+#endif
+            return true;
+        }
+
+        void unmap(Mapping& mapping) {
+            if (mapping.data == nullptr) {
+                return;
+            }
+#ifdef _WIN32
+            UnmapViewOfFile(mapping.data);
+#else
+            munmap(const_cast<unsigned char*>(mapping.data), mapping.size);
+#endif
+            mapping = {};
+        }
+
+        uint64_t hashBytes(std::span<const unsigned char> bytes) {
+            // Word at a time multiply and fold, fast enough that hashing a big glb stays well under parsing it
+            uint64_t hash = 0xcbf29ce484222325ull ^ bytes.size();
+            size_t words = bytes.size() / sizeof(uint64_t);
+            for (size_t i = 0; i < words; i++) {
+                uint64_t word;
+                std::memcpy(&word, bytes.data() + i * sizeof(uint64_t), sizeof(word));
+                hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+                hash ^= hash >> 29;
+            }
+            for (size_t i = words * sizeof(uint64_t); i < bytes.size(); i++) {
+                hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            }
+            return hash == 0 ? 1 : hash;
+        }
+
+        uint64_t hashFile(const std::filesystem::path& path) {
+            Mapping mapping{};
+            if (!map(path, mapping)) {
+                return 0;
+            }
+            uint64_t hash = hashBytes({mapping.data, mapping.size});
+            unmap(mapping);
+            return hash;
+        }
+
+        std::filesystem::path cachePath(const std::filesystem::path& directory, const std::filesystem::path& source,
+                                        uint64_t source_hash) {
+            std::ostringstream name;
+            name << source.stem().string() << "-" << std::hex << std::setw(16) << std::setfill('0') << source_hash
+                 << ".cmesh";
+            return directory / name.str();
+        }
+
+        template <typename T>
+        static std::pair<const void*, uint64_t> bytesOf(const std::vector<T>& values) {
+            return {values.data(), sizeof(T) * values.size()};
+        }
+
+        bool write(const std::filesystem::path& path, uint64_t source_hash, const Data& data) {
+            std::pair<const void*, uint64_t> sections[SECTION_COUNT] = {
+                bytesOf(data.samplers), bytesOf(data.images),   bytesOf(data.image_bytes), bytesOf(data.materials),
+                bytesOf(data.meshes),   bytesOf(data.surfaces), bytesOf(data.vertices),    bytesOf(data.indices),
+                bytesOf(data.nodes),    bytesOf(data.children), bytesOf(data.names),       bytesOf(data.dependencies),
+            };
+
+            FileHeader header{};
+            header.magic = file_magic;
+            header.version = importer_version;
+            header.source_hash = source_hash;
+            header.vertex_size = sizeof(Vertex);
+            uint64_t offset = sizeof(FileHeader);
+            for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+                offset = (offset + section_alignment - 1) / section_alignment * section_alignment;
+                header.sections[i] = {offset, sections[i].second};
+                offset += sections[i].second;
+            }
+
+            std::error_code error;
+            std::filesystem::create_directories(path.parent_path(), error);
+
+            // Written beside the real name and renamed once complete, a crash mid write never leaves a file
+            // that looks valid
+            std::filesystem::path temp_path = path;
+            temp_path += ".tmp";
+            {
+                std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+                if (!out) {
+                    std::cerr << "mesh cache: can't write " << temp_path << std::endl;
+                    return false;
+                }
+                out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                uint64_t written = sizeof(header);
+                const char zeros[section_alignment]{};
+                for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+                    out.write(zeros, static_cast<std::streamsize>(header.sections[i].offset - written));
+                    out.write(static_cast<const char*>(sections[i].first),
+                              static_cast<std::streamsize>(sections[i].second));
+                    written = header.sections[i].offset + sections[i].second;
+                }
+                if (!out) {
+                    std::cerr << "mesh cache: failed writing " << temp_path << std::endl;
+                    return false;
+                }
+            }
+
+            std::filesystem::rename(temp_path, path, error);
+            if (error) {
+                std::cerr << "mesh cache: can't rename to " << path << ": " << error.message() << std::endl;
+                std::filesystem::remove(temp_path, error);
+                return false;
+            }
+            std::cout << "mesh cache: wrote " << path << " (" << offset / 1024 << " KB)" << std::endl;
+            return true;
+        }
+
+        template <typename T>
+        static std::span<const T> section(const Mapping& mapping, const SectionEntry& entry) {
+            return {reinterpret_cast<const T*>(mapping.data + entry.offset), entry.size / sizeof(T)};
+        }
+
+        static bool inRange(uint64_t first, uint64_t count, size_t size) {
+            return first <= size && count <= size - first;
+        }
+
+        // Every index and range the records hold against the sections they point into. A file that passes
+        // can be instantiated without reading outside the mapping or handing the gpu an index past its mesh
+        static bool validReferences(const View& cooked) {
+            for (const SamplerRecord& sampler : cooked.samplers) {
+                if (sampler.mag_filter > uint32_t(VK_FILTER_LINEAR) ||
+                    sampler.min_filter > uint32_t(VK_FILTER_LINEAR) ||
+                    sampler.mipmap_mode > uint32_t(VK_SAMPLER_MIPMAP_MODE_LINEAR)) {
+                    return false;
+                }
+            }
+            for (const ImageRecord& image : cooked.images) {
+                if (!inRange(image.offset, image.size, cooked.image_bytes.size())) {
+                    return false;
+                }
+            }
+            auto validTexture = [&cooked](const TextureRef& ref) {
+                return (ref.image == no_index || (ref.image >= 0 && size_t(ref.image) < cooked.images.size())) &&
+                       (ref.sampler == no_index || (ref.sampler >= 0 && size_t(ref.sampler) < cooked.samplers.size()));
+            };
+            for (const MaterialRecord& material : cooked.materials) {
+                if (material.pass > uint32_t(MaterialOperation::MaterialPass::OTHER) ||
+                    !validTexture(material.color) || !validTexture(material.metal_rough) ||
+                    !validTexture(material.normal)) {
+                    return false;
+                }
+            }
+            for (const MeshRecord& mesh : cooked.meshes) {
+                if (!inRange(mesh.first_vertex, mesh.vertex_count, cooked.vertices.size()) ||
+                    !inRange(mesh.first_index, mesh.index_count, cooked.indices.size()) ||
+                    !inRange(mesh.first_surface, mesh.surface_count, cooked.surfaces.size()) ||
+                    !inRange(mesh.name_offset, mesh.name_size, cooked.names.size())) {
+                    return false;
+                }
+                // Surfaces index into their mesh's own slice, and the slice into the mesh's vertices
+                for (const SurfaceRecord& surface : cooked.surfaces.subspan(mesh.first_surface, mesh.surface_count)) {
+                    if (!inRange(surface.start_index, surface.count, mesh.index_count) || surface.material < 0 ||
+                        size_t(surface.material) >= cooked.materials.size()) {
+                        return false;
+                    }
+                }
+                for (uint32_t index : cooked.indices.subspan(mesh.first_index, mesh.index_count)) {
+                    if (index >= mesh.vertex_count) {
+                        return false;
+                    }
+                }
+            }
+            // A node listed under two parents could make the transform walk loop
+            std::vector<bool> has_parent(cooked.nodes.size(), false);
+            for (size_t i = 0; i < cooked.nodes.size(); i++) {
+                const NodeRecord& node = cooked.nodes[i];
+                if ((node.mesh != no_index && (node.mesh < 0 || size_t(node.mesh) >= cooked.meshes.size())) ||
+                    !inRange(node.first_child, node.child_count, cooked.children.size())) {
+                    return false;
+                }
+                for (uint32_t child : cooked.children.subspan(node.first_child, node.child_count)) {
+                    if (child >= cooked.nodes.size() || child == i || has_parent[child]) {
+                        return false;
+                    }
+                    has_parent[child] = true;
+                }
+            }
+            for (const DependencyRecord& dependency : cooked.dependencies) {
+                if (!inRange(dependency.path_offset, dependency.path_size, cooked.names.size())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::optional<View> open(const std::filesystem::path& path, uint64_t source_hash, Mapping& mapping) {
+            if (!map(path, mapping)) {
+                return {};
+            }
+
+            FileHeader header{};
+            bool valid = mapping.size >= sizeof(FileHeader);
+            if (valid) {
+                std::memcpy(&header, mapping.data, sizeof(header));
+                valid = header.magic == file_magic && header.version == importer_version &&
+                        header.source_hash == source_hash && header.vertex_size == sizeof(Vertex);
+            }
+            for (uint32_t i = 0; valid && i < SECTION_COUNT; i++) {
+                const SectionEntry& entry = header.sections[i];
+                valid = entry.offset % section_alignment == 0 && entry.offset <= mapping.size &&
+                        entry.size <= mapping.size - entry.offset && entry.size % record_sizes[i] == 0;
+            }
+            if (!valid) {
+                std::cout << "mesh cache: " << path << " is stale or damaged, reimporting" << std::endl;
+                unmap(mapping);
+                return {};
+            }
+
+            View cooked{
+                .samplers = section<SamplerRecord>(mapping, header.sections[SAMPLERS]),
+                .images = section<ImageRecord>(mapping, header.sections[IMAGES]),
+                .image_bytes = section<unsigned char>(mapping, header.sections[IMAGE_BYTES]),
+                .materials = section<MaterialRecord>(mapping, header.sections[MATERIALS]),
+                .meshes = section<MeshRecord>(mapping, header.sections[MESHES]),
+                .surfaces = section<SurfaceRecord>(mapping, header.sections[SURFACES]),
+                .vertices = section<Vertex>(mapping, header.sections[VERTICES]),
+                .indices = section<uint32_t>(mapping, header.sections[INDICES]),
+                .nodes = section<NodeRecord>(mapping, header.sections[NODES]),
+                .children = section<uint32_t>(mapping, header.sections[CHILDREN]),
+                .names = section<char>(mapping, header.sections[NAMES]),
+                .dependencies = section<DependencyRecord>(mapping, header.sections[DEPENDENCIES]),
+            };
+            if (!validReferences(cooked)) {
+                std::cout << "mesh cache: " << path << " is damaged, reimporting" << std::endl;
+                unmap(mapping);
+                return {};
+            }
+
+            // The source hash only covers the gltf itself, external buffers and images are checked one by one
+            for (const DependencyRecord& dependency : cooked.dependencies) {
+                std::string file(cooked.names.data() + dependency.path_offset, dependency.path_size);
+                if (hashFile(file) != dependency.hash) {
+                    std::cout << "mesh cache: " << file << " changed since " << path << ", reimporting" << std::endl;
+                    unmap(mapping);
+                    return {};
+                }
+            }
+            return cooked;
+        }
+    }
+}
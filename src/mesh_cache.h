@@ -0,0 +1,176 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "material.h"
+
+#include <filesystem>
+#include <optional>
+
+namespace Vulkan {
+    namespace MeshCache {
+        constexpr uint32_t file_magic{0x43584D43}; // "CMXC"
+        // Bump whenever the importer produces different data for the same source, old files then miss
+        constexpr uint32_t importer_version{5};
+        // Every section starts on this so the mapped spans are aligned for Vertex
+        constexpr uint64_t section_alignment{16};
+        constexpr int32_t no_index{-1};
+
+        enum Section : uint32_t {
+            SAMPLERS,
+            IMAGES,
+            IMAGE_BYTES,
+            MATERIALS,
+            MESHES,
+            SURFACES,
+            VERTICES,
+            INDICES,
+            NODES,
+            CHILDREN,
+            NAMES,
+            DEPENDENCIES,
+            SECTION_COUNT
+        };
+
+        struct SectionEntry {
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        struct FileHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t source_hash;
+            // Catches a Vertex layout change that nobody bumped the version for
+            uint64_t vertex_size;
+            SectionEntry sections[SECTION_COUNT];
+        };
+
+        // Everything below is written and mapped as is, so plain data only
+
+        struct SamplerRecord {
+            uint32_t mag_filter;  // VkFilter
+            uint32_t min_filter;  // VkFilter
+            uint32_t mipmap_mode; // VkSamplerMipmapMode
+        };
+
+        // Still encoded (png, jpg), decoding stays on the loader workers
+        struct ImageRecord {
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        struct TextureRef {
+            int32_t image{no_index};
+            int32_t sampler{no_index};
+        };
+
+        struct MaterialRecord {
+            glm::vec4 color_factors;
+            float metal_factor;
+            float rough_factor;
+            uint32_t pass; // MaterialOperation::MaterialPass
+            TextureRef color;
+            TextureRef metal_rough;
+            TextureRef normal;
+        };
+
+        // Vertex and index ranges are the mesh's slices of the file wide streams
+        struct MeshRecord {
+            uint64_t first_vertex;
+            uint64_t vertex_count;
+            uint64_t first_index;
+            uint64_t index_count;
+            uint32_t first_surface;
+            uint32_t surface_count;
+            uint32_t name_offset;
+            uint32_t name_size;
+        };
+
+        struct SurfaceRecord {
+            uint32_t start_index;
+            uint32_t count;
+            int32_t material;
+            MaterialOperation::Bounds bounds;
+        };
+
+        struct NodeRecord {
+            glm::mat4 local_transform;
+            int32_t mesh;
+            uint32_t first_child;
+            uint32_t child_count;
+            uint32_t padding;
+        };
+
+        // A file besides the gltf that was cooked in, an external buffer or image. The path is absolute and
+        // lives in the names section
+        struct DependencyRecord {
+            uint64_t hash;
+            uint32_t path_offset;
+            uint32_t path_size;
+        };
+
+        // What the importer produces, either filled by cooking a gltf or pointed into a mapped cache file
+        struct View {
+            std::span<const SamplerRecord> samplers;
+            std::span<const ImageRecord> images;
+            std::span<const unsigned char> image_bytes;
+            std::span<const MaterialRecord> materials;
+            std::span<const MeshRecord> meshes;
+            std::span<const SurfaceRecord> surfaces;
+            std::span<const Vertex> vertices;
+            std::span<const uint32_t> indices;
+            std::span<const NodeRecord> nodes;
+            std::span<const uint32_t> children;
+            std::span<const char> names;
+            std::span<const DependencyRecord> dependencies;
+        };
+
+        // Owning storage for a cold import
+        struct Data {
+            std::vector<SamplerRecord> samplers;
+            std::vector<ImageRecord> images;
+            std::vector<unsigned char> image_bytes;
+            std::vector<MaterialRecord> materials;
+            std::vector<MeshRecord> meshes;
+            std::vector<SurfaceRecord> surfaces;
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            std::vector<NodeRecord> nodes;
+            std::vector<uint32_t> children;
+            std::vector<char> names;
+            std::vector<DependencyRecord> dependencies;
+        };
+
+        struct Mapping {
+            const unsigned char* data{nullptr};
+            size_t size{0};
+        };
+
+        struct Settings {
+            std::filesystem::path directory{"mesh_cache"};
+            // Use an existing file when it matches the source
+            bool read{true};
+            // Write one after a cold import
+            bool write{true};
+        };
+
+        View view(const Data& data);
+
+        // Read only mapping of the whole file, the handles are closed straight away and the view stays valid
+        // until unmap
+        bool map(const std::filesystem::path& path, Mapping& mapping);
+        void unmap(Mapping& mapping);
+
+        // Never 0, so 0 can stand for no hash
+        uint64_t hashBytes(std::span<const unsigned char> bytes);
+        // Content hash of the source, 0 when it can't be read
+        uint64_t hashFile(const std::filesystem::path& path);
+        std::filesystem::path cachePath(const std::filesystem::path& directory, const std::filesystem::path& source,
+                                        uint64_t source_hash);
+
+        bool write(const std::filesystem::path& path, uint64_t source_hash, const Data& data);
+        // Maps path and checks it was cooked from source_hash by this importer version and that none of its
+        // dependencies changed since, the view points into the mapping so unmap only once it's no longer needed
+        std::optional<View> open(const std::filesystem::path& path, uint64_t source_hash, Mapping& mapping);
+    }
+}
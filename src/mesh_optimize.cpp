@@ -0,0 +1,295 @@
+#include "mesh_optimize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+
+namespace Vulkan {
+    namespace MeshOptimize {
+        // Fifo cache kept as the time each vertex was last loaded, a vertex is still cached while fewer than
+        // cache_size loads happened since
+        struct FifoCache {
+            std::vector<uint32_t> stamps;
+            uint32_t time{analyze_cache_size + 1};
+        };
+
+        static bool load(FifoCache& cache, uint32_t vertex) {
+            if (cache.time - cache.stamps[vertex] <= analyze_cache_size) {
+                return false;
+            }
+            cache.stamps[vertex] = cache.time++;
+            return true;
+        }
+
+        CacheStats analyzeVertexCache(std::span<const uint32_t> indices, size_t vertex_count) {
+            CacheStats stats{};
+            size_t triangle_count = indices.size() / 3;
+            if (triangle_count == 0) {
+                return stats;
+            }
+
+            FifoCache cache{std::vector<uint32_t>(vertex_count, 0)};
+            std::vector<uint8_t> referenced(vertex_count, 0);
+            uint32_t misses = 0;
+            uint32_t unique = 0;
+            for (uint32_t index : indices) {
+                misses += load(cache, index) ? 1 : 0;
+                unique += referenced[index] ? 0 : 1;
+                referenced[index] = 1;
+            }
+
+            stats.acmr = static_cast<float>(misses) / static_cast<float>(triangle_count);
+            stats.atvr = static_cast<float>(misses) / static_cast<float>(unique);
+            return stats;
+        }
+
+        static float vertexScore(int cache_position, uint32_t remaining) {
+            if (remaining == 0) {
+                return -1.0f;
+            }
+
+            float score = 0.0f;
+            if (cache_position >= 0) {
+                // The last triangle's vertices get a flat score so the next pick doesn't just reuse its edge
+                if (cache_position < 3) {
+                    score = 0.75f;
+                } else {
+                    float scaled = 1.0f - static_cast<float>(cache_position - 3) /
+                                              static_cast<float>(score_cache_size - 3);
+                    score = std::pow(scaled, 1.5f);
+                }
+            }
+            // Vertices with few triangles left get finished off so they can leave the cache
+            score += 2.0f / std::sqrt(static_cast<float>(remaining));
+            return score;
+        }
+
+        void optimizeVertexCache(std::span<uint32_t> indices, size_t vertex_count) {
+            size_t triangle_count = indices.size() / 3;
+            if (triangle_count < 2) {
+                return;
+            }
+
+            // Triangles per vertex, the first remaining[v] entries of a vertex's list are the ones not emitted yet
+            std::vector<uint32_t> remaining(vertex_count, 0);
+            for (uint32_t index : indices) {
+                remaining[index]++;
+            }
+            std::vector<uint32_t> offsets(vertex_count + 1, 0);
+            std::partial_sum(remaining.begin(), remaining.end(), offsets.begin() + 1);
+            std::vector<uint32_t> adjacency(indices.size());
+            {
+                std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < indices.size(); i++) {
+                    adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+                }
+            }
+
+            std::vector<int> cache_position(vertex_count, -1);
+            std::vector<float> vertex_scores(vertex_count);
+            for (size_t v = 0; v < vertex_count; v++) {
+                vertex_scores[v] = vertexScore(-1, remaining[v]);
+            }
+
+            std::vector<uint8_t> emitted(triangle_count, 0);
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            std::vector<uint32_t> cache;
+            std::vector<uint32_t> next_cache;
+            cache.reserve(score_cache_size + 3);
+            next_cache.reserve(score_cache_size + 3);
+
+            size_t scan = 0;
+            int64_t best = -1;
+            while (result.size() < indices.size()) {
+                // Nothing in the cache touches a triangle that's left, carry on from the next unemitted one
+                if (best < 0) {
+                    while (emitted[scan]) {
+                        scan++;
+                    }
+                    best = static_cast<int64_t>(scan);
+                }
+
+                uint32_t triangle = static_cast<uint32_t>(best);
+                uint32_t corners[3] = {indices[triangle * 3], indices[triangle * 3 + 1], indices[triangle * 3 + 2]};
+                emitted[triangle] = 1;
+                result.insert(result.end(), corners, corners + 3);
+
+                for (uint32_t v : corners) {
+                    uint32_t* list = adjacency.data() + offsets[v];
+                    for (uint32_t i = 0; i < remaining[v]; i++) {
+                        if (list[i] == triangle) {
+                            std::swap(list[i], list[remaining[v] - 1]);
+                            remaining[v]--;
+                            break;
+                        }
+                    }
+                }
+
+                // The new triangle goes to the front, whatever falls past the end leaves the cache
+                next_cache.assign(corners, corners + 3);
+                for (uint32_t v : cache) {
+                    if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                        next_cache.push_back(v);
+                    }
+                }
+                for (size_t i = 0; i < next_cache.size(); i++) {
+                    uint32_t v = next_cache[i];
+                    cache_position[v] = i < score_cache_size ? static_cast<int>(i) : -1;
+                    vertex_scores[v] = vertexScore(cache_position[v], remaining[v]);
+                }
+                if (next_cache.size() > score_cache_size) {
+                    next_cache.resize(score_cache_size);
+                }
+                cache.swap(next_cache);
+
+                // Only triangles touching the cache changed score, the best of them goes next
+                best = -1;
+                float best_score = -1.0f;
+                for (uint32_t v : cache) {
+                    const uint32_t* list = adjacency.data() + offsets[v];
+                    for (uint32_t i = 0; i < remaining[v]; i++) {
+                        uint32_t t = list[i];
+                        float score = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] +
+                                      vertex_scores[indices[t * 3 + 2]];
+                        if (score > best_score) {
+                            best_score = score;
+                            best = t;
+                        }
+                    }
+                }
+            }
+
+            std::copy(result.begin(), result.end(), indices.begin());
+        }
+
+        void optimizeOverdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices) {
+            size_t triangle_count = indices.size() / 3;
+            if (triangle_count < 2) {
+                return;
+            }
+
+            // A triangle that misses on all three corners starts from a cold cache, cutting there costs nothing
+            std::vector<uint32_t> cluster_starts;
+            FifoCache cache{std::vector<uint32_t>(vertices.size(), 0)};
+            for (size_t t = 0; t < triangle_count; t++) {
+                uint32_t misses = 0;
+                for (size_t c = 0; c < 3; c++) {
+                    misses += load(cache, indices[t * 3 + c]) ? 1 : 0;
+                }
+                if (t == 0 || misses == 3) {
+                    cluster_starts.push_back(static_cast<uint32_t>(t));
+                }
+            }
+            if (cluster_starts.size() < 2) {
+                return;
+            }
+            cluster_starts.push_back(static_cast<uint32_t>(triangle_count));
+
+            glm::vec3 mesh_centre{0.0f};
+            for (uint32_t index : indices) {
+                mesh_centre += vertices[index].position;
+            }
+            mesh_centre /= static_cast<float>(indices.size());
+
+            // Clusters far out along their own normal are likely to cover the rest, draw those first
+            size_t cluster_count = cluster_starts.size() - 1;
+            std::vector<float> occlusion(cluster_count);
+            for (size_t c = 0; c < cluster_count; c++) {
+                glm::vec3 centre{0.0f};
+                glm::vec3 normal{0.0f};
+                float area = 0.0f;
+                for (uint32_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+                    glm::vec3 p0 = vertices[indices[t * 3]].position;
+                    glm::vec3 p1 = vertices[indices[t * 3 + 1]].position;
+                    glm::vec3 p2 = vertices[indices[t * 3 + 2]].position;
+                    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                    float a = glm::length(n);
+                    centre += (p0 + p1 + p2) * (a / 3.0f);
+                    normal += n;
+                    area += a;
+                }
+                if (area <= 0.0f || glm::length(normal) <= 0.0f) {
+                    occlusion[c] = 0.0f;
+                    continue;
+                }
+                centre /= area;
+                occlusion[c] = glm::dot(centre - mesh_centre, glm::normalize(normal));
+            }
+
+            std::vector<uint32_t> order(cluster_count);
+            std::iota(order.begin(), order.end(), 0u);
+            std::stable_sort(order.begin(), order.end(),
+                             [&](uint32_t a, uint32_t b) { return occlusion[a] > occlusion[b]; });
+
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            for (uint32_t c : order) {
+                result.insert(result.end(), indices.begin() + cluster_starts[c] * 3,
+                              indices.begin() + cluster_starts[c + 1] * 3);
+            }
+            std::copy(result.begin(), result.end(), indices.begin());
+        }
+
+        void optimizeVertexFetch(std::span<uint32_t> indices, std::vector<Vertex>& vertices) {
+            constexpr uint32_t unused = ~0u;
+            std::vector<uint32_t> remap(vertices.size(), unused);
+            std::vector<Vertex> reordered;
+            reordered.reserve(vertices.size());
+
+            for (uint32_t& index : indices) {
+                if (remap[index] == unused) {
+                    remap[index] = static_cast<uint32_t>(reordered.size());
+                    reordered.push_back(vertices[index]);
+                }
+                index = remap[index];
+            }
+            vertices.swap(reordered);
+        }
+
+        MeshStats optimizeMesh(std::vector<uint32_t>& indices, std::vector<Vertex>& vertices,
+                               const std::vector<MaterialOperation::GeoSurface>& surfaces) {
+            MeshStats stats{};
+            if (indices.empty() || vertices.empty()) {
+                return stats;
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            stats.before = analyzeVertexCache(indices, vertices.size());
+
+            for (const MaterialOperation::GeoSurface& surface : surfaces) {
+                std::span<uint32_t> range(indices.data() + surface.start_index, surface.count);
+                if (range.size() < 6) {
+                    continue;
+                }
+
+                // Work on the surface's own vertex window so the scratch arrays don't scale with the whole mesh
+                auto [min_it, max_it] = std::minmax_element(range.begin(), range.end());
+                uint32_t base = *min_it;
+                size_t window = *max_it - base + 1;
+                for (uint32_t& index : range) {
+                    index -= base;
+                }
+                optimizeVertexCache(range, window);
+                optimizeOverdraw(range, std::span<const Vertex>(vertices.data() + base, window));
+                for (uint32_t& index : range) {
+                    index += base;
+                }
+            }
+
+            // Surfaces reference disjoint vertex ranges in index order, so first use keeps each one contiguous
+            optimizeVertexFetch(indices, vertices);
+
+            stats.after = analyzeVertexCache(indices, vertices.size());
+            std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+            stats.ms = ms.count();
+            return stats;
+        }
+
+        void logMeshStats(std::string_view name, size_t triangle_count, const MeshStats& stats) {
+            std::cout << "mesh " << name << ": acmr " << stats.before.acmr << " -> " << stats.after.acmr << ", atvr "
+                      << stats.before.atvr << " -> " << stats.after.atvr << " (" << triangle_count << " triangles, "
+                      << stats.ms << " ms)" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "material.h"
+
+#include <string_view>
+
+namespace Vulkan {
+    namespace MeshOptimize {
+        // Fifo size the stats are simulated with, close to what current gpus reuse post transform
+        constexpr uint32_t analyze_cache_size{16};
+        // Lru size the triangle scoring works against, bigger than the hardware so it plans a little ahead
+        constexpr uint32_t score_cache_size{32};
+
+        // acmr is transformed vertices per triangle (0.5 best, 3 worst), atvr is transformed vertices per
+        // referenced vertex (1 best)
+        struct CacheStats {
+            float acmr{0.0f};
+            float atvr{0.0f};
+        };
+
+        CacheStats analyzeVertexCache(std::span<const uint32_t> indices, size_t vertex_count);
+
+        // Forsyth's linear speed triangle reordering, indices have to be below vertex_count
+        void optimizeVertexCache(std::span<uint32_t> indices, size_t vertex_count);
+        // Splits the cache ordered triangles into clusters where the cache starts cold anyway and draws the
+        // clusters facing out from the centre first, so the cache result only changes at the seams
+        void optimizeOverdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices);
+        // Renumbers vertices in order of first use and drops the ones nothing references
+        void optimizeVertexFetch(std::span<uint32_t> indices, std::vector<Vertex>& vertices);
+
+        struct MeshStats {
+            CacheStats before;
+            CacheStats after;
+            double ms{0.0};
+        };
+
+        // Runs all three over a mesh, each surface is reordered within its own index range so the ranges and
+        // their materials stay valid. Prints nothing so it can run on the loader workers, see logMeshStats
+        MeshStats optimizeMesh(std::vector<uint32_t>& indices, std::vector<Vertex>& vertices,
+                               const std::vector<MaterialOperation::GeoSurface>& surfaces);
+        void logMeshStats(std::string_view name, size_t triangle_count, const MeshStats& stats);
+    }
+}
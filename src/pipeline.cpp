@@ -1,17 +1,169 @@
 #include "pipeline.h"
+#include "thread_pool.h"
 #include "vulkan_utils.h"
 #include <array>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 
 namespace Vulkan {
 
     namespace Pipeline {
+        void createCache(const Device& device, const std::filesystem::path& path, Cache& cache) {
+            cache.path = path;
+            std::vector<char> data;
+            if (!path.empty()) {
+                std::ifstream file(path, std::ios::binary | std::ios::ate);
+                if (file) {
+                    data.resize(static_cast<size_t>(file.tellg()));
+                    file.seekg(0);
+                    file.read(data.data(), static_cast<std::streamsize>(data.size()));
+                    if (!file) {
+                        data.clear();
+                    }
+                }
+            }
+
+            // Drivers are meant to reject data from another device themselves, not all of them do
+            if (!data.empty()) {
+                VkPipelineCacheHeaderVersionOne header{};
+                bool valid = data.size() >= sizeof(header);
+                if (valid) {
+                    std::memcpy(&header, data.data(), sizeof(header));
+                    valid = header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                            header.vendorID == device.properties.vendorID &&
+                            header.deviceID == device.properties.deviceID &&
+                            std::memcmp(header.pipelineCacheUUID, device.properties.pipelineCacheUUID,
+                                        VK_UUID_SIZE) == 0;
+                }
+                if (!valid) {
+                    std::cout << "pipeline cache " << path << " is from another device or driver, starting cold"
+                              << std::endl;
+                    data.clear();
+                }
+            }
+
+            VkPipelineCacheCreateInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+            info.initialDataSize = data.size();
+            info.pInitialData = data.empty() ? nullptr : data.data();
+            vkCheck(vkCreatePipelineCache(device.logical_handle, &info, nullptr, &cache.handle));
+            cache.stats.warm = !data.empty();
+        }
+
+        bool saveCache(const Device& device, const Cache& cache) {
+            if (cache.handle == VK_NULL_HANDLE || cache.path.empty()) {
+                return false;
+            }
+            size_t size = 0;
+            vkCheck(vkGetPipelineCacheData(device.logical_handle, cache.handle, &size, nullptr));
+            std::vector<char> data(size);
+            if (size == 0 || vkGetPipelineCacheData(device.logical_handle, cache.handle, &size, data.data()) !=
+                                 VK_SUCCESS) {
+                return false;
+            }
+
+            // Written next to it and renamed over, a run killed half way leaves the old file intact
+            std::error_code error;
+            if (cache.path.has_parent_path()) {
+                std::filesystem::create_directories(cache.path.parent_path(), error);
+            }
+            std::filesystem::path temp_path = cache.path;
+            temp_path += ".tmp";
+            {
+                std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+                file.write(data.data(), static_cast<std::streamsize>(size));
+                if (!file) {
+                    return false;
+                }
+            }
+            std::filesystem::rename(temp_path, cache.path, error);
+            return !error;
+        }
+
+        void logStats(Cache& cache) {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            std::cout << "pipelines: " << cache.stats.pipelines_created << " created in " << cache.stats.create_ms
+                      << " ms, " << (cache.stats.warm ? "warm" : "cold") << " driver cache";
+            if (cache.stats.queue_ms > 0.0) {
+                std::cout << ", queued builds done " << cache.stats.queue_ms << " ms after they started";
+            }
+            if (cache.pending_builds > 0) {
+                std::cout << ", " << cache.pending_builds << " still building";
+            }
+            std::cout << std::endl;
+        }
+
+        static void combine(uint64_t& hash, uint64_t value) {
+            hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;
+            hash ^= hash >> 29;
+        }
+
+        static void combineStage(uint64_t& hash, const VkPipelineShaderStageCreateInfo& stage,
+                                 std::span<const uint32_t> code) {
+            combine(hash, stage.stage);
+            combine(hash, code.size());
+            for (uint32_t word : code) {
+                combine(hash, word);
+            }
+            if (stage.pName != nullptr) {
+                for (const char* c = stage.pName; *c != 0; c++) {
+                    combine(hash, static_cast<uint64_t>(*c));
+                }
+            }
+            if (stage.pSpecializationInfo != nullptr) {
+                const VkSpecializationInfo& specialization = *stage.pSpecializationInfo;
+                for (uint32_t i = 0; i < specialization.mapEntryCount; i++) {
+                    combine(hash, specialization.pMapEntries[i].constantID);
+                    combine(hash, specialization.pMapEntries[i].offset);
+                    combine(hash, specialization.pMapEntries[i].size);
+                }
+                const unsigned char* data = static_cast<const unsigned char*>(specialization.pData);
+                for (size_t i = 0; i < specialization.dataSize; i++) {
+                    combine(hash, data[i]);
+                }
+            }
+        }
+
+        uint64_t hashConfiguration(const Configuration& config) {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            combineStage(hash, config.vertex_stages, config.vertex_code);
+            combineStage(hash, config.fragment_stages, config.fragment_code);
+            combine(hash, config.format);
+            combine(hash, config.num_descriptor_sets);
+            for (const DescriptorLayout* layout : config.descriptor_layouts) {
+                combine(hash, layout->bindings.size());
+                for (const VkDescriptorSetLayoutBinding& binding : layout->bindings) {
+                    combine(hash, binding.binding);
+                    combine(hash, binding.descriptorType);
+                    combine(hash, binding.descriptorCount);
+                    combine(hash, binding.stageFlags);
+                    combine(hash, binding.pImmutableSamplers != nullptr);
+                }
+            }
+            combine(hash, config.polygon_mode);
+            combine(hash, config.cull_mode_flags);
+            combine(hash, config.front_face);
+            combine(hash, config.enable_blend);
+            combine(hash, config.enable_depth);
+            combine(hash, config.depth_compare);
+            combine(hash, config.push_constant_size);
+            // 0 means not hashed yet
+            return hash == 0 ? 1 : hash;
+        }
+
+        static uint64_t configurationKey(const Configuration& config) {
+            return config.key != 0 ? config.key : hashConfiguration(config);
+        }
+
         void destroyPipelineObject(const Device& device, const std::unique_ptr<Object>& pipeline)
         {
             vkDestroyPipelineLayout(device.logical_handle, pipeline->layout_handle, nullptr);
             vkDestroyPipeline(device.logical_handle, pipeline->handle, nullptr);
         }
 
-        std::unique_ptr<Object> createPipelineObject(const Device& device, const Configuration& config)
+        // Everything up to the compile, the layout is created here so it's valid for draws falling back
+        static std::unique_ptr<Object> preparePipelineObject(const Device& device, const Configuration& config)
         {
             /*
             Could use a memory allocator here and placement new the pipeline object from some arena/free list thingo maybe
@@ -27,7 +179,7 @@ namespace Vulkan {
             pipeline->input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
             pipeline->input_assembly.primitiveRestartEnable = VK_FALSE;
 
-            std::vector<VkDynamicState> dynamic_states = {
+            pipeline->dynamic_states = {
                 VK_DYNAMIC_STATE_VIEWPORT,
                 VK_DYNAMIC_STATE_SCISSOR
             };
@@ -50,8 +202,8 @@ namespace Vulkan {
             // pipeline->vertex_input_info.pVertexAttributeDescriptions = attributeDescriptions.data();
 
             pipeline->dynamic_states_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-            pipeline->dynamic_states_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
-            pipeline->dynamic_states_info.pDynamicStates = dynamic_states.data();
+            pipeline->dynamic_states_info.dynamicStateCount = static_cast<uint32_t>(pipeline->dynamic_states.size());
+            pipeline->dynamic_states_info.pDynamicStates = pipeline->dynamic_states.data();
 
             pipeline->viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
             pipeline->viewport_state.viewportCount = 1;
@@ -98,7 +250,7 @@ namespace Vulkan {
             pipeline->color_blending.blendConstants[3] = 0.0f;
 
             pipeline->buffer_range.offset = 0;
-            pipeline->buffer_range.size = sizeof(GPUDrawPushConstants);
+            pipeline->buffer_range.size = config.push_constant_size;
             pipeline->buffer_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
             pipeline->pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -112,14 +264,15 @@ namespace Vulkan {
             pipeline->render_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
             pipeline->render_info.pNext = nullptr; 
             pipeline->render_info.colorAttachmentCount = 1;
-            pipeline->render_info.pColorAttachmentFormats = &config.format;
+            pipeline->color_format = config.format;
+            pipeline->render_info.pColorAttachmentFormats = &pipeline->color_format;
             pipeline->render_info.depthAttachmentFormat = VK_FORMAT_D32_SFLOAT;
 
-            VkPipelineShaderStageCreateInfo stages[]= {config.vertex_stages, config.fragment_stages};
+            pipeline->stages = {config.vertex_stages, config.fragment_stages};
             pipeline->pipeline_info.pNext = &pipeline->render_info; 
             pipeline->pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-            pipeline->pipeline_info.stageCount = 2;
-            pipeline->pipeline_info.pStages = stages;
+            pipeline->pipeline_info.stageCount = static_cast<uint32_t>(pipeline->stages.size());
+            pipeline->pipeline_info.pStages = pipeline->stages.data();
 
             pipeline->depth_stencil_info.depthTestEnable = config.enable_depth;
             pipeline->depth_stencil_info.depthWriteEnable = config.enable_depth;
@@ -148,13 +301,120 @@ namespace Vulkan {
             pipeline->pipeline_info.basePipelineIndex = -1;
 
 
-            vkCheck(vkCreateGraphicsPipelines(device.logical_handle, VK_NULL_HANDLE, 1, &pipeline->pipeline_info, nullptr, &pipeline->handle)); 
+            return pipeline;
+        }
 
-            return std::move(pipeline);
+        // Safe on any thread, the shared driver cache is synchronized internally
+        static void compilePipelineObject(const Device& device, Cache& cache, Object& pipeline) {
+            auto create_start = std::chrono::high_resolution_clock::now();
+            vkCheck(vkCreateGraphicsPipelines(device.logical_handle, cache.handle, 1, &pipeline.pipeline_info,
+                                              nullptr, &pipeline.handle));
+            std::chrono::duration<double, std::milli> create_ms =
+                std::chrono::high_resolution_clock::now() - create_start;
+            {
+                std::lock_guard<std::mutex> lock(cache.mutex);
+                cache.stats.pipelines_created++;
+                cache.stats.create_ms += create_ms.count();
+            }
+            pipeline.ready.store(true, std::memory_order_release);
+        }
+
+        std::unique_ptr<Object> createPipelineObject(const Device& device, const Configuration& config,
+                                                     Cache& cache)
+        {
+            std::unique_ptr<Object> pipeline = preparePipelineObject(device, config);
+            compilePipelineObject(device, cache, *pipeline);
+            return pipeline;
+        }
+
+        Object* queuePipeline(const Device& device, const Configuration& config, Cache& cache, ThreadPool& workers,
+                              const Object* fallback) {
+            Object* cached = getPipelineFromCache(config, cache);
+            if (cached != nullptr) {
+                return cached;
+            }
+            std::unique_ptr<Object> pipeline = preparePipelineObject(device, config);
+            pipeline->fallback = fallback;
+            Object* queued = pipeline.get();
+            addPipelineToCache(config, cache, std::move(pipeline));
+
+            {
+                std::lock_guard<std::mutex> lock(cache.mutex);
+                if (cache.pending_builds == 0) {
+                    cache.queue_start = std::chrono::high_resolution_clock::now();
+                }
+                cache.pending_builds++;
+            }
+            std::string name(config.name);
+            Jobs::submit(workers, [&device, &cache, queued, name]() {
+                // A failed build stays on its fallback rather than taking the worker down
+                try {
+                    compilePipelineObject(device, cache, *queued);
+                } catch (const std::exception& e) {
+                    std::cerr << "pipeline " << name << " failed to build: " << e.what() << std::endl;
+                }
+                std::lock_guard<std::mutex> lock(cache.mutex);
+                cache.pending_builds--;
+                if (cache.pending_builds == 0) {
+                    std::chrono::duration<double, std::milli> queue_ms =
+                        std::chrono::high_resolution_clock::now() - cache.queue_start;
+                    cache.stats.queue_ms += queue_ms.count();
+                    cache.builds_done.notify_all();
+                }
+            });
+            return queued;
+        }
+
+        const Object* resolve(const Object* pipeline) {
+            if (pipeline->ready.load(std::memory_order_acquire)) {
+                return pipeline;
+            }
+            if (pipeline->fallback != nullptr && pipeline->fallback->ready.load(std::memory_order_acquire)) {
+                return pipeline->fallback;
+            }
+            return nullptr;
+        }
+
+        void waitForPipeline(Cache& cache, const Object* pipeline) {
+            std::unique_lock<std::mutex> lock(cache.mutex);
+            cache.builds_done.wait(lock, [&cache, pipeline]() {
+                return pipeline->ready.load(std::memory_order_acquire) || cache.pending_builds == 0;
+            });
+            if (!pipeline->ready.load(std::memory_order_acquire)) {
+                throw std::runtime_error("waited on a pipeline that failed to build");
+            }
+        }
+
+        void waitForBuilds(Cache& cache) {
+            std::unique_lock<std::mutex> lock(cache.mutex);
+            cache.builds_done.wait(lock, [&cache]() { return cache.pending_builds == 0; });
+        }
+
+        void retireShaderModule(const Device& device, Cache& cache, Shader& shader) {
+            {
+                std::lock_guard<std::mutex> lock(cache.mutex);
+                if (cache.pending_builds > 0) {
+                    cache.retired_modules.push_back(shader.module);
+                    shader.module = VK_NULL_HANDLE;
+                    return;
+                }
+            }
+            destroyShaderModule(device, shader);
+        }
+
+        void collect(const Device& device, Cache& cache) {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            if (cache.pending_builds > 0 || cache.retired_modules.empty()) {
+                return;
+            }
+            for (VkShaderModule module : cache.retired_modules) {
+                vkDestroyShaderModule(device.logical_handle, module, nullptr);
+            }
+            cache.retired_modules.clear();
         }
 
         Object* getPipelineFromCache(const Configuration& config, Cache& cache) {
-            auto it = cache.object_map.find(config.name);
+            auto it = cache.object_map.find(configurationKey(config));
             if (it != cache.object_map.end()) {
                 return it->second.get();
             }
@@ -163,15 +423,86 @@ namespace Vulkan {
 
         void addPipelineToCache(const Configuration& config, Cache& cache, std::unique_ptr<Object> pipeline)
         {
-            cache.object_map[config.name] = std::move(pipeline);
+            std::unique_ptr<Object>& entry = cache.object_map[configurationKey(config)];
+            if (entry != nullptr) {
+                std::cout << "pipeline " << config.name << " has the same state as one already cached" << std::endl;
+            }
+            entry = std::move(pipeline);
+        }
+
+        void destroyComputeObject(const Device& device, const std::unique_ptr<ComputeObject>& pipeline)
+        {
+            vkDestroyPipelineLayout(device.logical_handle, pipeline->layout_handle, nullptr);
+            vkDestroyPipeline(device.logical_handle, pipeline->handle, nullptr);
+        }
+
+        std::unique_ptr<ComputeObject> createComputeObject(const Device& device, const ComputeConfiguration& config,
+                                                           Cache& cache)
+        {
+            std::unique_ptr<ComputeObject> pipeline = std::make_unique<ComputeObject>();
+
+            pipeline->push_range.offset = 0;
+            pipeline->push_range.size = config.push_constant_size;
+            pipeline->push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+            pipeline->pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pipeline->pipeline_layout_info.setLayoutCount = config.num_descriptor_sets;
+            pipeline->pipeline_layout_info.pSetLayouts = config.descriptor_set_layout;
+            pipeline->pipeline_layout_info.pushConstantRangeCount = config.push_constant_size > 0 ? 1 : 0;
+            pipeline->pipeline_layout_info.pPushConstantRanges = &pipeline->push_range;
+
+            vkCheck(vkCreatePipelineLayout(device.logical_handle, &pipeline->pipeline_layout_info, nullptr,
+                                           &pipeline->layout_handle));
+
+            pipeline->pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipeline->pipeline_info.stage = config.compute_stage;
+            pipeline->pipeline_info.layout = pipeline->layout_handle;
+            pipeline->pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+            pipeline->pipeline_info.basePipelineIndex = -1;
+
+            auto create_start = std::chrono::high_resolution_clock::now();
+            vkCheck(vkCreateComputePipelines(device.logical_handle, cache.handle, 1, &pipeline->pipeline_info,
+                                             nullptr, &pipeline->handle));
+            std::chrono::duration<double, std::milli> create_ms =
+                std::chrono::high_resolution_clock::now() - create_start;
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            cache.stats.pipelines_created++;
+            cache.stats.create_ms += create_ms.count();
+
+            return pipeline;
+        }
+
+        void addComputeToCache(const ComputeConfiguration& config, Cache& cache,
+                               std::unique_ptr<ComputeObject> pipeline)
+        {
+            cache.compute_map[config.name] = std::move(pipeline);
+        }
+
+        ComputeObject* getComputeFromCache(std::string_view name, Cache& cache)
+        {
+            auto it = cache.compute_map.find(name);
+            if (it != cache.compute_map.end()) {
+                return it->second.get();
+            }
+            return nullptr;
         }
 
         void clearCache(const Device& device, Cache& cache)
         {
+            waitForBuilds(cache);
+            collect(device, cache);
             for (const auto& pair : cache.object_map) {
                 destroyPipelineObject(device, pair.second);
             }
             cache.object_map.clear();
+            for (const auto& pair : cache.compute_map) {
+                destroyComputeObject(device, pair.second);
+            }
+            cache.compute_map.clear();
+            if (cache.handle != VK_NULL_HANDLE) {
+                vkDestroyPipelineCache(device.logical_handle, cache.handle, nullptr);
+                cache.handle = VK_NULL_HANDLE;
+            }
         }
 
         bool loadShader(Shader& shader) {
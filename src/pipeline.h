@@ -15,6 +15,12 @@
 #include <sys/stat.h>
 #include <functional>
 #include <tuple>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <span>
 
 #ifdef _WIN32
     #include <windows.h>
@@ -28,6 +34,8 @@
 
 namespace Vulkan {
 
+    struct ThreadPool;
+
         /*
         Need to sort out a ref to the device for the shader modules
         */
@@ -162,6 +170,14 @@ namespace Vulkan {
             VkPipelineRenderingCreateInfo render_info{};
             VkGraphicsPipelineCreateInfo pipeline_info{};
             VkPipelineDepthStencilStateCreateInfo depth_stencil_info{};
+            // Held here rather than on the stack so a queued build can still read them
+            std::array<VkDynamicState, 2> dynamic_states{};
+            std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+            VkFormat color_format{VK_FORMAT_UNDEFINED};
+            // Set once handle is valid. Until then draws use fallback, which shares the layout's sets and push
+            // constants
+            std::atomic<bool> ready{false};
+            const Object* fallback{nullptr};
         };
 
         struct Configuration {
@@ -178,12 +194,60 @@ namespace Vulkan {
             VkBool32 enable_blend{VK_TRUE};
             VkBool32 enable_depth{VK_TRUE};
             VkCompareOp depth_compare{};
+            uint32_t push_constant_size{sizeof(GPUDrawPushConstants)};
+            // Hashed in place of the module and set layout handles, a freed handle value can come back for
+            // different state. The stages' Shader::spirv_binary and one layout per descriptor set
+            std::span<const uint32_t> vertex_code{};
+            std::span<const uint32_t> fragment_code{};
+            std::span<const DescriptorLayout* const> descriptor_layouts{};
+            // Hash of everything above except the name and handles, what the cache is keyed on. Set it with
+            // hashConfiguration while the code, layouts and specialization data are still alive, a config left
+            // at 0 is hashed on every lookup
+            uint64_t key{0};
+        };
+
+        struct ComputeObject {
+            VkPipeline handle;
+            VkPipelineLayout layout_handle;
+            VkPushConstantRange push_range{};
+            VkPipelineLayoutCreateInfo pipeline_layout_info{};
+            VkComputePipelineCreateInfo pipeline_info{};
+        };
+
+        struct ComputeConfiguration {
+            VkPipelineShaderStageCreateInfo compute_stage{};
+            std::string_view name{""};
+            VkDescriptorSetLayout* descriptor_set_layout{nullptr};
+            uint32_t num_descriptor_sets{0};
+            uint32_t push_constant_size{0};
+        };
+
+        // Time spent in vkCreate*Pipelines, the number to compare between a cold and a warm start
+        struct Stats {
+            uint32_t pipelines_created{0};
+            // Summed over every create, with queued builds it runs ahead of the wall clock
+            double create_ms{0.0};
+            // First queued build to the last one finishing
+            double queue_ms{0.0};
+            // The driver cache came from disk and matched this device
+            bool warm{false};
         };
 
         struct Cache {
-            // Update to use the config as the hash when my life force can deal with all the overloading of the == operator and hash specialization into the dark of the void of whats required.
-            // Maybe just change to a uint handle? why use the config, i dont quite see the benefit, at least for my case at the moment.
-            std::unordered_map<std::string_view, std::unique_ptr<Object>> object_map;
+            std::unordered_map<uint64_t, std::unique_ptr<Object>> object_map;
+            std::unordered_map<std::string_view, std::unique_ptr<ComputeObject>> compute_map;
+            // Shared by every pipeline create, saved on shutdown so the next run skips the compiles
+            VkPipelineCache handle{VK_NULL_HANDLE};
+            std::filesystem::path path{};
+            Stats stats{};
+
+            // Guards stats and the queued build state, the maps are only touched on the main thread
+            std::mutex mutex;
+            std::condition_variable builds_done;
+            uint32_t pending_builds{0};
+            std::chrono::high_resolution_clock::time_point queue_start{};
+            // Modules the queued builds still read, destroyed once they're done
+            std::vector<VkShaderModule> retired_modules;
         };
 
         struct Shader {
@@ -195,10 +259,38 @@ namespace Vulkan {
 
         // Operators
 
+        // Reads path into the driver cache when its header matches this device, otherwise starts empty. An empty
+        // path keeps the cache in memory only
+        void createCache(const Device& device, const std::filesystem::path& path, Cache& cache);
+        // Writes the driver cache back to its path, returns false when there's nothing to write or it failed
+        bool saveCache(const Device& device, const Cache& cache);
+        void logStats(Cache& cache);
+
+        uint64_t hashConfiguration(const Configuration& config);
         void destroyPipelineObject(const Device& device, const std::unique_ptr<Object>& pipeline);
-        std::unique_ptr<Object> createPipelineObject(const Device& device, const Configuration& config);
+        std::unique_ptr<Object> createPipelineObject(const Device& device, const Configuration& config,
+                                                     Cache& cache);
         void addPipelineToCache(const Configuration& config, Cache& cache, std::unique_ptr<Object> pipeline);
+        // Adds the pipeline to the cache straight away and compiles it on workers, vkCreateGraphicsPipelines and
+        // the driver cache are safe to use from several threads. Returns the cached one when the state is there
+        Object* queuePipeline(const Device& device, const Configuration& config, Cache& cache, ThreadPool& workers,
+                              const Object* fallback);
+        // What a draw should bind, the pipeline once built, its fallback before. Null when neither is usable
+        const Object* resolve(const Object* pipeline);
+        void waitForPipeline(Cache& cache, const Object* pipeline);
+        void waitForBuilds(Cache& cache);
+        // The module goes once no queued build can read it anymore
+        void retireShaderModule(const Device& device, Cache& cache, Shader& shader);
+        // Once a frame, destroys retired modules when the queue has drained
+        void collect(const Device& device, Cache& cache);
         Object* getPipelineFromCache(const Configuration& config, Cache& cache);
+        void destroyComputeObject(const Device& device, const std::unique_ptr<ComputeObject>& pipeline);
+        std::unique_ptr<ComputeObject> createComputeObject(const Device& device, const ComputeConfiguration& config,
+                                                           Cache& cache);
+        void addComputeToCache(const ComputeConfiguration& config, Cache& cache,
+                               std::unique_ptr<ComputeObject> pipeline);
+        ComputeObject* getComputeFromCache(std::string_view name, Cache& cache);
+        // Destroys the pipelines and the driver cache, save it first
         void clearCache(const Device& device, Cache& cache);
         bool loadShader(Shader& shader);
         void createShaderModule(const Device& device, Shader& shader);
@@ -0,0 +1,167 @@
+#include "profiler.h"
+#include "device.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace Vulkan {
+    namespace Profiler {
+        void createQueries(const Device& device, FrameQueries& queries) {
+            uint32_t num_queue_families{0};
+            vkGetPhysicalDeviceQueueFamilyProperties(device.physical_handle, &num_queue_families, nullptr);
+            std::vector<VkQueueFamilyProperties> queue_fams(num_queue_families);
+            vkGetPhysicalDeviceQueueFamilyProperties(device.physical_handle, &num_queue_families, queue_fams.data());
+
+            uint32_t valid_bits = queue_fams[device.suitability.queue_fam_indexes.at("draw")].timestampValidBits;
+            if (valid_bits == 0) {
+                std::cout << "Timestamps not supported on the draw queue, gpu profiling disabled" << std::endl;
+                queries.enabled = false;
+                return;
+            }
+            queries.timestamp_mask = (valid_bits >= 64) ? ~0ull : ((1ull << valid_bits) - 1);
+
+            VkQueryPoolCreateInfo query_info{};
+            query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            query_info.queryCount = max_queries;
+            vkCheck(vkCreateQueryPool(device.logical_handle, &query_info, nullptr, &queries.pool));
+
+            queries.scopes.reserve(max_queries / 2);
+            queries.enabled = true;
+        }
+
+        void destroyQueries(const Device& device, FrameQueries& queries) {
+            if (queries.pool) {
+                vkDestroyQueryPool(device.logical_handle, queries.pool, nullptr);
+                queries.pool = VK_NULL_HANDLE;
+            }
+            queries.enabled = false;
+        }
+
+        void resetQueries(VkCommandBuffer cmd, FrameQueries& queries) {
+            queries.scopes.clear();
+            queries.next_query = 0;
+            if (!queries.enabled) {
+                return;
+            }
+            vkCmdResetQueryPool(cmd, queries.pool, 0, max_queries);
+            queries.pending = true;
+        }
+
+        uint32_t beginScope(VkCommandBuffer cmd, FrameQueries& queries, std::string_view name) {
+            if (!queries.enabled || queries.next_query + 2 > max_queries) {
+                return UINT32_MAX;
+            }
+            Scope scope{.name = name, .begin_query = queries.next_query, .end_query = queries.next_query + 1};
+            queries.next_query += 2;
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.pool, scope.begin_query);
+            queries.scopes.push_back(scope);
+            return static_cast<uint32_t>(queries.scopes.size() - 1);
+        }
+
+        void endScope(VkCommandBuffer cmd, FrameQueries& queries, uint32_t scope) {
+            if (scope == UINT32_MAX) {
+                return;
+            }
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries.pool,
+                                queries.scopes[scope].end_query);
+        }
+
+        static void pushSample(RollingAverage& average, double ms) {
+            if (average.count == average_window) {
+                average.sum -= average.window[average.head];
+            } else {
+                average.count++;
+            }
+            average.window[average.head] = ms;
+            average.sum += ms;
+            average.head = (average.head + 1) % average_window;
+            average.last_ms = ms;
+        }
+
+        void collect(const Device& device, FrameQueries& queries, Stats& stats) {
+            if (!queries.pending) {
+                return;
+            }
+            queries.pending = false;
+            queries.results.clear();
+            if (queries.next_query == 0) {
+                return;
+            }
+
+            std::array<uint64_t, max_queries> timestamps{};
+            VkResult result = vkGetQueryPoolResults(device.logical_handle, queries.pool, 0, queries.next_query,
+                                                    sizeof(uint64_t) * queries.next_query, timestamps.data(),
+                                                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            if (result != VK_SUCCESS) {
+                return;
+            }
+
+            // Scopes that share a name within a frame are summed, so split up passes still report as one bucket
+            double period = device.properties.limits.timestampPeriod;
+            for (const Scope& scope : queries.scopes) {
+                uint64_t begin = timestamps[scope.begin_query] & queries.timestamp_mask;
+                uint64_t end = timestamps[scope.end_query] & queries.timestamp_mask;
+                double ms = static_cast<double>((end - begin) & queries.timestamp_mask) * period / 1000000.0;
+
+                auto it = std::find_if(queries.results.begin(), queries.results.end(),
+                                       [&](const ScopeResult& r) { return r.name == scope.name; });
+                if (it != queries.results.end()) {
+                    it->ms += ms;
+                } else {
+                    queries.results.push_back({scope.name, ms});
+                }
+            }
+
+            for (const ScopeResult& scope_result : queries.results) {
+                auto it = stats.scopes.find(std::string(scope_result.name));
+                if (it == stats.scopes.end()) {
+                    it = stats.scopes.emplace(std::string(scope_result.name), RollingAverage{}).first;
+                }
+                pushSample(it->second, scope_result.ms);
+            }
+        }
+
+        double averageMs(const Stats& stats, std::string_view name) {
+            auto it = stats.scopes.find(std::string(name));
+            if (it == stats.scopes.end() || it->second.count == 0) {
+                return 0.0;
+            }
+            return it->second.sum / it->second.count;
+        }
+
+        double lastMs(const FrameQueries& queries, std::string_view name) {
+            for (const ScopeResult& scope_result : queries.results) {
+                if (scope_result.name == name) {
+                    return scope_result.ms;
+                }
+            }
+            return 0.0;
+        }
+
+        void log(const Stats& stats) {
+            std::vector<std::string_view> names;
+            for (const auto& pair : stats.scopes) {
+                names.push_back(pair.first);
+            }
+            std::sort(names.begin(), names.end());
+
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "gpu scopes (avg over " << average_window << " frames):" << std::endl;
+            for (std::string_view name : names) {
+                const RollingAverage& average = stats.scopes.at(std::string(name));
+                std::cout << "  " << name << " avg " << averageMs(stats, name) << " ms last " << average.last_ms
+                          << " ms" << std::endl;
+            }
+        }
+
+        ScopedZone::ScopedZone(VkCommandBuffer cmd, FrameQueries& queries, std::string_view name)
+            : cmd(cmd), queries(queries), scope(beginScope(cmd, queries, name)) {
+        }
+
+        ScopedZone::~ScopedZone() {
+            endScope(cmd, queries, scope);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "vulkan_common.h"
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace Vulkan {
+
+    struct Device;
+
+    namespace Profiler {
+        constexpr uint32_t max_queries{128};
+        constexpr uint32_t average_window{64};
+
+        struct Scope {
+            std::string_view name;
+            uint32_t begin_query;
+            uint32_t end_query;
+        };
+
+        struct ScopeResult {
+            std::string_view name;
+            double ms;
+        };
+
+        // One per FrameResources, so reading it back never waits on work that is still in flight
+        struct FrameQueries {
+            VkQueryPool pool{VK_NULL_HANDLE};
+            std::vector<Scope> scopes;
+            std::vector<ScopeResult> results;
+            uint32_t next_query{0};
+            uint64_t timestamp_mask{~0ull};
+            bool enabled{false};
+            bool pending{false};
+        };
+
+        struct RollingAverage {
+            std::array<double, average_window> window{};
+            uint32_t head{0};
+            uint32_t count{0};
+            double sum{0.0};
+            double last_ms{0.0};
+        };
+
+        struct Stats {
+            std::unordered_map<std::string, RollingAverage> scopes;
+        };
+
+        void createQueries(const Device& device, FrameQueries& queries);
+        void destroyQueries(const Device& device, FrameQueries& queries);
+        // Must be recorded outside of rendering, before any scopes for the frame
+        void resetQueries(VkCommandBuffer cmd, FrameQueries& queries);
+        uint32_t beginScope(VkCommandBuffer cmd, FrameQueries& queries, std::string_view name);
+        void endScope(VkCommandBuffer cmd, FrameQueries& queries, uint32_t scope);
+        // Call once the gpu has finished the frame that recorded these queries
+        void collect(const Device& device, FrameQueries& queries, Stats& stats);
+        double averageMs(const Stats& stats, std::string_view name);
+        double lastMs(const FrameQueries& queries, std::string_view name);
+        void log(const Stats& stats);
+
+        struct ScopedZone {
+            ScopedZone(VkCommandBuffer cmd, FrameQueries& queries, std::string_view name);
+            ~ScopedZone();
+            ScopedZone(const ScopedZone&) = delete;
+            ScopedZone& operator=(const ScopedZone&) = delete;
+
+            VkCommandBuffer cmd;
+            FrameQueries& queries;
+            uint32_t scope;
+        };
+    }
+}
@@ -1,16 +1,32 @@
-#define NOMINMAX
-#include <Windows.h>
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <Windows.h>
+#endif
 
+#include "culling.h"
 #include "device.h"
 #include "material.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimize.h"
 #include "resource_manager.h"
+#include "texture_cache.h"
+#include "texture_streaming.h"
+#include "thread_pool.h"
 #include "vulkan_operations.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
 #include <stdexcept>
+#include <thread>
+#include <unordered_set>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <fastgltf/core.hpp>
 #include <fastgltf/glm_element_traits.hpp>
@@ -18,7 +34,6 @@
 
 
 #include <ktx.h>
-#include <ktxvulkan.h>
 
 namespace Vulkan {
 
@@ -26,7 +41,8 @@ namespace Vulkan {
         std::vector<std::shared_ptr<MaterialOperation::MeshAsset>> loadAssets(Device& device,
                                                                               const std::string& filepath,
                                                                               VmaAllocator allocator_handle,
-                                                                              VkCommandPool pool_handle) {
+                                                                              Upload::Context& uploader,
+                                                                              Geometry::Buffers& geometry) {
 
             std::filesystem::path f_path(filepath);
             std::cout << "Loading GLTF: " << f_path << std::endl;
@@ -94,6 +110,9 @@ namespace Vulkan {
                                                                       });
                     }
 
+                    new_sub_primitive.bounds = Culling::computeBounds(
+                        std::span<const Vertex>(vertices.data() + initial_vtx, vertices.size() - initial_vtx));
+
                     // load vertex normals
                     auto normals = p.findAttribute("NORMAL");
                     if (normals != p.attributes.end()) {
@@ -136,67 +155,390 @@ namespace Vulkan {
                 }
                 // sub_mesh.upload(device, allocator_handle, pool_handle);
 
+                MeshOptimize::MeshStats stats = MeshOptimize::optimizeMesh(indices, vertices, sub_mesh.surfaces);
+                MeshOptimize::logMeshStats(sub_mesh.name, indices.size() / 3, stats);
                 sub_mesh.mesh_buffers =
-                    MeshOperations::uploadMeshData(device, allocator_handle, pool_handle, indices, vertices);
+                    MeshOperations::uploadMeshData(device, allocator_handle, uploader, geometry, indices, vertices);
 
                 // meshes.emplace(mesh_index, sub_mesh);
                 meshes.emplace_back(std::make_shared<MaterialOperation::MeshAsset>(std::move(sub_mesh)));
             }
 
+            Upload::submit(device, uploader);
             return meshes;
         }
 
-        std::optional<std::shared_ptr<MaterialOperation::LoadedGLTF>> loadGLTF(
-            Device& device, const std::string& filepath, VmaAllocator& allocator_handle, VkCommandPool& pool_handle,
-            AllocatedTexture& default_texture, MaterialOperation::MaterialResources& default_resources,
-            MaterialOperation::GLTFOperations& material_operations, Pipeline::Cache& pipeline_cache) {
-            std::cout << "Loading GLTF: " << filepath << std::endl;
+        // Every buffer of the asset as bytes. Glb and external buffers point into file mappings, so nothing
+        // the accessors read is copied into the heap first
+        struct SourceBuffers {
+            std::vector<std::span<const std::byte>> bytes;
+            std::vector<MeshCache::Mapping> mappings;
 
-            std::shared_ptr<MaterialOperation::LoadedGLTF> scene = std::make_shared<MaterialOperation::LoadedGLTF>();
-            MaterialOperation::LoadedGLTF& file = *scene.get();
+            ~SourceBuffers() {
+                for (MeshCache::Mapping& mapping : mappings) {
+                    MeshCache::unmap(mapping);
+                }
+            }
+        };
 
-            auto cleanup = [&device, &allocator_handle, &pool_handle, scene, default_texture]() {
-                Descriptors::destroyPools(scene->descriptor_pool, device);
-                Buffer::destroyBuffer(allocator_handle, scene->material_data_buffer);
+        // Hands fastgltf's accessor tools the mapped bytes of a buffer view
+        struct SourceBufferAdapter {
+            const SourceBuffers* buffers{nullptr};
 
-                for (auto& v : scene->textures) {
+            fastgltf::span<const std::byte> operator()(const fastgltf::Asset& asset, std::size_t buffer_view) const {
+                const fastgltf::BufferView& view = asset.bufferViews[buffer_view];
+                std::span<const std::byte> bytes = buffers->bytes[view.bufferIndex];
+                return {bytes.data() + view.byteOffset, view.byteLength};
+            }
+        };
+
+        // A file besides the gltf went into the cooked data, hash covers all of it so a warm load can check it
+        static void addDependency(MeshCache::Data& cooked, const std::filesystem::path& file, uint64_t hash) {
+            std::error_code error;
+            std::string path = std::filesystem::absolute(file, error).string();
+            if (error) {
+                path = file.string();
+            }
+            cooked.dependencies.push_back({hash, static_cast<uint32_t>(cooked.names.size()),
+                                           static_cast<uint32_t>(path.size())});
+            cooked.names.insert(cooked.names.end(), path.begin(), path.end());
+        }
 
-                    if (v.image == default_texture.image) {
-                        continue;
+        // Without LoadGLBBuffers and LoadExternalBuffers fastgltf leaves buffers as uris, the glb's own one with
+        // an offset into the file. Those are mapped, the rest (data uris) fastgltf already decoded
+        static bool mapBuffers(const fastgltf::Asset& asset, const std::filesystem::path& source_path,
+                               SourceBuffers& buffers, MeshCache::Data& cooked) {
+            std::filesystem::path directory = source_path.parent_path();
+            for (const fastgltf::Buffer& buffer : asset.buffers) {
+                std::span<const std::byte> bytes;
+                bool found = false;
+                std::visit(fastgltf::visitor{
+                               [](auto& arg) {
+                               },
+                               [&](const fastgltf::sources::URI& uri) {
+                                   if (!uri.uri.isLocalPath()) {
+                                       return;
+                                   }
+                                   // Relative to the gltf for external buffers, the glb's own one may already
+                                   // carry the directory
+                                   std::filesystem::path uri_path(uri.uri.path());
+                                   MeshCache::Mapping mapping{};
+                                   std::filesystem::path file = uri_path.empty() ? source_path : directory / uri_path;
+                                   bool mapped = MeshCache::map(file, mapping);
+                                   if (!mapped && !uri_path.empty()) {
+                                       file = uri_path;
+                                       mapped = MeshCache::map(file, mapping);
+                                   }
+                                   if (!mapped) {
+                                       return;
+                                   }
+                                   buffers.mappings.push_back(mapping);
+                                   // The glb's own buffer is covered by the source hash
+                                   if (!uri_path.empty()) {
+                                       addDependency(cooked, file, MeshCache::hashBytes({mapping.data, mapping.size}));
+                                   }
+                                   if (uri.fileByteOffset + buffer.byteLength <= mapping.size) {
+                                       bytes = {reinterpret_cast<const std::byte*>(mapping.data) + uri.fileByteOffset,
+                                                buffer.byteLength};
+                                       found = true;
+                                   }
+                               },
+                               [&](const fastgltf::sources::Array& array) {
+                                   bytes = {array.bytes.data(), array.bytes.size()};
+                                   found = true;
+                               },
+                               [&](const fastgltf::sources::Vector& vector) {
+                                   bytes = {vector.bytes.data(), vector.bytes.size()};
+                                   found = true;
+                               },
+                               [&](const fastgltf::sources::ByteView& view) {
+                                   bytes = {view.bytes.data(), view.bytes.size()};
+                                   found = true;
+                               },
+                           },
+                           buffer.data);
+                if (!found) {
+                    std::cerr << "gltf buffer " << buffers.bytes.size() << " of " << source_path
+                              << " couldn't be read" << std::endl;
+                    return false;
+                }
+                buffers.bytes.push_back(bytes);
+            }
+            return true;
+        }
+
+        // The image as stored in the gltf, still encoded, appended to the cooked image bytes
+        static bool readEncodedImage(const fastgltf::Asset& asset, const SourceBuffers& buffers,
+                                     const fastgltf::Image& image, MeshCache::Data& cooked) {
+            std::vector<unsigned char>& bytes = cooked.image_bytes;
+            bool found = false;
+            std::visit(fastgltf::visitor{
+                           [](auto& arg) {
+                           },
+                           [&](const fastgltf::sources::URI& filePath) {
+                               assert(filePath.fileByteOffset == 0);
+                               assert(filePath.uri.isLocalPath());
+                               const std::string path(filePath.uri.path().begin(), filePath.uri.path().end());
+                               std::ifstream file(path, std::ios::binary | std::ios::ate);
+                               if (file) {
+                                   size_t offset = bytes.size();
+                                   bytes.resize(offset + static_cast<size_t>(file.tellg()));
+                                   file.seekg(0);
+                                   file.read(reinterpret_cast<char*>(bytes.data() + offset),
+                                             static_cast<std::streamsize>(bytes.size() - offset));
+                                   found = static_cast<bool>(file);
+                                   if (found) {
+                                       addDependency(cooked, path, MeshCache::hashBytes({bytes.data() + offset,
+                                                                                         bytes.size() - offset}));
+                                   }
+                               }
+                           },
+                           [&](const fastgltf::sources::Vector& vector) {
+                               const unsigned char* data = reinterpret_cast<const unsigned char*>(vector.bytes.data());
+                               bytes.insert(bytes.end(), data, data + vector.bytes.size());
+                               found = true;
+                           },
+                           [&](const fastgltf::sources::BufferView& view) {
+                               auto& bufferView = asset.bufferViews[view.bufferViewIndex];
+                               std::span<const std::byte> buffer = buffers.bytes[bufferView.bufferIndex];
+                               const unsigned char* data =
+                                   reinterpret_cast<const unsigned char*>(buffer.data()) + bufferView.byteOffset;
+                               bytes.insert(bytes.end(), data, data + bufferView.byteLength);
+                               found = true;
+                           },
+                       },
+                       image.data);
+            return found;
+        }
+
+        static MeshCache::TextureRef textureRef(const fastgltf::Asset& gltf, size_t texture_index) {
+            const fastgltf::Texture& texture = gltf.textures[texture_index];
+            MeshCache::TextureRef ref{};
+            // The ktx2 source wins over the png or jpg fallback when a texture has both
+            if (texture.basisuImageIndex.has_value()) {
+                ref.image = static_cast<int32_t>(texture.basisuImageIndex.value());
+            } else if (texture.imageIndex.has_value()) {
+                ref.image = static_cast<int32_t>(texture.imageIndex.value());
+            } else {
+                ref.image = MeshCache::no_index;
+            }
+            ref.sampler = texture.samplerIndex.has_value() ? static_cast<int32_t>(texture.samplerIndex.value())
+                                                           : MeshCache::no_index;
+            return ref;
+        }
+
+        // One mesh's streams with indices relative to its own vertices
+        struct CookedMesh {
+            std::vector<uint32_t> indices;
+            std::vector<Vertex> vertices;
+            std::vector<MaterialOperation::GeoSurface> surfaces;
+            std::vector<int32_t> surface_materials;
+        };
+
+        // A float attribute read in place from its buffer view. Empty when the accessor needs fastgltf's
+        // conversion, normalized integers, sparse data or a different width
+        struct AttributeStream {
+            const std::byte* data{nullptr};
+            size_t stride{0};
+        };
+
+        static AttributeStream floatStream(const fastgltf::Asset& gltf, const SourceBufferAdapter& buffers,
+                                           const fastgltf::Accessor& accessor, fastgltf::AccessorType type) {
+            if (accessor.componentType != fastgltf::ComponentType::Float || accessor.type != type ||
+                accessor.sparse.has_value() || !accessor.bufferViewIndex.has_value()) {
+                return {};
+            }
+            size_t view_index = accessor.bufferViewIndex.value();
+            size_t element_size = fastgltf::getElementByteSize(type, accessor.componentType);
+            return {buffers(gltf, view_index).data() + accessor.byteOffset,
+                    gltf.bufferViews[view_index].byteStride.value_or(element_size)};
+        }
+
+        // Indices straight into the primitive's range, the common widths without going through fastgltf
+        static void readIndices(const fastgltf::Asset& gltf, const SourceBufferAdapter& buffers,
+                                const fastgltf::Accessor& accessor, std::span<uint32_t> indices) {
+            if (accessor.sparse.has_value() || !accessor.bufferViewIndex.has_value()) {
+                fastgltf::iterateAccessorWithIndex<std::uint32_t>(
+                    gltf, accessor, [&](std::uint32_t idx, size_t i) { indices[i] = idx; }, buffers);
+                return;
+            }
+            size_t view_index = accessor.bufferViewIndex.value();
+            const std::byte* data = buffers(gltf, view_index).data() + accessor.byteOffset;
+            size_t element_size = fastgltf::getElementByteSize(accessor.type, accessor.componentType);
+            size_t stride = gltf.bufferViews[view_index].byteStride.value_or(element_size);
+            switch (accessor.componentType) {
+            case fastgltf::ComponentType::UnsignedInt:
+                for (size_t i = 0; i < indices.size(); i++) {
+                    memcpy(&indices[i], data + i * stride, sizeof(uint32_t));
+                }
+                break;
+            case fastgltf::ComponentType::UnsignedShort:
+                for (size_t i = 0; i < indices.size(); i++) {
+                    uint16_t index;
+                    memcpy(&index, data + i * stride, sizeof(uint16_t));
+                    indices[i] = index;
+                }
+                break;
+            case fastgltf::ComponentType::UnsignedByte:
+                for (size_t i = 0; i < indices.size(); i++) {
+                    indices[i] = static_cast<uint32_t>(data[i * stride]);
+                }
+                break;
+            default:
+                fastgltf::iterateAccessorWithIndex<std::uint32_t>(
+                    gltf, accessor, [&](std::uint32_t idx, size_t i) { indices[i] = idx; }, buffers);
+                break;
+            }
+        }
+
+        // Runs on the loader workers, only reads the asset. Each primitive's vertices are written once, in their
+        // final layout, by a single pass over every float attribute. Attributes stored any other way are
+        // patched in afterwards through fastgltf
+        static void cookMesh(fastgltf::Asset& gltf, const SourceBufferAdapter& buffers, fastgltf::Mesh& mesh,
+                             CookedMesh& result) {
+            for (auto&& p : mesh.primitives) {
+                MaterialOperation::GeoSurface new_surface;
+                new_surface.start_index = (uint32_t)result.indices.size();
+                new_surface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+
+                size_t initial_vtx = result.vertices.size();
+                const fastgltf::Accessor& position_accessor =
+                    gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
+                result.indices.resize(result.indices.size() + new_surface.count);
+                result.vertices.resize(result.vertices.size() + position_accessor.count);
+                std::span<Vertex> primitive_vertices(result.vertices.data() + initial_vtx, position_accessor.count);
+                std::span<uint32_t> primitive_indices(result.indices.data() + new_surface.start_index,
+                                                      new_surface.count);
+
+                readIndices(gltf, buffers, gltf.accessors[p.indicesAccessor.value()], primitive_indices);
+
+                const fastgltf::Accessor* normal_accessor = nullptr;
+                const fastgltf::Accessor* uv_accessor = nullptr;
+                const fastgltf::Accessor* color_accessor = nullptr;
+                const fastgltf::Accessor* tangent_accessor = nullptr;
+                if (auto normals = p.findAttribute("NORMAL"); normals != p.attributes.end()) {
+                    normal_accessor = &gltf.accessors[normals->accessorIndex];
+                }
+                if (auto uv = p.findAttribute("TEXCOORD_0"); uv != p.attributes.end()) {
+                    uv_accessor = &gltf.accessors[uv->accessorIndex];
+                }
+                if (auto colors = p.findAttribute("COLOR_0"); colors != p.attributes.end()) {
+                    color_accessor = &gltf.accessors[colors->accessorIndex];
+                }
+                if (auto tangents = p.findAttribute("TANGENT"); tangents != p.attributes.end()) {
+                    tangent_accessor = &gltf.accessors[tangents->accessorIndex];
+                }
+
+                AttributeStream position =
+                    floatStream(gltf, buffers, position_accessor, fastgltf::AccessorType::Vec3);
+                AttributeStream normal =
+                    normal_accessor != nullptr
+                        ? floatStream(gltf, buffers, *normal_accessor, fastgltf::AccessorType::Vec3)
+                        : AttributeStream{};
+                AttributeStream uv = uv_accessor != nullptr
+                                         ? floatStream(gltf, buffers, *uv_accessor, fastgltf::AccessorType::Vec2)
+                                         : AttributeStream{};
+                AttributeStream color =
+                    color_accessor != nullptr
+                        ? floatStream(gltf, buffers, *color_accessor, fastgltf::AccessorType::Vec4)
+                        : AttributeStream{};
+                AttributeStream tangent =
+                    tangent_accessor != nullptr
+                        ? floatStream(gltf, buffers, *tangent_accessor, fastgltf::AccessorType::Vec4)
+                        : AttributeStream{};
+
+                // Missing attributes keep these defaults, the branches don't change inside the loop so they're
+                // hoisted out of it
+                for (size_t v = 0; v < primitive_vertices.size(); v++) {
+                    Vertex& vertex = primitive_vertices[v];
+                    float uv_value[2]{0.0f, 0.0f};
+                    float tangent_value[4]{1.0f, 0.0f, 0.0f, 1.0f};
+                    vertex.position = glm::vec3{0.0f};
+                    vertex.normal = {1, 0, 0};
+                    vertex.color = glm::vec4{1.f};
+                    vertex.padding = 0.0f;
+                    if (position.data != nullptr) {
+                        memcpy(&vertex.position, position.data + v * position.stride, sizeof(glm::vec3));
+                    }
+                    if (normal.data != nullptr) {
+                        memcpy(&vertex.normal, normal.data + v * normal.stride, sizeof(glm::vec3));
                     }
-                    Texture::destroy(device, allocator_handle, v);
+                    if (uv.data != nullptr) {
+                        memcpy(uv_value, uv.data + v * uv.stride, sizeof(uv_value));
+                    }
+                    if (color.data != nullptr) {
+                        memcpy(&vertex.color, color.data + v * color.stride, sizeof(glm::vec4));
+                    }
+                    if (tangent.data != nullptr) {
+                        memcpy(tangent_value, tangent.data + v * tangent.stride, sizeof(tangent_value));
+                    }
+                    vertex.uv_x = uv_value[0];
+                    vertex.uv_y = uv_value[1];
+                    // w is the bitangent sign, nothing reads it yet
+                    vertex.tangent = glm::vec3{tangent_value[0], tangent_value[1], tangent_value[2]};
                 }
 
-                for (auto& sampler : scene->samplers) {
-                    vkDestroySampler(device.logical_handle, sampler, nullptr);
+                // The rare layouts, quantized or sparse, go through fastgltf's conversion
+                if (position.data == nullptr) {
+                    fastgltf::iterateAccessorWithIndex<glm::vec3>(
+                        gltf, position_accessor,
+                        [&](glm::vec3 v, size_t index) { primitive_vertices[index].position = v; }, buffers);
+                }
+                if (normal_accessor != nullptr && normal.data == nullptr) {
+                    fastgltf::iterateAccessorWithIndex<glm::vec3>(
+                        gltf, *normal_accessor,
+                        [&](glm::vec3 v, size_t index) { primitive_vertices[index].normal = v; }, buffers);
+                }
+                if (uv_accessor != nullptr && uv.data == nullptr) {
+                    fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf, *uv_accessor,
+                                                                  [&](glm::vec2 v, size_t index) {
+                                                                      primitive_vertices[index].uv_x = v.x;
+                                                                      primitive_vertices[index].uv_y = v.y;
+                                                                  },
+                                                                  buffers);
+                }
+                if (color_accessor != nullptr && color.data == nullptr) {
+                    fastgltf::iterateAccessorWithIndex<glm::vec4>(
+                        gltf, *color_accessor, [&](glm::vec4 v, size_t index) { primitive_vertices[index].color = v; },
+                        buffers);
+                }
+                if (tangent_accessor != nullptr && tangent.data == nullptr) {
+                    fastgltf::iterateAccessorWithIndex<glm::vec4>(
+                        gltf, *tangent_accessor,
+                        [&](glm::vec4 v, size_t index) { primitive_vertices[index].tangent = glm::vec3(v); }, buffers);
                 }
 
-                // for (auto& v: scene->meshes) {
-                //     Buffer::destroyBuffer(allocator_handle, v->mesh_buffers.index_buffer);
-                //     Buffer::destroyBuffer(allocator_handle, v->mesh_buffers.vertex_buffer);
-                // }
-                // Something a bit fishy here, the above should clear all the meshes since its the same pointer
-                // the below works but at somepoint figureing out why would be nice
+                new_surface.bounds = Culling::computeBounds(std::span<const Vertex>(primitive_vertices));
 
-                for (auto& node : scene->nodes) {
-                    auto mn = static_cast<MaterialOperation::MeshNode*>(node.get());
-                    Buffer::destroyBuffer(allocator_handle, mn->mesh->mesh_buffers.index_buffer);
-                    Buffer::destroyBuffer(allocator_handle, mn->mesh->mesh_buffers.vertex_buffer);
+                // Only this primitive's range, earlier ones are finished. Indices are still relative to it here
+                if (tangent_accessor == nullptr) {
+                    MeshOperations::generateTangents(primitive_indices, primitive_vertices);
+                }
+                for (uint32_t& index : primitive_indices) {
+                    index += static_cast<uint32_t>(initial_vtx);
                 }
 
-                std::cout << "destroying loaded gltf" << std::endl;
-            };
-            scene->setCleanupFunction(cleanup);
+                result.surface_materials.push_back(
+                    p.materialIndex.has_value() ? static_cast<int32_t>(p.materialIndex.value()) : 0);
+                result.surfaces.push_back(new_surface);
+            }
+        }
 
-            fastgltf::GltfDataBuffer data;
-            auto dltfile = data.FromPath(filepath);
-            std::cout << static_cast<uint64_t>(dltfile.error()) << std::endl;
+        // Everything fastgltf is needed for. The result only depends on the source file and the importer, which
+        // is what makes it cacheable
+        static bool cookGLTF(const std::string& filepath, ThreadPool& workers, MeshCache::Data& cooked) {
+            // Mapped rather than read, the json is parsed in place and the buffers are left in the file
+            auto dltfile = fastgltf::MappedGltfFile::FromPath(filepath);
+            if (!dltfile) {
+                std::cerr << "Failed to map glTF: " << fastgltf::to_underlying(dltfile.error()) << std::endl;
+                return false;
+            }
             constexpr auto gltfOptions = fastgltf::Options::DontRequireValidAssetMember |
-                                         fastgltf::Options::AllowDouble | fastgltf::Options::LoadGLBBuffers |
-                                         fastgltf::Options::LoadExternalBuffers;
+                                         fastgltf::Options::AllowDouble;
 
             fastgltf::Asset gltf;
-            fastgltf::Parser parser{};
+            // Basis textures are transcoded at upload, so a file that requires the extension still loads
+            fastgltf::Parser parser{fastgltf::Extensions::KHR_texture_basisu};
 
             std::filesystem::path path = filepath;
 
@@ -224,306 +566,557 @@ namespace Vulkan {
                 return {};
             }
 
-            Descriptors::initPool(file.descriptor_pool, device);
+            SourceBuffers buffers;
+            if (!mapBuffers(gltf, path, buffers, cooked)) {
+                return false;
+            }
+            SourceBufferAdapter adapter{&buffers};
 
             for (fastgltf::Sampler& sampler : gltf.samplers) {
-
-                VkSamplerCreateInfo sampl = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, .pNext = nullptr};
-                sampl.maxLod = VK_LOD_CLAMP_NONE;
-                sampl.minLod = 0;
-
-                sampl.magFilter = VK_FILTER_LINEAR;
-                sampl.minFilter = VK_FILTER_LINEAR;
-
-                sampl.mipmapMode = extractMipmapMode(sampler.minFilter.value_or(fastgltf::Filter::Nearest));
-
-                VkSampler newSampler;
-                vkCreateSampler(device.logical_handle, &sampl, nullptr, &newSampler);
-
-                file.samplers.push_back(newSampler);
+                // Unset filters are up to the implementation in gltf, linear with mips looks best
+                fastgltf::Filter min_filter = sampler.minFilter.value_or(fastgltf::Filter::LinearMipMapLinear);
+                fastgltf::Filter mag_filter = sampler.magFilter.value_or(fastgltf::Filter::Linear);
+                cooked.samplers.push_back({static_cast<uint32_t>(extractFilter(mag_filter)),
+                                           static_cast<uint32_t>(extractFilter(min_filter)),
+                                           static_cast<uint32_t>(extractMipmapMode(min_filter))});
             }
 
             for (fastgltf::Image& image : gltf.images) {
-                std::optional<AllocatedTexture> img = loadImage(device, allocator_handle, pool_handle, gltf, image);
-                std::cout << image.name.c_str() << std::endl;
-                if (img.has_value()) {
-                    file.textures.push_back(img.value());
-                    std::cout << "This should be the proper image " << image.name << std::endl;
-                } else {
-                    file.textures.push_back(default_texture);
-                    std::cout << "gltf failed to load texture " << image.name << std::endl;
+                MeshCache::ImageRecord record{cooked.image_bytes.size(), 0};
+                if (!readEncodedImage(gltf, buffers, image, cooked)) {
+                    std::cout << "gltf failed to read image " << image.name << std::endl;
+                    cooked.image_bytes.resize(record.offset);
                 }
+                record.size = cooked.image_bytes.size() - record.offset;
+                cooked.images.push_back(record);
             }
 
-            file.material_data_buffer = Buffer::allocateBuffer(
-                allocator_handle, sizeof(MaterialOperation::MaterialConstants) * gltf.materials.size(),
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-            size_t data_index = 0;
-            MaterialOperation::MaterialConstants* scene_material_constants =
-                static_cast<MaterialOperation::MaterialConstants*>(file.material_data_buffer.info.pMappedData);
-
             for (fastgltf::Material& mat : gltf.materials) {
-                std::shared_ptr<MaterialOperation::MaterialInstance> new_material =
-                    std::make_shared<MaterialOperation::MaterialInstance>();
-                file.materials.push_back(new_material);
-
-                MaterialOperation::MaterialConstants constants;
-
-                float metallic = mat.pbrData.metallicFactor;
-                float roughness = mat.pbrData.roughnessFactor;
-
-                constants.color_factors =
-                    glm::vec4(mat.pbrData.baseColorFactor[0], mat.pbrData.baseColorFactor[1],
-                                         mat.pbrData.baseColorFactor[2], mat.pbrData.baseColorFactor[3]);  // Avoid full 1.0 values
+                MeshCache::MaterialRecord record{};
+                record.color_factors = glm::vec4(mat.pbrData.baseColorFactor[0], mat.pbrData.baseColorFactor[1],
+                                                 mat.pbrData.baseColorFactor[2], mat.pbrData.baseColorFactor[3]);
+                record.metal_factor = mat.pbrData.metallicFactor;
+                record.rough_factor = mat.pbrData.roughnessFactor;
+                std::cout << mat.name.c_str() << " constants.metal_factors: " << record.metal_factor
+                          << " constants.rough_factors: " << record.rough_factor << std::endl;
+
+                record.pass = static_cast<uint32_t>(MaterialOperation::MaterialPass::MAINCOLOUR);
+                if (mat.alphaMode == fastgltf::AlphaMode::Blend) {
+                    record.pass = static_cast<uint32_t>(MaterialOperation::MaterialPass::TRANSPARENTCOLOUR);
+                    std::cout << "transparent: " << mat.name.c_str() << std::endl;
+                }
 
-                constants.metal_factors = mat.pbrData.metallicFactor;
-                constants.rough_factors = mat.pbrData.roughnessFactor;
-                std::cout << mat.name.c_str() << " constants.metal_factors: " << constants.metal_factors
-                          << " constants.rough_factors: " << constants.rough_factors << std::endl;
-                constants.ao = 1.0f;
+                if (mat.pbrData.baseColorTexture.has_value()) {
+                    record.color = textureRef(gltf, mat.pbrData.baseColorTexture.value().textureIndex);
+                }
+                if (mat.pbrData.metallicRoughnessTexture.has_value()) {
+                    record.metal_rough = textureRef(gltf, mat.pbrData.metallicRoughnessTexture.value().textureIndex);
+                }
+                if (mat.normalTexture.has_value()) {
+                    record.normal = textureRef(gltf, mat.normalTexture.value().textureIndex);
+                }
+                cooked.materials.push_back(record);
+            }
 
-                MaterialOperation::MaterialPass pass_type = MaterialOperation::MaterialPass::MAINCOLOUR;
+            // Meshes are independent until they're appended, so each one is built and optimized on a loader
+            // worker and the results go into the cooked streams in order
+            auto meshes_start = std::chrono::high_resolution_clock::now();
+            std::vector<CookedMesh> meshes(gltf.meshes.size());
+            std::vector<MeshOptimize::MeshStats> mesh_stats(gltf.meshes.size());
+            Jobs::parallelFor(workers, static_cast<uint32_t>(gltf.meshes.size()), [&](uint32_t i) {
+                cookMesh(gltf, adapter, gltf.meshes[i], meshes[i]);
+                // Tangents are done, from here on only the order of triangles and vertices changes
+                mesh_stats[i] = MeshOptimize::optimizeMesh(meshes[i].indices, meshes[i].vertices, meshes[i].surfaces);
+            });
+            std::chrono::duration<double, std::milli> meshes_ms =
+                std::chrono::high_resolution_clock::now() - meshes_start;
+            std::cout << "Cooked " << meshes.size() << " meshes in " << meshes_ms.count() << " ms on "
+                      << Jobs::threadCount(workers) << " threads" << std::endl;
+
+            for (size_t m = 0; m < meshes.size(); m++) {
+                const fastgltf::Mesh& mesh = gltf.meshes[m];
+                const CookedMesh& cooked_mesh = meshes[m];
+                MeshOptimize::logMeshStats(mesh.name, cooked_mesh.indices.size() / 3, mesh_stats[m]);
+
+                MeshCache::MeshRecord record{};
+                record.first_vertex = cooked.vertices.size();
+                record.vertex_count = cooked_mesh.vertices.size();
+                record.first_index = cooked.indices.size();
+                record.index_count = cooked_mesh.indices.size();
+                record.first_surface = static_cast<uint32_t>(cooked.surfaces.size());
+                record.surface_count = static_cast<uint32_t>(cooked_mesh.surfaces.size());
+                record.name_offset = static_cast<uint32_t>(cooked.names.size());
+                record.name_size = static_cast<uint32_t>(mesh.name.size());
+                cooked.names.insert(cooked.names.end(), mesh.name.begin(), mesh.name.end());
+                cooked.meshes.push_back(record);
+
+                for (size_t i = 0; i < cooked_mesh.surfaces.size(); i++) {
+                    const MaterialOperation::GeoSurface& surface = cooked_mesh.surfaces[i];
+                    cooked.surfaces.push_back(
+                        {surface.start_index, surface.count, cooked_mesh.surface_materials[i], surface.bounds});
+                }
+                cooked.vertices.insert(cooked.vertices.end(), cooked_mesh.vertices.begin(), cooked_mesh.vertices.end());
+                cooked.indices.insert(cooked.indices.end(), cooked_mesh.indices.begin(), cooked_mesh.indices.end());
+            }
 
-                if (mat.alphaMode == fastgltf::AlphaMode::Blend) {
-                    pass_type = MaterialOperation::MaterialPass::TRANSPARENTCOLOUR;
-                    std::cout << "transparent: " << mat.name.c_str() << std::endl;
+            for (fastgltf::Node& node : gltf.nodes) {
+                MeshCache::NodeRecord record{};
+                record.mesh = node.meshIndex.has_value() ? static_cast<int32_t>(node.meshIndex.value())
+                                                         : MeshCache::no_index;
+                record.first_child = static_cast<uint32_t>(cooked.children.size());
+                record.child_count = static_cast<uint32_t>(node.children.size());
+                for (auto& c : node.children) {
+                    cooked.children.push_back(static_cast<uint32_t>(c));
                 }
 
-                MaterialOperation::MaterialResources material_resources;
-                material_resources.color_image = default_resources.color_image;
-                material_resources.color_sampler = default_resources.color_sampler;
-                material_resources.metal_rough_image = default_resources.metal_rough_image;
-                material_resources.metal_rough_sampler = default_resources.metal_rough_sampler;
+                std::visit(fastgltf::visitor{[&](fastgltf::math::fmat4x4 matrix) {
+                                                 memcpy(&record.local_transform, &matrix, sizeof(matrix));
+                                             },
+                                             [&](fastgltf::TRS transform) {
+                                                 glm::vec3 tl(transform.translation[0], transform.translation[1],
+                                                              transform.translation[2]);
+                                                 glm::quat rot(transform.rotation[3], transform.rotation[0],
+                                                               transform.rotation[1], transform.rotation[2]);
+                                                 glm::vec3 sc(transform.scale[0], transform.scale[1],
+                                                              transform.scale[2]);
 
-                material_resources.data_buffer = file.material_data_buffer.buffer;
-                material_resources.data_buffer_offset = data_index * sizeof(MaterialOperation::MaterialConstants);
+                                                 glm::mat4 tm = glm::translate(glm::mat4(1.f), tl);
+                                                 glm::mat4 rm = glm::toMat4(rot);
+                                                 glm::mat4 sm = glm::scale(glm::mat4(1.f), sc);
 
-                std::cout << "Base Color Texture Index: " << mat.pbrData.baseColorTexture.value().textureIndex << std::endl;
-                std::cout << "Metallic-Roughness Texture Index: " << mat.pbrData.metallicRoughnessTexture.value().textureIndex << std::endl;
+                                                 record.local_transform = tm * rm * sm;
+                                             }},
+                           node.transform);
+                cooked.nodes.push_back(record);
+            }
+            return true;
+        }
 
-                if (mat.pbrData.baseColorTexture.has_value()) {
-                    size_t img = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex].imageIndex.value();
-                    size_t sampler =
-                        gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex].samplerIndex.value();
-                    std::cout << mat.name.c_str() << " " << img << std::endl;
-                    material_resources.color_image = file.textures[img];
-                    material_resources.color_sampler = file.samplers[sampler];
+        // Cpu side of the images, worked out before anything is recorded so an async load can do it off the main
+        // thread
+        struct PreparedImages {
+            std::vector<TextureCache::TextureKey> keys;
+            std::vector<DecodedImage> decoded;
+            // Streamed images only keep the coarse end of their chain, the rest is decoded again on demand
+            std::vector<TextureStreaming::Levels> resident_levels;
+            std::vector<uint8_t> streamed;
+            // Already resident when the load started, not decoded
+            size_t skipped{0};
+            double decode_ms{0.0};
+        };
+
+        struct PendingLoad {
+            std::string filepath;
+            std::atomic<LoadStage> stage{LoadStage::COOKING};
+            std::atomic<uint32_t> images_decoded{0};
+            std::atomic<uint32_t> image_count{0};
+            std::thread worker;
+            std::chrono::high_resolution_clock::time_point start{};
+            TranscodeTargets targets{};
+            // What the texture cache held when the load started, taken on the main thread so the decode can skip
+            // those images without touching the cache
+            std::unordered_set<TextureCache::TextureKey, TextureCache::TextureKeyHash> resident;
+            // The view points into one of these, the mapping for a warm load and cooked for a cold one
+            MeshCache::Mapping mapping{};
+            MeshCache::Data cooked;
+            std::optional<MeshCache::View> view;
+            bool from_cache{false};
+            PreparedImages images;
+            std::shared_ptr<MaterialOperation::LoadedGLTF> scene;
+
+            // How far recording got, a big scene is recorded over several polls
+            std::vector<uint32_t> stream_ids;
+            size_t next_image{0};
+            size_t next_mesh{0};
+            bool materials_written{false};
+            size_t cache_hits{0};
+            double record_ms{0.0};
+
+            ~PendingLoad() {
+                if (worker.joinable()) {
+                    worker.join();
                 }
+                // Whatever an abandoned load decoded but never recorded
+                for (DecodedImage& decoded : images.decoded) {
+                    releaseImage(decoded);
+                }
+                if (mapping.data != nullptr) {
+                    MeshCache::unmap(mapping);
+                }
+            }
+        };
 
-                if (mat.pbrData.metallicRoughnessTexture.has_value()) {
-                    constants.has_metal_rough_texture = 1;
-                    size_t img =
-                        gltf.textures[mat.pbrData.metallicRoughnessTexture.value().textureIndex].imageIndex.value();
-                        std::cout << "Using metal roughness texture: " << img << std::endl;
-                    size_t sampler =
-                        gltf.textures[mat.pbrData.metallicRoughnessTexture.value().textureIndex].samplerIndex.value();
-
-                    material_resources.metal_rough_image = file.textures[img];
-                    material_resources.metal_rough_sampler = file.samplers[sampler];
-                } else {
-                    constants.has_metal_rough_texture = 0;
+        // Main thread only, the cache itself is never read by the load's thread
+        static void snapshotResident(PendingLoad& load, const TextureCache::Cache& texture_cache) {
+            for (const auto& [key, entry] : texture_cache.textures) {
+                load.resident.insert(key);
+            }
+        }
+
+        // Decoding is the slow part and touches no vulkan, so it fans out over the workers. Images that were
+        // resident when the load started are skipped
+        static void prepareImages(PendingLoad& load, ThreadPool& workers, const TextureStreaming::Streamer* streamer) {
+            auto decode_start = std::chrono::high_resolution_clock::now();
+            const MeshCache::View& cooked = load.view.value();
+            PreparedImages& images = load.images;
+            size_t count = cooked.images.size();
+            images.keys.resize(count);
+            images.decoded.resize(count);
+            images.resident_levels.resize(count);
+            images.streamed.assign(count, 0);
+            load.image_count = static_cast<uint32_t>(count);
+
+            std::vector<uint8_t> skip(count, 0);
+            Jobs::parallelFor(workers, static_cast<uint32_t>(count), [&](uint32_t i) {
+                std::span<const unsigned char> bytes =
+                    cooked.image_bytes.subspan(cooked.images[i].offset, cooked.images[i].size);
+                if (!bytes.empty()) {
+                    images.keys[i] = {MeshCache::hashBytes(bytes), bytes.size(), decodedFormat(bytes, load.targets)};
                 }
+            });
+            for (size_t i = 0; i < count; i++) {
+                skip[i] = load.resident.contains(images.keys[i]) ? 1 : 0;
+                images.skipped += skip[i];
+            }
 
-                if (mat.normalTexture.has_value())
-                {
-                    std::cout << "normal texture found" << std::endl;
-                    size_t texIndex = mat.normalTexture.value().textureIndex;
-                    size_t imgIndex = gltf.textures[texIndex].imageIndex.value();
-                    size_t samplerIndex = gltf.textures[texIndex].samplerIndex.value();
-                
-                    material_resources.normal_image = file.textures[imgIndex];
-                    material_resources.normal_sampler = file.samplers[samplerIndex];
+            Jobs::parallelFor(workers, static_cast<uint32_t>(count), [&](uint32_t i) {
+                const MeshCache::ImageRecord& image = cooked.images[i];
+                if (image.size > 0 && !skip[i]) {
+                    images.decoded[i] =
+                        decodeImage(cooked.image_bytes.subspan(image.offset, image.size), load.targets);
+                    if (streamer != nullptr) {
+                        images.streamed[i] = TextureStreaming::prepareResident(*streamer, images.decoded[i],
+                                                                               images.resident_levels[i]);
+                    }
                 }
+                load.images_decoded++;
+            });
+            std::chrono::duration<double, std::milli> decode_ms =
+                std::chrono::high_resolution_clock::now() - decode_start;
+            images.decode_ms = decode_ms.count();
+        }
 
-                scene_material_constants[data_index] = constants;
-                *new_material = MaterialOperation::writeMaterial(
-                    device, pass_type, material_resources, file.descriptor_pool, material_operations, pipeline_cache);
+        // Everything up to the point vulkan is needed, safe on any thread. Leaves the load in RECORDING, or FAILED
+        static void prepareLoad(PendingLoad& load, ThreadPool& workers, const MeshCache::Settings& cache_settings,
+                                const TextureStreaming::Streamer* streamer) {
+            uint64_t source_hash = MeshCache::hashFile(load.filepath);
+            std::filesystem::path cache_path =
+                MeshCache::cachePath(cache_settings.directory, load.filepath, source_hash);
+            if (cache_settings.read && source_hash != 0) {
+                // Warm, fastgltf never sees the file
+                load.view = MeshCache::open(cache_path, source_hash, load.mapping);
+            }
+            load.from_cache = load.view.has_value();
 
-                data_index++;
+            if (!load.from_cache) {
+                if (!cookGLTF(load.filepath, workers, load.cooked)) {
+                    load.stage = LoadStage::FAILED;
+                    return;
+                }
+                if (cache_settings.write && source_hash != 0) {
+                    MeshCache::write(cache_path, source_hash, load.cooked);
+                }
+                load.view = MeshCache::view(load.cooked);
             }
 
-            std::vector<uint32_t> indices;
-            std::vector<Vertex> vertices;
+            load.stage = LoadStage::DECODING;
+            prepareImages(load, workers, streamer);
+            load.stage = LoadStage::RECORDING;
+        }
 
-            for (fastgltf::Mesh& mesh : gltf.meshes) {
-                std::shared_ptr<MaterialOperation::MeshAsset> newmesh =
-                    std::make_shared<MaterialOperation::MeshAsset>();
-                file.meshes.push_back(newmesh);
-                newmesh->name = mesh.name;
+        // The scene with its cleanup, descriptor pool and samplers, nothing staged yet
+        static void beginScene(PendingLoad& load, Device& device, VmaAllocator& allocator_handle,
+                               Geometry::Buffers& geometry, AllocatedTexture& default_texture,
+                               TextureCache::Cache& texture_cache, TextureStreaming::Streamer* streamer) {
+            const MeshCache::View& cooked = load.view.value();
+            load.scene = std::make_shared<MaterialOperation::LoadedGLTF>();
+            std::shared_ptr<MaterialOperation::LoadedGLTF> scene = load.scene;
+            MaterialOperation::LoadedGLTF& file = *scene.get();
 
-                indices.clear();
-                vertices.clear();
+            // Only releases what was recorded, an abandoned load can stop partway through
+            auto cleanup = [&device, &allocator_handle, &geometry, &texture_cache, scene, default_texture,
+                            streamer]() {
+                if (streamer != nullptr) {
+                    TextureStreaming::release(*streamer, {}, scene->stream_slots);
+                }
+                Descriptors::destroyPools(scene->descriptor_pool, device);
+                Buffer::destroyBuffer(allocator_handle, scene->material_data_buffer);
 
-                for (auto&& p : mesh.primitives) {
-                    MaterialOperation::GeoSurface new_surface;
-                    new_surface.start_index = (uint32_t)indices.size();
-                    new_surface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+                // Textures and samplers are shared through the cache, the last scene holding one destroys it
+                for (auto& v : scene->textures) {
 
-                    size_t initial_vtx = vertices.size();
+                    if (v.image == default_texture.image) {
+                        continue;
+                    }
+                    TextureCache::releaseTexture(device, allocator_handle, texture_cache, v.image);
+                }
 
-                    // load indexes
-                    {
-                        fastgltf::Accessor& indexaccessor = gltf.accessors[p.indicesAccessor.value()];
-                        indices.reserve(indices.size() + indexaccessor.count);
+                for (auto& sampler : scene->samplers) {
+                    TextureCache::releaseSampler(device, texture_cache, sampler);
+                }
 
-                        fastgltf::iterateAccessor<std::uint32_t>(
-                            gltf, indexaccessor, [&](std::uint32_t idx) { indices.push_back(idx + initial_vtx); });
-                    }
+                // Walking the meshes rather than the nodes, nodes share meshes and a range handed back twice
+                // would corrupt the free list
+                for (auto& mesh : scene->meshes) {
+                    MeshOperations::destroyMesh(geometry, mesh->mesh_buffers);
+                }
 
-                    // load vertex positions
-                    {
-                        fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
-                        vertices.resize(vertices.size() + posAccessor.count);
+                std::cout << "destroying loaded gltf" << std::endl;
+            };
+            scene->setCleanupFunction(cleanup);
 
-                        fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
-                                                                      [&](glm::vec3 v, size_t index) {
-                                                                          Vertex newvtx;
-                                                                          newvtx.position = v;
-                                                                          newvtx.normal = {1, 0, 0};
-                                                                          newvtx.color = glm::vec4{1.f};
-                                                                          newvtx.uv_x = 0;
-                                                                          newvtx.uv_y = 0;
-                                                                          vertices[initial_vtx + index] = newvtx;
-                                                                      });
-                    }
+            Descriptors::initPool(file.descriptor_pool, device);
 
-                    // load vertex normals
-                    auto normals = p.findAttribute("NORMAL");
-                    if (normals != p.attributes.end()) {
+            for (const MeshCache::SamplerRecord& sampler : cooked.samplers) {
 
-                        fastgltf::iterateAccessorWithIndex<glm::vec3>(
-                            gltf, gltf.accessors[(*normals).accessorIndex],
-                            [&](glm::vec3 v, size_t index) { vertices[initial_vtx + index].normal = v; });
-                    }
+                VkSamplerCreateInfo sampl = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, .pNext = nullptr};
+                sampl.maxLod = VK_LOD_CLAMP_NONE;
+                sampl.minLod = 0;
 
-                    // load UVs
-                    auto uv = p.findAttribute("TEXCOORD_0");
-                    if (uv != p.attributes.end()) {
+                sampl.magFilter = static_cast<VkFilter>(sampler.mag_filter);
+                sampl.minFilter = static_cast<VkFilter>(sampler.min_filter);
+                sampl.mipmapMode = static_cast<VkSamplerMipmapMode>(sampler.mipmap_mode);
 
-                        fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf, gltf.accessors[(*uv).accessorIndex],
-                                                                      [&](glm::vec2 v, size_t index) {
-                                                                          vertices[initial_vtx + index].uv_x = v.x;
-                                                                          vertices[initial_vtx + index].uv_y = v.y;
-                                                                      });
-                    }
+                // Textures carry their full chain now, anisotropy keeps the mips sharp at grazing angles
+                if (device.sampler_anisotropy) {
+                    sampl.anisotropyEnable = VK_TRUE;
+                    sampl.maxAnisotropy = std::min(max_sampler_anisotropy,
+                                                   device.properties.limits.maxSamplerAnisotropy);
+                }
 
-                    // load vertex colors
-                    auto colors = p.findAttribute("COLOR_0");
-                    if (colors != p.attributes.end()) {
+                file.samplers.push_back(TextureCache::acquireSampler(device, texture_cache, sampl));
+            }
 
-                        fastgltf::iterateAccessorWithIndex<glm::vec4>(
-                            gltf, gltf.accessors[(*colors).accessorIndex],
-                            [&](glm::vec4 v, size_t index) { vertices[initial_vtx + index].color = v; });
-                    }
+            // What the textures take on the gpu against the same textures as RGBA8 with full chains, worked out
+            // before any of the decoded images is released
+            const std::vector<DecodedImage>& decoded_images = load.images.decoded;
+            size_t compressed_count = 0;
+            size_t texture_bytes = 0;
+            size_t rgba_bytes = 0;
+            size_t streamed_count = 0;
+            size_t resident_bytes = 0;
+            for (size_t i = 0; i < decoded_images.size(); i++) {
+                const DecodedImage& decoded = decoded_images[i];
+                size_t full_size = static_cast<size_t>(decoded.width) * static_cast<size_t>(decoded.height) * 4;
+                rgba_bytes += full_size * 4 / 3;
+                if (load.images.streamed[i]) {
+                    const TextureStreaming::Levels& levels = load.images.resident_levels[i];
+                    size_t coarse_size = levels.level_offsets.size() > 1 ? levels.level_offsets[1] : levels.data.size();
+                    streamed_count++;
+                    compressed_count += levels.format != VK_FORMAT_R8G8B8A8_UNORM ? 1 : 0;
+                    texture_bytes += (coarse_size << (2 * levels.first_level)) * 4 / 3;
+                    resident_bytes += levels.data.size();
+                } else if (decoded.ktx != nullptr) {
+                    compressed_count += decoded.format != VK_FORMAT_R8G8B8A8_UNORM ? 1 : 0;
+                    texture_bytes += ktxTexture_GetDataSize(ktxTexture(decoded.ktx));
+                } else {
+                    texture_bytes += full_size * 4 / 3;
+                }
+            }
+            std::cout << "images: " << compressed_count << " block compressed, " << texture_bytes / (1024 * 1024)
+                      << " MB on the gpu against " << rgba_bytes / (1024 * 1024) << " MB as RGBA8" << std::endl;
+            if (streamer != nullptr) {
+                std::cout << "images: " << streamed_count << " streamed, " << resident_bytes / (1024 * 1024)
+                          << " MB of coarse levels uploaded with the scene" << std::endl;
+            }
 
-                    std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+            load.stream_ids.assign(cooked.images.size(), TextureStreaming::no_texture);
+        }
 
-                    for (size_t i = 0; i < indices.size(); i += 3) {
-                        uint32_t i0 = indices[i];
-                        uint32_t i1 = indices[i + 1];
-                        uint32_t i2 = indices[i + 2];
+        // Anything another scene or an earlier image of this file put in the cache is shared, whatever was
+        // decoded for it is thrown away. Returns the bytes staged
+        static VkDeviceSize recordImage(PendingLoad& load, size_t i, Device& device, VmaAllocator& allocator_handle,
+                                        Upload::Context& uploader, AllocatedTexture& default_texture,
+                                        TextureCache::Cache& texture_cache, TextureStreaming::Streamer* streamer) {
+            const MeshCache::View& cooked = load.view.value();
+            const MeshCache::ImageRecord& image = cooked.images[i];
+            std::span<const unsigned char> bytes = cooked.image_bytes.subspan(image.offset, image.size);
+            const TextureCache::TextureKey& key = load.images.keys[i];
+            DecodedImage& decoded = load.images.decoded[i];
+            TextureStreaming::Levels& resident_levels = load.images.resident_levels[i];
+            MaterialOperation::LoadedGLTF& file = *load.scene;
+
+            std::optional<TextureCache::TextureEntry> cached;
+            if (key.content_hash != 0) {
+                cached = TextureCache::acquireTexture(texture_cache, key);
+            }
+            // Resident when the load started and released by another scene since, decoded here after all
+            if (!cached.has_value() && !bytes.empty() && load.resident.contains(key)) {
+                decoded = decodeImage(bytes, load.targets);
+                if (streamer != nullptr) {
+                    load.images.streamed[i] = TextureStreaming::prepareResident(*streamer, decoded, resident_levels);
+                }
+            }
+
+            std::optional<AllocatedTexture> img;
+            VkDeviceSize staged = 0;
+            if (cached.has_value()) {
+                releaseImage(decoded);
+                load.cache_hits++;
+                img = cached->texture;
+                load.stream_ids[i] = cached->stream_id;
+            } else if (load.images.streamed[i]) {
+                AllocatedTexture texture{};
+                staged = resident_levels.data.size();
+                load.stream_ids[i] = TextureStreaming::addTexture(device, allocator_handle, uploader, *streamer,
+                                                                  resident_levels, bytes, texture);
+                if (load.stream_ids[i] != TextureStreaming::no_texture) {
+                    img = texture;
+                }
+                resident_levels = {};
+            } else {
+                staged = decoded.ktx != nullptr ? ktxTexture_GetDataSize(ktxTexture(decoded.ktx))
+                                                : VkDeviceSize(decoded.width) * VkDeviceSize(decoded.height) * 4;
+                img = uploadImage(device, allocator_handle, uploader, decoded);
+            }
+            if (img.has_value() && !cached.has_value() && key.content_hash != 0) {
+                TextureCache::addTexture(texture_cache, key, img.value(), load.stream_ids[i]);
+            }
+            if (img.has_value()) {
+                file.textures.push_back(img.value());
+            } else {
+                file.textures.push_back(default_texture);
+                std::cout << "gltf failed to load texture " << i << std::endl;
+            }
+            return staged;
+        }
 
-                        glm::vec3 v0 = vertices[i0].position;
-                        glm::vec3 v1 = vertices[i1].position;
-                        glm::vec3 v2 = vertices[i2].position;
+        // Every texture is recorded by now, the descriptors point at them
+        static void writeMaterials(PendingLoad& load, Device& device, VmaAllocator& allocator_handle,
+                                   MaterialOperation::MaterialResources& default_resources,
+                                   MaterialOperation::GLTFOperations& material_operations,
+                                   Pipeline::Cache& pipeline_cache, TextureStreaming::Streamer* streamer) {
+            const MeshCache::View& cooked = load.view.value();
+            MaterialOperation::LoadedGLTF& file = *load.scene;
+            file.material_data_buffer = Buffer::allocateBuffer(
+                allocator_handle, sizeof(MaterialOperation::MaterialConstants) * cooked.materials.size(),
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
 
-                        glm::vec2 uv0 = glm::vec2(vertices[i0].uv_x, vertices[i0].uv_y);
-                        glm::vec2 uv1 = glm::vec2(vertices[i1].uv_x, vertices[i1].uv_y);
-                        glm::vec2 uv2 = glm::vec2(vertices[i2].uv_x, vertices[i2].uv_y);
+            size_t data_index = 0;
+            MaterialOperation::MaterialConstants* scene_material_constants =
+                static_cast<MaterialOperation::MaterialConstants*>(file.material_data_buffer.info.pMappedData);
 
-                        glm::vec3 deltaPos1 = v1 - v0;
-                        glm::vec3 deltaPos2 = v2 - v0;
-                        glm::vec2 deltaUV1 = uv1 - uv0;
-                        glm::vec2 deltaUV2 = uv2 - uv0;
+            for (const MeshCache::MaterialRecord& mat : cooked.materials) {
+                std::shared_ptr<MaterialOperation::MaterialInstance> new_material =
+                    std::make_shared<MaterialOperation::MaterialInstance>();
+                file.materials.push_back(new_material);
 
-                        float r = (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-                        if (fabs(r) < 1e-6) r = 1.0f; // Avoid division by zero
+                MaterialOperation::MaterialConstants constants;
+                constants.color_factors = mat.color_factors;
+                constants.metal_factors = mat.metal_factor;
+                constants.rough_factors = mat.rough_factor;
+                constants.ao = 1.0f;
 
-                        float invDet = 1.0f / r;
-                        glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * invDet;
+                MaterialOperation::MaterialPass pass_type = static_cast<MaterialOperation::MaterialPass>(mat.pass);
 
-                        // Accumulate for averaging
-                        tangents[i0] += tangent;
-                        tangents[i1] += tangent;
-                        tangents[i2] += tangent;
-                    }
+                MaterialOperation::MaterialResources material_resources;
+                material_resources.color_image = default_resources.color_image;
+                material_resources.color_sampler = default_resources.color_sampler;
+                material_resources.metal_rough_image = default_resources.metal_rough_image;
+                material_resources.metal_rough_sampler = default_resources.metal_rough_sampler;
 
-                    // Normalize and Orthogonalize Tangents
-                    for (size_t i = 0; i < vertices.size(); i++) {
-                        glm::vec3 N = glm::normalize(vertices[i].normal);
-                        glm::vec3 T = glm::normalize(tangents[i]);
+                material_resources.data_buffer = file.material_data_buffer.buffer;
+                material_resources.data_buffer_offset = data_index * sizeof(MaterialOperation::MaterialConstants);
 
-                        // Gram-Schmidt orthogonalization
-                        T = glm::normalize(T - N * glm::dot(N, T));
+                // A texture without a sampler keeps the default one
+                auto sampler_for = [&](const MeshCache::TextureRef& ref, VkSampler fallback) {
+                    return ref.sampler != MeshCache::no_index ? file.samplers[ref.sampler] : fallback;
+                };
 
-                        vertices[i].tangent = T;
+                if (mat.color.image != MeshCache::no_index) {
+                    material_resources.color_image = file.textures[mat.color.image];
+                    material_resources.color_sampler = sampler_for(mat.color, default_resources.color_sampler);
+                }
 
-                        if (i % 500 == 0) { // Print every 500th vertex
-                            std::cout << "Vertex " << i << " Tangent: " << T.x << ", " << T.y << ", " << T.z << std::endl;
-                        }
-                    }
+                if (mat.metal_rough.image != MeshCache::no_index) {
+                    constants.has_metal_rough_texture = 1;
+                    material_resources.metal_rough_image = file.textures[mat.metal_rough.image];
+                    material_resources.metal_rough_sampler =
+                        sampler_for(mat.metal_rough, default_resources.metal_rough_sampler);
+                } else {
+                    constants.has_metal_rough_texture = 0;
+                }
 
-                    
+                if (mat.normal.image != MeshCache::no_index) {
+                    material_resources.normal_image = file.textures[mat.normal.image];
+                    material_resources.normal_sampler = sampler_for(mat.normal, default_resources.color_sampler);
+                }
 
-                    if (p.materialIndex.has_value()) {
-                        new_surface.material = file.materials[p.materialIndex.value()];
-                    } else {
-                        new_surface.material = file.materials[0];
-                    }
+                scene_material_constants[data_index] = constants;
+                *new_material = MaterialOperation::writeMaterial(
+                    device, pass_type, material_resources, file.descriptor_pool, material_operations, pipeline_cache);
 
-                    newmesh->surfaces.push_back(new_surface);
+                // The clamps live in the constants just written, the streamer moves them from here on
+                auto stream_id = [&](const MeshCache::TextureRef& ref) {
+                    return ref.image != MeshCache::no_index ? load.stream_ids[ref.image]
+                                                            : TextureStreaming::no_texture;
+                };
+                const uint32_t stream_textures[3] = {stream_id(mat.color), stream_id(mat.metal_rough),
+                                                     stream_id(mat.normal)};
+                if (streamer != nullptr &&
+                    std::any_of(std::begin(stream_textures), std::end(stream_textures),
+                                [](uint32_t id) { return id != TextureStreaming::no_texture; })) {
+                    new_material->stream_slot = TextureStreaming::addMaterial(
+                        *streamer, &scene_material_constants[data_index], stream_textures);
+                    file.stream_slots.push_back(new_material->stream_slot);
                 }
 
-                newmesh->mesh_buffers =
-                    MeshOperations::uploadMeshData(device, allocator_handle, pool_handle, indices, vertices);
+                data_index++;
             }
+        }
 
-            for (fastgltf::Node& node : gltf.nodes) {
+        // Vertex and index streams are copied straight from the view into staging. Returns the bytes staged
+        static VkDeviceSize recordMesh(PendingLoad& load, size_t i, Device& device, VmaAllocator& allocator_handle,
+                                       Upload::Context& uploader, Geometry::Buffers& geometry) {
+            const MeshCache::View& cooked = load.view.value();
+            const MeshCache::MeshRecord& mesh = cooked.meshes[i];
+            MaterialOperation::LoadedGLTF& file = *load.scene;
+            std::shared_ptr<MaterialOperation::MeshAsset> newmesh = std::make_shared<MaterialOperation::MeshAsset>();
+            file.meshes.push_back(newmesh);
+            newmesh->name.assign(cooked.names.data() + mesh.name_offset, mesh.name_size);
+
+            for (uint32_t s = 0; s < mesh.surface_count; s++) {
+                const MeshCache::SurfaceRecord& surface = cooked.surfaces[mesh.first_surface + s];
+                MaterialOperation::GeoSurface new_surface;
+                new_surface.start_index = surface.start_index;
+                new_surface.count = surface.count;
+                new_surface.bounds = surface.bounds;
+                new_surface.material = file.materials[surface.material];
+                newmesh->surfaces.push_back(new_surface);
+            }
+
+            std::span<const uint32_t> indices = cooked.indices.subspan(mesh.first_index, mesh.index_count);
+            std::span<const MaterialOperation::Vertex> vertices =
+                cooked.vertices.subspan(mesh.first_vertex, mesh.vertex_count);
+            newmesh->mesh_buffers =
+                MeshOperations::uploadMeshData(device, allocator_handle, uploader, geometry, indices, vertices);
+            return indices.size_bytes() + vertices.size_bytes();
+        }
+
+        static void linkNodes(PendingLoad& load) {
+            const MeshCache::View& cooked = load.view.value();
+            MaterialOperation::LoadedGLTF& file = *load.scene;
+            for (const MeshCache::NodeRecord& node : cooked.nodes) {
                 std::shared_ptr<MaterialOperation::Node> new_node;
 
-                if (node.meshIndex.has_value()) {
+                if (node.mesh != MeshCache::no_index) {
                     new_node = std::make_shared<MaterialOperation::MeshNode>();
-                    static_cast<MaterialOperation::MeshNode*>(new_node.get())->mesh = file.meshes[node.meshIndex.value()];
+                    static_cast<MaterialOperation::MeshNode*>(new_node.get())->mesh = file.meshes[node.mesh];
                 } else {
                     new_node = std::make_shared<MaterialOperation::Node>();
                 }
+                new_node->localTransform = node.local_transform;
 
                 file.nodes.push_back(new_node);
-
-                std::visit(fastgltf::visitor{[&](fastgltf::math::fmat4x4 matrix) {
-                                                 memcpy(&new_node->localTransform, &matrix, sizeof(matrix));
-                                             },
-                                             [&](fastgltf::TRS transform) {
-                                                 glm::vec3 tl(transform.translation[0], transform.translation[1],
-                                                              transform.translation[2]);
-                                                 glm::quat rot(transform.rotation[3], transform.rotation[0],
-                                                               transform.rotation[1], transform.rotation[2]);
-                                                 glm::vec3 sc(transform.scale[0], transform.scale[1],
-                                                              transform.scale[2]);
-
-                                                 glm::mat4 tm = glm::translate(glm::mat4(1.f), tl);
-                                                 glm::mat4 rm = glm::toMat4(rot);
-                                                 glm::mat4 sm = glm::scale(glm::mat4(1.f), sc);
-
-                                                 new_node->localTransform = tm * rm * sm;
-                                             }},
-                           node.transform);
             }
 
-            // AllocatedTexture irradianceMap = loadKTXTexture(device, pool_handle, "C:/Users/bgarner/Documents/repos/Corax/assets/_ibl.ktx");
-            // AllocatedTexture prefilteredEnvMap = loadKTXTexture(device, pool_handle, "C:/Users/bgarner/Documents/repos/Corax/assets/_skybox.ktx");
-            // AllocatedTexture brdfLUT = loadKTXTexture(device, pool_handle, "brdfLUT.ktx");
-            // std::optional<AllocatedTexture> img = loadImage(device, allocator_handle, pool_handle, gltf, image);
-
-            for (int i = 0; i < gltf.nodes.size(); i++) {
-                fastgltf::Node& node = gltf.nodes[i];
+            for (size_t i = 0; i < cooked.nodes.size(); i++) {
+                const MeshCache::NodeRecord& node = cooked.nodes[i];
                 std::shared_ptr<MaterialOperation::Node>& sceneNode = file.nodes[i];
-                std::cout << "parent: " << i << " child: " << node.children.size() << std::endl;
-                for (auto& c : node.children) {
-                    
-                    sceneNode->children.push_back(file.nodes[c]);
-                    file.nodes[c]->parent = sceneNode;
+                for (uint32_t c = 0; c < node.child_count; c++) {
+                    uint32_t child = cooked.children[node.first_child + c];
+                    sceneNode->children.push_back(file.nodes[child]);
+                    file.nodes[child]->parent = sceneNode;
                 }
             }
 
@@ -534,7 +1127,156 @@ namespace Vulkan {
                     node->refreshTransform(glm::mat4{1.f});
                 }
             }
-            return scene;
+        }
+
+        // Main thread half of a load. Records images and meshes until budget bytes are staged and returns false
+        // to be called again, true once the whole scene is recorded and submitted
+        static bool finishLoad(PendingLoad& load, Device& device, VmaAllocator& allocator_handle,
+                               Upload::Context& uploader, Geometry::Buffers& geometry,
+                               AllocatedTexture& default_texture,
+                               MaterialOperation::MaterialResources& default_resources,
+                               MaterialOperation::GLTFOperations& material_operations,
+                               Pipeline::Cache& pipeline_cache, TextureCache::Cache& texture_cache,
+                               TextureStreaming::Streamer* streamer, VkDeviceSize budget) {
+            const MeshCache::View& cooked = load.view.value();
+            if (load.scene == nullptr) {
+                beginScene(load, device, allocator_handle, geometry, default_texture, texture_cache, streamer);
+            }
+
+            VkDeviceSize staged = 0;
+            if (load.next_image < cooked.images.size()) {
+                // The decoding already happened off this thread, what's left only records copies into the batch
+                auto record_start = std::chrono::high_resolution_clock::now();
+                while (load.next_image < cooked.images.size() && staged < budget) {
+                    staged += recordImage(load, load.next_image++, device, allocator_handle, uploader,
+                                          default_texture, texture_cache, streamer);
+                }
+                std::chrono::duration<double, std::milli> record_ms =
+                    std::chrono::high_resolution_clock::now() - record_start;
+                load.record_ms += record_ms.count();
+                if (load.next_image < cooked.images.size()) {
+                    return false;
+                }
+            }
+
+            if (!load.materials_written) {
+                std::cout << "images: " << cooked.images.size() - load.images.skipped << " decoded in "
+                          << load.images.decode_ms << " ms, upload recorded in " << load.record_ms << " ms, "
+                          << load.cache_hits << " already resident" << std::endl;
+                writeMaterials(load, device, allocator_handle, default_resources, material_operations,
+                               pipeline_cache, streamer);
+                load.materials_written = true;
+            }
+
+            while (load.next_mesh < cooked.meshes.size() && staged < budget) {
+                staged += recordMesh(load, load.next_mesh++, device, allocator_handle, uploader, geometry);
+            }
+            if (load.next_mesh < cooked.meshes.size()) {
+                return false;
+            }
+
+            linkNodes(load);
+            // Whatever the earlier polls recorded may have gone out with other submits already, this one covers
+            // the rest and its value is only reached once those are done too
+            load.scene->upload_ready = Upload::submit(device, uploader);
+
+            load.view.reset();
+            load.images = {};
+            load.cooked = {};
+            if (load.mapping.data != nullptr) {
+                MeshCache::unmap(load.mapping);
+            }
+
+            std::chrono::duration<double, std::milli> load_ms = std::chrono::high_resolution_clock::now() - load.start;
+            std::cout << "Loaded " << load.filepath << " in " << load_ms.count() << " ms ("
+                      << (load.from_cache ? "mesh cache" : "imported") << ")" << std::endl;
+            Geometry::logUsage(geometry);
+            return true;
+        }
+
+        std::optional<std::shared_ptr<MaterialOperation::LoadedGLTF>> loadGLTF(
+            Device& device, const std::string& filepath, VmaAllocator& allocator_handle, Upload::Context& uploader,
+            Geometry::Buffers& geometry, ThreadPool& workers, const MeshCache::Settings& cache_settings,
+            AllocatedTexture& default_texture, MaterialOperation::MaterialResources& default_resources,
+            MaterialOperation::GLTFOperations& material_operations, Pipeline::Cache& pipeline_cache,
+            TextureCache::Cache& texture_cache, TextureStreaming::Streamer* streamer) {
+            std::cout << "Loading GLTF: " << filepath << std::endl;
+            PendingLoad load;
+            load.filepath = filepath;
+            load.start = std::chrono::high_resolution_clock::now();
+            load.targets = queryTranscodeTargets(device);
+            snapshotResident(load, texture_cache);
+
+            prepareLoad(load, workers, cache_settings, streamer);
+            if (load.stage == LoadStage::FAILED) {
+                return {};
+            }
+            // Nothing else runs while a blocking load records, it goes in one go
+            finishLoad(load, device, allocator_handle, uploader, geometry, default_texture, default_resources,
+                       material_operations, pipeline_cache, texture_cache, streamer,
+                       std::numeric_limits<VkDeviceSize>::max());
+            return load.scene;
+        }
+
+        LoadHandle beginLoad(const Device& device, const std::string& filepath, ThreadPool& workers,
+                             const MeshCache::Settings& cache_settings, const TextureCache::Cache& texture_cache,
+                             const TextureStreaming::Streamer* streamer) {
+            std::cout << "Loading GLTF in the background: " << filepath << std::endl;
+            LoadHandle load = std::make_shared<PendingLoad>();
+            load->filepath = filepath;
+            load->start = std::chrono::high_resolution_clock::now();
+            load->targets = queryTranscodeTargets(device);
+            snapshotResident(*load, texture_cache);
+
+            // A thread of its own rather than a pool job, the cook and decode fan out over the pool and a job
+            // waiting on its own pool could starve it
+            load->worker = std::thread([load = load.get(), &workers, cache_settings, streamer]() {
+                try {
+                    prepareLoad(*load, workers, cache_settings, streamer);
+                } catch (const std::exception& e) {
+                    std::cerr << "failed to load " << load->filepath << ": " << e.what() << std::endl;
+                    load->stage = LoadStage::FAILED;
+                }
+            });
+            return load;
+        }
+
+        LoadProgress loadProgress(const LoadHandle& load) {
+            return {load->stage.load(), load->images_decoded.load(), load->image_count.load()};
+        }
+
+        std::shared_ptr<MaterialOperation::LoadedGLTF> pollLoad(
+            const LoadHandle& load, Device& device, VmaAllocator& allocator_handle, Upload::Context& uploader,
+            Geometry::Buffers& geometry, AllocatedTexture& default_texture,
+            MaterialOperation::MaterialResources& default_resources,
+            MaterialOperation::GLTFOperations& material_operations, Pipeline::Cache& pipeline_cache,
+            TextureCache::Cache& texture_cache, TextureStreaming::Streamer* streamer) {
+            if (load->stage == LoadStage::RECORDING) {
+                if (load->worker.joinable()) {
+                    load->worker.join();
+                }
+                if (finishLoad(*load, device, allocator_handle, uploader, geometry, default_texture,
+                               default_resources, material_operations, pipeline_cache, texture_cache, streamer,
+                               max_record_bytes_per_poll)) {
+                    load->stage = LoadStage::UPLOADING;
+                }
+            }
+            // Handed over only once the gpu has everything, until then the scene isn't drawn
+            if (load->stage == LoadStage::UPLOADING &&
+                Upload::isComplete(device, uploader, load->scene->upload_ready)) {
+                load->stage = LoadStage::READY;
+                std::chrono::duration<double, std::milli> ready_ms =
+                    std::chrono::high_resolution_clock::now() - load->start;
+                std::cout << load->filepath << " ready to draw after " << ready_ms.count() << " ms" << std::endl;
+            }
+            return load->stage == LoadStage::READY ? load->scene : nullptr;
+        }
+
+        std::shared_ptr<MaterialOperation::LoadedGLTF> abandonLoad(const LoadHandle& load) {
+            if (load->worker.joinable()) {
+                load->worker.join();
+            }
+            return load->scene;
         }
 
         VkFilter extractFilter(fastgltf::Filter filter) {
@@ -567,7 +1309,7 @@ namespace Vulkan {
             }
         }
 
-        AllocatedTexture loadBRDFLUT(const Device& device, VmaAllocator allocator_handle, VkCommandPool& pool_handle, const std::string& filename) {
+        AllocatedTexture loadBRDFLUT(const Device& device, VmaAllocator allocator_handle, Upload::Context& uploader, const std::string& filename) {
             std::cout << "fastgltf::sources::URI& filePath" << std::endl;
             const std::string path(filename.c_str());
             int width, height, nrChannels;
@@ -579,7 +1321,7 @@ namespace Vulkan {
                 imagesize.height = height;
                 imagesize.depth = 1;
 
-                new_image = Texture::upload(device, allocator_handle, pool_handle, data, imagesize,
+                new_image = Texture::upload(device, allocator_handle, uploader, data, imagesize,
                                             VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
                 stbi_image_free(data);
@@ -614,131 +1356,263 @@ namespace Vulkan {
             return sampler;
         }
 
-        AllocatedTexture loadKTXTexture(const Device& device, VkCommandPool& pool_handle, const std::string& filename) {
-            // Load KTX texture
-            ktxTexture* ktxTex;
-            KTX_error_code result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTex);
+        AllocatedTexture loadKTXTexture(const Device& device, VmaAllocator allocator_handle, Upload::Context& uploader,
+                                        const std::string& filename) {
+            std::ifstream file(filename, std::ios::binary | std::ios::ate);
+            if (!file) {
+                throw std::runtime_error("Failed to open KTX texture: " + filename);
+            }
+            std::vector<unsigned char> bytes(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
 
-            if (result != KTX_SUCCESS) {
+            DecodedImage decoded = decodeImage(bytes, queryTranscodeTargets(device));
+            std::optional<AllocatedTexture> texture = uploadImage(device, allocator_handle, uploader, decoded);
+            if (!texture.has_value()) {
                 throw std::runtime_error("Failed to load KTX texture: " + filename);
             }
+            return texture.value();
+        }
+
+        TranscodeTargets queryTranscodeTargets(const Device& device) {
+            auto sampled = [&](VkFormat format) {
+                VkFormatProperties properties{};
+                vkGetPhysicalDeviceFormatProperties(device.physical_handle, format, &properties);
+                return device.texture_compression_bc &&
+                       (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+            };
+            return {sampled(VK_FORMAT_BC7_UNORM_BLOCK), sampled(VK_FORMAT_BC3_UNORM_BLOCK),
+                    sampled(VK_FORMAT_BC1_RGB_UNORM_BLOCK)};
+        }
 
-            // Create KTX Vulkan device info
-            ktxVulkanDeviceInfo vdi;
-            ktxVulkanDeviceInfo_Construct(&vdi, device.physical_handle, device.logical_handle, device.graphics_queue, pool_handle, nullptr);
+        static bool isKTX2(std::span<const unsigned char> bytes) {
+            static constexpr unsigned char magic[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+            return bytes.size() >= sizeof(magic) && std::memcmp(bytes.data(), magic, sizeof(magic)) == 0;
+        }
 
-            // Prepare Vulkan texture structure
-            ktxVulkanTexture vkTex;
-            result = ktxTexture_VkUpload(ktxTex, &vdi, &vkTex);
+        static ktx_transcode_fmt_e transcodeTarget(const TranscodeTargets& targets, uint32_t components) {
+            if (targets.bc7) {
+                return KTX_TTF_BC7_RGBA;
+            }
+            if (components <= 3 && targets.bc1) {
+                return KTX_TTF_BC1_RGB;
+            }
+            if (targets.bc3) {
+                return KTX_TTF_BC3_RGBA;
+            }
+            // No block format to go to, still smaller on disk than a png
+            return KTX_TTF_RGBA32;
+        }
 
+        // stb images go up as UNORM and the shaders are written for that, so srgb formats get their UNORM twin
+        static VkFormat unormFormat(VkFormat format) {
+            switch (format) {
+                case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                    return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+                case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                    return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+                case VK_FORMAT_BC2_SRGB_BLOCK:
+                    return VK_FORMAT_BC2_UNORM_BLOCK;
+                case VK_FORMAT_BC3_SRGB_BLOCK:
+                    return VK_FORMAT_BC3_UNORM_BLOCK;
+                case VK_FORMAT_BC7_SRGB_BLOCK:
+                    return VK_FORMAT_BC7_UNORM_BLOCK;
+                case VK_FORMAT_R8G8B8A8_SRGB:
+                    return VK_FORMAT_R8G8B8A8_UNORM;
+                default:
+                    return format;
+            }
+        }
+
+        // Runs on the loader workers like the stb path, transcoding is the expensive part of a ktx2 load
+        static DecodedImage decodeKTX2(std::span<const unsigned char> bytes, const TranscodeTargets& targets) {
+            DecodedImage decoded{};
+            ktxTexture2* texture = nullptr;
+            KTX_error_code result = ktxTexture2_CreateFromMemory(bytes.data(), bytes.size(),
+                                                                 KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture);
             if (result != KTX_SUCCESS) {
-                ktxTexture_Destroy(ktxTex);
-                ktxVulkanDeviceInfo_Destruct(&vdi);
-                throw std::runtime_error("Failed to upload KTX texture to Vulkan: " + filename);
+                std::cerr << "failed to read ktx2 image: " << ktxErrorString(result) << std::endl;
+                return decoded;
+            }
+            if (texture->numDimensions != 2 || texture->numLayers > 1 || texture->numFaces > 1) {
+                std::cerr << "ktx2 image isn't a plain 2d texture" << std::endl;
+                ktxTexture_Destroy(ktxTexture(texture));
+                return decoded;
             }
 
-            // Store texture in Vulkan AllocatedTexture structure
-            AllocatedTexture texture;
-            texture.image = vkTex.image;
+            if (ktxTexture2_NeedsTranscoding(texture)) {
+                ktx_transcode_fmt_e target = transcodeTarget(targets, ktxTexture2_GetNumComponents(texture));
+                result = ktxTexture2_TranscodeBasis(texture, target, 0);
+                if (result != KTX_SUCCESS) {
+                    std::cerr << "failed to transcode ktx2 image: " << ktxErrorString(result) << std::endl;
+                    ktxTexture_Destroy(ktxTexture(texture));
+                    return decoded;
+                }
+            }
 
-            // Cleanup
-            ktxTexture_Destroy(ktxTex);
-            ktxVulkanDeviceInfo_Destruct(&vdi);
+            decoded.ktx = texture;
+            decoded.format = unormFormat(static_cast<VkFormat>(texture->vkFormat));
+            decoded.width = static_cast<int>(texture->baseWidth);
+            decoded.height = static_cast<int>(texture->baseHeight);
+            return decoded;
+        }
 
-            return texture;
+        // What libktx reports after transcoding, before the UNORM mapping
+        static VkFormat transcodedFormat(ktx_transcode_fmt_e target) {
+            switch (target) {
+                case KTX_TTF_BC7_RGBA:
+                    return VK_FORMAT_BC7_UNORM_BLOCK;
+                case KTX_TTF_BC3_RGBA:
+                    return VK_FORMAT_BC3_UNORM_BLOCK;
+                case KTX_TTF_BC1_RGB:
+                    return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+                default:
+                    return VK_FORMAT_R8G8B8A8_UNORM;
+            }
         }
 
-        std::optional<AllocatedTexture> loadImage(Device& device, VmaAllocator& allocator_handle,
-                                                  VkCommandPool& pool_handle, fastgltf::Asset& asset,
-                                                  fastgltf::Image& image) {
-            AllocatedTexture newImage{};
+        VkFormat decodedFormat(std::span<const unsigned char> bytes, const TranscodeTargets& targets) {
+            if (!isKTX2(bytes)) {
+                return VK_FORMAT_R8G8B8A8_UNORM;
+            }
+            // Header and format descriptor only, the levels aren't read
+            ktxTexture2* texture = nullptr;
+            if (ktxTexture2_CreateFromMemory(bytes.data(), bytes.size(), KTX_TEXTURE_CREATE_NO_FLAGS, &texture) !=
+                KTX_SUCCESS) {
+                return VK_FORMAT_UNDEFINED;
+            }
+            VkFormat format = static_cast<VkFormat>(texture->vkFormat);
+            if (ktxTexture2_NeedsTranscoding(texture)) {
+                format = transcodedFormat(transcodeTarget(targets, ktxTexture2_GetNumComponents(texture)));
+            }
+            ktxTexture_Destroy(ktxTexture(texture));
+            return unormFormat(format);
+        }
 
-            int width, height, nrChannels;
+        DecodedImage decodeImage(std::span<const unsigned char> bytes, const TranscodeTargets& targets) {
+            if (isKTX2(bytes)) {
+                return decodeKTX2(bytes, targets);
+            }
+            DecodedImage decoded{};
+            int channels{0};
+            decoded.pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &decoded.width,
+                                                   &decoded.height, &channels, 4);
+            if (decoded.pixels == nullptr) {
+                std::cerr << "failed to decode image: " << stbi_failure_reason() << std::endl;
+            }
+            return decoded;
+        }
+
+        DecodedImage decodeImage(const fastgltf::Asset& asset, const fastgltf::Image& image) {
+            // Runs on the loader workers, so no vulkan in here and nothing but errors printed
+            DecodedImage decoded{};
+            int channels{0};
 
             std::visit(fastgltf::visitor{
                            [](auto& arg) {
                            },
-                           [&](fastgltf::sources::Array& array) {
-                               std::cout << "fastgltf::sources::Array& array" << std::endl;
-                           },
-                           [&](fastgltf::sources::Fallback& fallback) {
-                               std::cout << "fastgltf::sources::Fallback& fallback" << std::endl;
-                           },
-                           [&](fastgltf::sources::ByteView& byteview) {
-                               std::cout << "fastgltf::sources::ByteView& byteview" << std::endl;
-                           },
-                            [&](fastgltf::sources::CustomBuffer& custombuffer) {
-                               std::cout << "fastgltf::sources::CustomBuffer& custombuffer" << std::endl;
-                           },
-                           [&](fastgltf::sources::URI& filePath) {
+                           [&](const fastgltf::sources::URI& filePath) {
                                assert(filePath.fileByteOffset == 0);
                                assert(filePath.uri.isLocalPath());
-                               std::cout << "fastgltf::sources::URI& filePath" << std::endl;
                                const std::string path(filePath.uri.path().begin(), filePath.uri.path().end());
-                               unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
-                               if (data) {
-                                   VkExtent3D imagesize;
-                                   imagesize.width = width;
-                                   imagesize.height = height;
-                                   imagesize.depth = 1;
-
-                                   newImage = Texture::upload(device, allocator_handle, pool_handle, data, imagesize,
-                                                              VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-
-                                   stbi_image_free(data);
-                                   
-                               }
+                               decoded.pixels = stbi_load(path.c_str(), &decoded.width, &decoded.height, &channels, 4);
                            },
-                           [&](fastgltf::sources::Vector& vector) {
-                               unsigned char* data = stbi_load_from_memory(
+                           [&](const fastgltf::sources::Vector& vector) {
+                               decoded.pixels = stbi_load_from_memory(
                                    reinterpret_cast<const stbi_uc*>(vector.bytes.data()),
-                                   static_cast<int>(vector.bytes.size()), &width, &height, &nrChannels, 4);
-                               std::cout << "fastgltf::sources::Vector& vector" << std::endl;
-                               if (data) {
-                                   VkExtent3D imagesize;
-                                   imagesize.width = width;
-                                   imagesize.height = height;
-                                   imagesize.depth = 1;
-
-                                   newImage = Texture::upload(device, allocator_handle, pool_handle, data, imagesize,
-                                                              VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-
-                                   stbi_image_free(data);
-                                   
-                               }
+                                   static_cast<int>(vector.bytes.size()), &decoded.width, &decoded.height,
+                                   &channels, 4);
                            },
-                           [&](fastgltf::sources::BufferView& view) {
+                           [&](const fastgltf::sources::BufferView& view) {
                                auto& bufferView = asset.bufferViews[view.bufferViewIndex];
                                auto& buffer = asset.buffers[bufferView.bufferIndex];
-                               auto vec = std::get<fastgltf::sources::Array>(buffer.data);
-                               unsigned char* data = stbi_load_from_memory(
+                               // By reference, a copy here duplicated the whole glb buffer for every image
+                               auto& vec = std::get<fastgltf::sources::Array>(buffer.data);
+                               decoded.pixels = stbi_load_from_memory(
                                    reinterpret_cast<const stbi_uc*>(vec.bytes.data()) + bufferView.byteOffset,
-                                   static_cast<int>(bufferView.byteLength), &width, &height, &nrChannels, 4);
-                               std::cout << "fastgltf::sources::BufferView& view" << std::endl;
-                               if (data) {
-                                   VkExtent3D imagesize;
-                                   imagesize.width = width;
-                                   imagesize.height = height;
-                                   imagesize.depth = 1;
-
-                                   newImage = Texture::upload(device, allocator_handle, pool_handle, data, imagesize,
-                                                              VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-
-                                   stbi_image_free(data);
-                                   
-                               } else {
-                                   std::cout << "load data is null" << std::endl;
-                               }
+                                   static_cast<int>(bufferView.byteLength), &decoded.width, &decoded.height,
+                                   &channels, 4);
                            },
                        },
                        image.data);
 
-            if (newImage.image == VK_NULL_HANDLE) {
-                std::cout << "image is null" << std::endl;
-                return {};
+            if (decoded.pixels == nullptr) {
+                std::cerr << "failed to decode image " << image.name << ": " << stbi_failure_reason() << std::endl;
+            }
+            return decoded;
+        }
+
+        static std::optional<AllocatedTexture> uploadKTX2(const Device& device, VmaAllocator allocator_handle,
+                                                          Upload::Context& uploader, DecodedImage& decoded) {
+            ktxTexture* texture = ktxTexture(decoded.ktx);
+            VkExtent3D imagesize{static_cast<uint32_t>(decoded.width), static_cast<uint32_t>(decoded.height), 1};
+            std::optional<AllocatedTexture> new_image;
+
+            VkFormatProperties properties{};
+            vkGetPhysicalDeviceFormatProperties(device.physical_handle, decoded.format, &properties);
+            if (!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+                std::cout << "ktx2 image format " << decoded.format << " can't be sampled on this device" << std::endl;
+            } else if (decoded.format == VK_FORMAT_R8G8B8A8_UNORM && texture->numLevels == 1) {
+                // Uncompressed without its own mips, the blit chain can fill them in
+                new_image = Texture::upload(device, allocator_handle, uploader, ktxTexture_GetData(texture),
+                                            imagesize, decoded.format, VK_IMAGE_USAGE_SAMPLED_BIT, true);
             } else {
-                return newImage;
+                std::vector<VkDeviceSize> level_offsets(texture->numLevels);
+                for (uint32_t level = 0; level < texture->numLevels; level++) {
+                    ktx_size_t offset = 0;
+                    ktxTexture_GetImageOffset(texture, level, 0, 0, &offset);
+                    level_offsets[level] = offset;
+                }
+                new_image = Texture::uploadLevels(device, allocator_handle, uploader, ktxTexture_GetData(texture),
+                                                  ktxTexture_GetDataSize(texture), imagesize, decoded.format,
+                                                  VK_IMAGE_USAGE_SAMPLED_BIT, level_offsets);
+            }
+
+            ktxTexture_Destroy(texture);
+            decoded.ktx = nullptr;
+            return new_image;
+        }
+
+        void releaseImage(DecodedImage& decoded) {
+            if (decoded.ktx != nullptr) {
+                ktxTexture_Destroy(ktxTexture(decoded.ktx));
+                decoded.ktx = nullptr;
+            }
+            if (decoded.pixels != nullptr) {
+                stbi_image_free(decoded.pixels);
+                decoded.pixels = nullptr;
+            }
+        }
+
+        std::optional<AllocatedTexture> uploadImage(const Device& device, VmaAllocator allocator_handle,
+                                                    Upload::Context& uploader, DecodedImage& decoded) {
+            if (decoded.ktx != nullptr) {
+                return uploadKTX2(device, allocator_handle, uploader, decoded);
+            }
+            if (decoded.pixels == nullptr) {
+                return {};
+            }
+            VkExtent3D imagesize;
+            imagesize.width = static_cast<uint32_t>(decoded.width);
+            imagesize.height = static_cast<uint32_t>(decoded.height);
+            imagesize.depth = 1;
+
+            AllocatedTexture newImage = Texture::upload(device, allocator_handle, uploader, decoded.pixels, imagesize,
+                                                        VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+            stbi_image_free(decoded.pixels);
+            decoded.pixels = nullptr;
+            return newImage;
+        }
+
+        std::optional<AllocatedTexture> loadImage(Device& device, VmaAllocator& allocator_handle,
+                                                  Upload::Context& uploader, fastgltf::Asset& asset,
+                                                  fastgltf::Image& image) {
+            DecodedImage decoded = decodeImage(asset, image);
+            std::optional<AllocatedTexture> newImage = uploadImage(device, allocator_handle, uploader, decoded);
+            if (!newImage.has_value()) {
+                std::cout << "image is null" << std::endl;
             }
+            return newImage;
         }
     }  // namespace ResourceManagement
 }  // namespace Vulkan
\ No newline at end of file
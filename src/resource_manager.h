@@ -5,6 +5,9 @@
 
 #include <unordered_map>
 #include <optional>
+#include <memory>
+
+struct ktxTexture2;
 
 namespace fastgltf {
     enum class Filter : std::uint16_t;
@@ -26,6 +29,7 @@ namespace Vulkan
 
     struct Mesh;
     struct Device;
+    struct ThreadPool;
     namespace MaterialOperation {
         struct MeshAsset;
         struct LoadedGLTF;
@@ -36,19 +40,112 @@ namespace Vulkan
     namespace Pipeline {
         struct Cache;
     }
+
+    namespace Upload {
+        struct Context;
+    }
+
+    namespace Geometry {
+        struct Buffers;
+    }
+
+    namespace MeshCache {
+        struct Settings;
+    }
+
+    namespace TextureStreaming {
+        struct Streamer;
+    }
+
+    namespace TextureCache {
+        struct Cache;
+    }
     
 
 
     namespace ResourceManagement {
-        std::vector<std::shared_ptr<MaterialOperation::MeshAsset>> loadAssets(Device& device, const std::string& filepath, VmaAllocator allocator_handle, VkCommandPool pool_handle);
+        // Upper bound for the gltf samplers, the device limit wins when it's lower
+        constexpr float max_sampler_anisotropy{8.0f};
+        // Bytes a background load stages per poll before handing the frame back, a big scene is recorded over
+        // several polls instead of stalling one frame for all of it
+        constexpr VkDeviceSize max_record_bytes_per_poll{32ull * 1024 * 1024};
+
+        std::vector<std::shared_ptr<MaterialOperation::MeshAsset>> loadAssets(Device& device, const std::string& filepath, VmaAllocator allocator_handle, Upload::Context& uploader, Geometry::Buffers& geometry);
         std::optional<std::shared_ptr<MaterialOperation::LoadedGLTF>> loadGLTF(
-            Device& device, const std::string& filepath, VmaAllocator& allocator_handle, VkCommandPool& pool_handle,
-            AllocatedTexture& default_texture, MaterialOperation::MaterialResources& default_resources, MaterialOperation::GLTFOperations& material_operations, Pipeline::Cache& pipeline_cache);
-            std::optional<AllocatedTexture> loadImage(Device& device, VmaAllocator& allocator_handle, VkCommandPool& pool_handle, fastgltf::Asset& asset, fastgltf::Image& image);
+            Device& device, const std::string& filepath, VmaAllocator& allocator_handle, Upload::Context& uploader,
+            Geometry::Buffers& geometry, ThreadPool& workers, const MeshCache::Settings& cache_settings,
+            AllocatedTexture& default_texture, MaterialOperation::MaterialResources& default_resources, MaterialOperation::GLTFOperations& material_operations, Pipeline::Cache& pipeline_cache,
+            TextureCache::Cache& texture_cache, TextureStreaming::Streamer* streamer = nullptr);
+        // Where a background load is, everything before RECORDING runs on the load's own thread
+        enum class LoadStage {
+            COOKING,
+            DECODING,
+            RECORDING,
+            UPLOADING,
+            READY,
+            FAILED
+        };
+
+        struct LoadProgress {
+            LoadStage stage{LoadStage::COOKING};
+            uint32_t images_decoded{0};
+            uint32_t image_count{0};
+        };
+
+        struct PendingLoad;
+        using LoadHandle = std::shared_ptr<PendingLoad>;
+
+        // Starts reading, cooking and decoding the file off the main thread and returns straight away. Images
+        // the texture cache holds right now aren't decoded
+        LoadHandle beginLoad(const Device& device, const std::string& filepath, ThreadPool& workers,
+                             const MeshCache::Settings& cache_settings, const TextureCache::Cache& texture_cache,
+                             const TextureStreaming::Streamer* streamer = nullptr);
+        LoadProgress loadProgress(const LoadHandle& load);
+        // Once a frame from the main thread. Once decoding is done records up to max_record_bytes_per_poll of
+        // the scene's uploads per call, submits them with the last one and returns the scene when the gpu has
+        // all of it, nullptr until then or when the load failed
+        std::shared_ptr<MaterialOperation::LoadedGLTF> pollLoad(
+            const LoadHandle& load, Device& device, VmaAllocator& allocator_handle, Upload::Context& uploader,
+            Geometry::Buffers& geometry, AllocatedTexture& default_texture,
+            MaterialOperation::MaterialResources& default_resources,
+            MaterialOperation::GLTFOperations& material_operations, Pipeline::Cache& pipeline_cache,
+            TextureCache::Cache& texture_cache, TextureStreaming::Streamer* streamer = nullptr);
+        // Waits for the load's thread. Returns the scene if it got as far as recording, possibly only partly
+        // recorded, the caller destroys it
+        std::shared_ptr<MaterialOperation::LoadedGLTF> abandonLoad(const LoadHandle& load);
+
+        // Block formats the device can sample, basis payloads are transcoded to the best of them
+        struct TranscodeTargets {
+            bool bc7{false};
+            bool bc3{false};
+            bool bc1{false};
+        };
+        TranscodeTargets queryTranscodeTargets(const Device& device);
+
+        // Either RGBA8 pixels from stbi or a ktx2 texture with all of its levels, freed by uploadImage
+        struct DecodedImage {
+            unsigned char* pixels{nullptr};
+            ktxTexture2* ktx{nullptr};
+            VkFormat format{VK_FORMAT_R8G8B8A8_UNORM};
+            int width{0};
+            int height{0};
+        };
+        // Safe to call from worker threads, it only reads the asset and decodes
+        DecodedImage decodeImage(const fastgltf::Asset& asset, const fastgltf::Image& image);
+        // Encoded bytes already in memory, the cooked image data. Png and jpg through stbi, ktx2 through libktx
+        DecodedImage decodeImage(std::span<const unsigned char> bytes, const TranscodeTargets& targets);
+        // The format decodeImage will produce for the bytes, without decoding them
+        VkFormat decodedFormat(std::span<const unsigned char> bytes, const TranscodeTargets& targets);
+        // Frees whichever of the pixels or the ktx texture the image holds
+        void releaseImage(DecodedImage& decoded);
+        std::optional<AllocatedTexture> uploadImage(const Device& device, VmaAllocator allocator_handle,
+                                                    Upload::Context& uploader, DecodedImage& decoded);
+            std::optional<AllocatedTexture> loadImage(Device& device, VmaAllocator& allocator_handle, Upload::Context& uploader, fastgltf::Asset& asset, fastgltf::Image& image);
         VkFilter extractFilter(fastgltf::Filter filter);
         VkSamplerMipmapMode extractMipmapMode(fastgltf::Filter filter);
         VkSampler createIBLSampler(VkDevice device);
-        AllocatedTexture loadKTXTexture(const Device& device, VkCommandPool& pool_handle, const std::string& filename);
-        AllocatedTexture loadBRDFLUT(const Device& device, VmaAllocator allocator_handle, VkCommandPool& pool_handle, const std::string& filename);
+        AllocatedTexture loadKTXTexture(const Device& device, VmaAllocator allocator_handle, Upload::Context& uploader,
+                                        const std::string& filename);
+        AllocatedTexture loadBRDFLUT(const Device& device, VmaAllocator allocator_handle, Upload::Context& uploader, const std::string& filename);
     }
 }
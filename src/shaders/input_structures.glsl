@@ -18,6 +18,7 @@ layout(set = 1, binding = 0) uniform GLTFMaterialData{
 	float rough_factors;
 	float ao;
 	uint has_metal_rough_texture;
+	vec4 min_lod;
 
 	
 } materialData;
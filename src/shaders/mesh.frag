@@ -131,6 +131,12 @@ float geometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
     return geometrySchlickGGX(NdotV, roughness) * geometrySchlickGGX(NdotL, roughness);
 }
 
+// Streamed textures only hold valid data from min_lod down, biasing up keeps the sample off the finer levels
+vec4 sampleResident(sampler2D tex, vec2 uv, float min_lod) {
+    float lod = textureQueryLod(tex, uv).y;
+    return texture(tex, uv, max(min_lod - lod, 0.0));
+}
+
 vec3 toneMapACES(vec3 color) {
     float a = 2.51;
     float b = 0.03;
@@ -147,10 +153,10 @@ void main() {
     vec3 H = normalize(V + L); // Halfway vector
 
     // Sample textures
-    vec3 mrSample = texture(metalRoughTex, inUV).rgb;
-    vec3 texColor = texture(colorTex, inUV).rgb * materialData.color_factors.rgb;
+    vec3 mrSample = sampleResident(metalRoughTex, inUV, materialData.min_lod.y).rgb;
+    vec3 texColor = sampleResident(colorTex, inUV, materialData.min_lod.x).rgb * materialData.color_factors.rgb;
     texColor = pow(texColor, vec3(2.2));
-    vec3 normalTS = texture(normalMap, inUV).rgb * 2.0 - 1.0; // Convert [0,1] to [-1,1]
+    vec3 normalTS = sampleResident(normalMap, inUV, materialData.min_lod.z).rgb * 2.0 - 1.0; // Convert [0,1] to [-1,1]
 
     // Extract material properties
     float metallic = (materialData.has_metal_rough_texture > 0) ? mrSample.b : materialData.metal_factors;
@@ -65,8 +65,10 @@
 
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
 
 #include "input_structures.glsl"
+#include "vertex_fetch.glsl"
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
@@ -74,27 +76,14 @@ layout (location = 2) out vec2 outUV;
 layout (location = 3) out vec3 outPos;
 layout (location = 4) out vec3 outTangent; // New tangent output
 
-struct Vertex {
-    vec3 position;
-    float uv_x;
-    vec3 normal;
-    float uv_y;
-    vec3 tangent; // New tangent field
-    vec4 color;
-}; 
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer { 
-    Vertex vertices[];
-};
-
 // Push constants block
 layout(push_constant) uniform constants {
     mat4 render_matrix;
-    VertexBuffer vertexBuffer;
+    uvec2 vertexBuffer;
 } PushConstants;
 
 void main() {
-    Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+    MeshVertex v = fetchVertex(PushConstants.vertexBuffer, gl_VertexIndex);
     
     vec4 position = vec4(v.position, 1.0f);
 
@@ -107,7 +96,7 @@ void main() {
     outTangent = normalize((PushConstants.render_matrix * vec4(v.tangent, 0.0)).xyz); // Transform tangent
 
     outColor = v.color.xyz * materialData.color_factors.xyz;    
-    outUV = vec2(v.uv_x, v.uv_y);
+    outUV = v.uv;
 
     gl_Position = sceneData.viewproj * PushConstants.render_matrix * position;
 }
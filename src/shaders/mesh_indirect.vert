@@ -0,0 +1,60 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+#include "input_structures.glsl"
+#include "vertex_fetch.glsl"
+
+// Same outputs as mesh.vert, but the transform and vertex buffer come from the surface table written at
+// upload, picked by gl_InstanceIndex which the cull pass sets to the surface id through firstInstance
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outPos;
+layout (location = 4) out vec3 outTangent;
+
+struct Surface {
+    vec4 sphere;
+    vec4 extents;
+    uint first_index;
+    uint index_count;
+    uint transform_index;
+    uint bucket;
+    uvec2 vertex_buffer;
+    uvec2 padding;
+};
+
+layout(buffer_reference, std430) readonly buffer SurfaceBuffer {
+    Surface surfaces[];
+};
+
+layout(buffer_reference, std430) readonly buffer TransformBuffer {
+    mat4 transforms[];
+};
+
+layout(push_constant) uniform constants {
+    SurfaceBuffer surface_buffer;
+    TransformBuffer transform_buffer;
+} PushConstants;
+
+void main() {
+    Surface surface = PushConstants.surface_buffer.surfaces[gl_InstanceIndex];
+    mat4 render_matrix = PushConstants.transform_buffer.transforms[surface.transform_index];
+    MeshVertex v = fetchVertex(surface.vertex_buffer, gl_VertexIndex);
+
+    vec4 position = vec4(v.position, 1.0f);
+
+    mat4 modelView = sceneData.view * render_matrix;
+    outPos = (modelView * position).xyz;
+
+    outNormal = normalize((render_matrix * vec4(v.normal, 0.f)).xyz);
+    outTangent = normalize((render_matrix * vec4(v.tangent, 0.0)).xyz);
+
+    outColor = v.color.xyz * materialData.color_factors.xyz;
+    outUV = v.uv;
+
+    gl_Position = sceneData.viewproj * render_matrix * position;
+}
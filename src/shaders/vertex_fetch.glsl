@@ -0,0 +1,73 @@
+// Vertex pulling for both import layouts, needs GL_EXT_buffer_reference and GL_EXT_buffer_reference_uvec2
+// enabled by the including shader. Addresses come in as uvec2 so one pointer can be read as either layout
+
+// Set at pipeline creation to match the layout the geometry arena was created with
+layout(constant_id = 0) const bool compact_vertices = false;
+
+struct Vertex {
+    vec3 position;
+    float uv_x;
+    vec3 normal;
+    float uv_y;
+    vec3 tangent;
+    vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer {
+    Vertex vertices[];
+};
+
+// 24 bytes, see CompactVertex in vulkan_common.h
+struct CompactVertex {
+    uint position_xy; // unorm16 x2 within the mesh box
+    uint position_z;  // unorm16, upper half unused
+    uint normal;      // octahedral snorm16 x2
+    uint tangent;     // octahedral snorm16 x2
+    uint uv;          // half x2
+    uint color;       // unorm8 x4
+};
+
+// The mesh's range starts with the box positions are quantized against
+layout(buffer_reference, std430) readonly buffer CompactVertexBuffer {
+    vec4 position_offset;
+    vec4 position_scale;
+    CompactVertex vertices[];
+};
+
+struct MeshVertex {
+    vec3 position;
+    vec3 normal;
+    vec3 tangent;
+    vec2 uv;
+    vec4 color;
+};
+
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
+MeshVertex fetchVertex(uvec2 address, int index) {
+    MeshVertex result;
+    if (compact_vertices) {
+        CompactVertexBuffer buffer = CompactVertexBuffer(address);
+        CompactVertex v = buffer.vertices[index];
+        vec3 quantized = vec3(unpackUnorm2x16(v.position_xy), unpackUnorm2x16(v.position_z).x);
+        result.position = buffer.position_offset.xyz + quantized * buffer.position_scale.xyz;
+        result.normal = octDecode(unpackSnorm2x16(v.normal));
+        result.tangent = octDecode(unpackSnorm2x16(v.tangent));
+        result.uv = unpackHalf2x16(v.uv);
+        result.color = unpackUnorm4x8(v.color);
+    } else {
+        Vertex v = VertexBuffer(address).vertices[index];
+        result.position = v.position;
+        result.normal = v.normal;
+        result.tangent = v.tangent;
+        result.uv = vec2(v.uv_x, v.uv_y);
+        result.color = v.color;
+    }
+    return result;
+}
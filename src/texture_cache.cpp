@@ -0,0 +1,129 @@
+#include "texture_cache.h"
+#include "device.h"
+#include "vulkan_operations.h"
+
+#include <cstring>
+
+namespace Vulkan {
+    namespace TextureCache {
+        void create(Cache& cache, TextureStreaming::Streamer* streamer) {
+            cache.streamer = streamer;
+        }
+
+        void destroy(const Device& device, VmaAllocator allocator, Cache& cache) {
+            if (!cache.textures.empty() || !cache.samplers.empty()) {
+                std::cout << "texture cache: " << cache.textures.size() << " textures and " << cache.samplers.size()
+                          << " samplers still referenced at shutdown" << std::endl;
+            }
+            for (auto& [key, entry] : cache.textures) {
+                Texture::destroy(device, allocator, entry.texture);
+            }
+            for (auto& [key, entry] : cache.samplers) {
+                vkDestroySampler(device.logical_handle, entry.sampler, nullptr);
+            }
+            cache = {};
+        }
+
+        static void combine(uint64_t& hash, uint64_t value) {
+            hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;
+            hash ^= hash >> 29;
+        }
+
+        static uint64_t floatBits(float value) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        uint64_t hashSampler(const VkSamplerCreateInfo& info) {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            combine(hash, info.flags);
+            combine(hash, info.magFilter);
+            combine(hash, info.minFilter);
+            combine(hash, info.mipmapMode);
+            combine(hash, info.addressModeU);
+            combine(hash, info.addressModeV);
+            combine(hash, info.addressModeW);
+            combine(hash, floatBits(info.mipLodBias));
+            combine(hash, info.anisotropyEnable);
+            combine(hash, floatBits(info.maxAnisotropy));
+            combine(hash, info.compareEnable);
+            combine(hash, info.compareOp);
+            combine(hash, floatBits(info.minLod));
+            combine(hash, floatBits(info.maxLod));
+            combine(hash, info.borderColor);
+            combine(hash, info.unnormalizedCoordinates);
+            return hash;
+        }
+
+        VkSampler acquireSampler(const Device& device, Cache& cache, const VkSamplerCreateInfo& info) {
+            uint64_t key = hashSampler(info);
+            SamplerEntry& entry = cache.samplers[key];
+            if (entry.sampler == VK_NULL_HANDLE) {
+                vkCheck(vkCreateSampler(device.logical_handle, &info, nullptr, &entry.sampler));
+                cache.sampler_keys[entry.sampler] = key;
+                cache.stats.sampler_misses++;
+            } else {
+                cache.stats.sampler_hits++;
+            }
+            entry.references++;
+            return entry.sampler;
+        }
+
+        void releaseSampler(const Device& device, Cache& cache, VkSampler sampler) {
+            auto key = cache.sampler_keys.find(sampler);
+            if (key == cache.sampler_keys.end()) {
+                return;
+            }
+            auto entry = cache.samplers.find(key->second);
+            if (--entry->second.references == 0) {
+                vkDestroySampler(device.logical_handle, sampler, nullptr);
+                cache.samplers.erase(entry);
+                cache.sampler_keys.erase(key);
+            }
+        }
+
+        std::optional<TextureEntry> acquireTexture(Cache& cache, const TextureKey& key) {
+            auto entry = cache.textures.find(key);
+            if (entry == cache.textures.end()) {
+                return {};
+            }
+            cache.stats.texture_hits++;
+            entry->second.references++;
+            return entry->second;
+        }
+
+        void addTexture(Cache& cache, const TextureKey& key, const AllocatedTexture& texture, uint32_t stream_id) {
+            TextureEntry& entry = cache.textures[key];
+            entry.texture = texture;
+            entry.stream_id = stream_id;
+            entry.references = 1;
+            cache.texture_keys[texture.image] = key;
+            cache.stats.texture_misses++;
+        }
+
+        void releaseTexture(const Device& device, VmaAllocator allocator, Cache& cache, VkImage image) {
+            auto key = cache.texture_keys.find(image);
+            if (key == cache.texture_keys.end()) {
+                return;
+            }
+            auto entry = cache.textures.find(key->second);
+            if (--entry->second.references > 0) {
+                return;
+            }
+            if (entry->second.stream_id != TextureStreaming::no_texture && cache.streamer != nullptr) {
+                TextureStreaming::release(*cache.streamer, {&entry->second.stream_id, 1}, {});
+            }
+            Texture::destroy(device, allocator, entry->second.texture);
+            cache.textures.erase(entry);
+            cache.texture_keys.erase(key);
+        }
+
+        void log(const Cache& cache) {
+            std::cout << "texture cache: " << cache.textures.size() << " textures, " << cache.samplers.size()
+                      << " samplers resident, textures " << cache.stats.texture_hits << " hits "
+                      << cache.stats.texture_misses << " misses, samplers " << cache.stats.sampler_hits << " hits "
+                      << cache.stats.sampler_misses << " misses" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "texture_streaming.h"
+
+#include <optional>
+#include <unordered_map>
+
+namespace Vulkan {
+
+    struct Device;
+
+    namespace TextureCache {
+        // Encoded content plus the format it decodes to on this device, the size guards against a hash collision
+        struct TextureKey {
+            uint64_t content_hash{0};
+            uint64_t size{0};
+            VkFormat format{VK_FORMAT_UNDEFINED};
+
+            bool operator==(const TextureKey& other) const = default;
+        };
+
+        struct TextureKeyHash {
+            size_t operator()(const TextureKey& key) const {
+                return static_cast<size_t>(key.content_hash ^ (key.size * 0x9e3779b97f4a7c15ull) ^
+                                           (uint64_t(key.format) << 32));
+            }
+        };
+
+        struct TextureEntry {
+            AllocatedTexture texture{};
+            // Streamer entry behind the image, released with the last reference
+            uint32_t stream_id{TextureStreaming::no_texture};
+            uint32_t references{0};
+        };
+
+        struct SamplerEntry {
+            VkSampler sampler{VK_NULL_HANDLE};
+            uint32_t references{0};
+        };
+
+        struct Stats {
+            uint32_t texture_hits{0};
+            uint32_t texture_misses{0};
+            uint32_t sampler_hits{0};
+            uint32_t sampler_misses{0};
+        };
+
+        // Renderer wide, every scene takes references instead of owning its textures and samplers
+        struct Cache {
+            std::unordered_map<TextureKey, TextureEntry, TextureKeyHash> textures;
+            std::unordered_map<uint64_t, SamplerEntry> samplers;
+            // Release only gets the handle back, these find the entry for it
+            std::unordered_map<VkImage, TextureKey> texture_keys;
+            std::unordered_map<VkSampler, uint64_t> sampler_keys;
+            TextureStreaming::Streamer* streamer{nullptr};
+            Stats stats{};
+        };
+
+        void create(Cache& cache, TextureStreaming::Streamer* streamer);
+        // Destroys whatever is still referenced, the gpu has to be done with it
+        void destroy(const Device& device, VmaAllocator allocator, Cache& cache);
+
+        // Every field that changes how the sampler filters or addresses, pNext is not followed
+        uint64_t hashSampler(const VkSamplerCreateInfo& info);
+        // Creates the sampler on a miss, either way the caller holds a reference
+        VkSampler acquireSampler(const Device& device, Cache& cache, const VkSamplerCreateInfo& info);
+        void releaseSampler(const Device& device, Cache& cache, VkSampler sampler);
+
+        // Takes a reference when the texture is resident, nothing when it has to be loaded. A miss is only
+        // counted once the texture is added
+        std::optional<TextureEntry> acquireTexture(Cache& cache, const TextureKey& key);
+        // A freshly uploaded texture, the caller holds the first reference
+        void addTexture(Cache& cache, const TextureKey& key, const AllocatedTexture& texture, uint32_t stream_id);
+        void releaseTexture(const Device& device, VmaAllocator allocator, Cache& cache, VkImage image);
+        void log(const Cache& cache);
+    }
+}
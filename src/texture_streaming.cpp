@@ -0,0 +1,370 @@
+#include "texture_streaming.h"
+#include "device.h"
+#include "thread_pool.h"
+#include "upload.h"
+#include "vulkan_operations.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+#include <ktx.h>
+
+namespace Vulkan {
+    namespace TextureStreaming {
+        void create(const Device& device, ThreadPool& workers, const Settings& settings, Streamer& streamer) {
+            streamer.settings = settings;
+            streamer.workers = &workers;
+            streamer.targets = ResourceManagement::queryTranscodeTargets(device);
+        }
+
+        void destroy(Streamer& streamer) {
+            if (streamer.workers != nullptr) {
+                Jobs::wait(*streamer.workers);
+            }
+            streamer.textures.clear();
+            streamer.free_textures.clear();
+            streamer.materials.clear();
+            streamer.free_materials.clear();
+            streamer.uploads.clear();
+            streamer.decoded.clear();
+            streamer.decodes_in_flight = 0;
+        }
+
+        static uint32_t fullChain(VkExtent3D extent) {
+            return static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+        }
+
+        // Finest level that still fits in the resident size, the whole chain when even level 0 does
+        static uint32_t coarseLevel(VkExtent3D extent, uint32_t mip_levels, uint32_t resident_size) {
+            uint32_t level = 0;
+            while (level + 1 < mip_levels && std::max(extent.width >> level, extent.height >> level) > resident_size) {
+                level++;
+            }
+            return level;
+        }
+
+        // Ktx files that ship their mips are streamed as stored, RGBA8 with a single level gets its chain built
+        // here. A single level block format can't be filtered on the cpu, 0 leaves it to the normal path
+        static uint32_t levelCount(const ResourceManagement::DecodedImage& decoded) {
+            VkExtent3D extent{static_cast<uint32_t>(decoded.width), static_cast<uint32_t>(decoded.height), 1};
+            if (decoded.ktx != nullptr) {
+                if (decoded.ktx->numLevels > 1) {
+                    return decoded.ktx->numLevels;
+                }
+                return decoded.format == VK_FORMAT_R8G8B8A8_UNORM ? fullChain(extent) : 0;
+            }
+            return decoded.pixels != nullptr ? fullChain(extent) : 0;
+        }
+
+        // 2x2 box down to the next level, an odd edge repeats its last texel
+        static void downsample(const unsigned char* src, uint32_t width, uint32_t height, unsigned char* dst) {
+            uint32_t dst_width = std::max(width >> 1, 1u);
+            uint32_t dst_height = std::max(height >> 1, 1u);
+            for (uint32_t y = 0; y < dst_height; y++) {
+                const unsigned char* row0 = src + size_t(std::min(y * 2, height - 1)) * width * 4;
+                const unsigned char* row1 = src + size_t(std::min(y * 2 + 1, height - 1)) * width * 4;
+                unsigned char* out = dst + size_t(y) * dst_width * 4;
+                for (uint32_t x = 0; x < dst_width; x++) {
+                    uint32_t x0 = std::min(x * 2, width - 1) * 4;
+                    uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+                    for (uint32_t c = 0; c < 4; c++) {
+                        out[x * 4 + c] = static_cast<unsigned char>(
+                            (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        // Packs levels [first_level, end_level) of the decoded image into levels.data
+        static void extractLevels(const ResourceManagement::DecodedImage& decoded, uint32_t first_level,
+                                  uint32_t end_level, Levels& levels) {
+            levels.format = decoded.format;
+            levels.extent = {static_cast<uint32_t>(decoded.width), static_cast<uint32_t>(decoded.height), 1};
+            levels.first_level = first_level;
+            levels.data.clear();
+            levels.level_offsets.clear();
+
+            if (decoded.ktx != nullptr && decoded.ktx->numLevels > 1) {
+                ktxTexture* texture = ktxTexture(decoded.ktx);
+                for (uint32_t level = first_level; level < end_level; level++) {
+                    ktx_size_t offset = 0;
+                    ktxTexture_GetImageOffset(texture, level, 0, 0, &offset);
+                    size_t size = ktxTexture_GetImageSize(texture, level);
+                    levels.level_offsets.push_back(levels.data.size());
+                    levels.data.insert(levels.data.end(), ktxTexture_GetData(texture) + offset,
+                                       ktxTexture_GetData(texture) + offset + size);
+                }
+                return;
+            }
+
+            const unsigned char* source =
+                decoded.ktx != nullptr ? ktxTexture_GetData(ktxTexture(decoded.ktx)) : decoded.pixels;
+            uint32_t width = levels.extent.width;
+            uint32_t height = levels.extent.height;
+            std::vector<unsigned char> current;
+            std::vector<unsigned char> next;
+            for (uint32_t level = 0; level < end_level; level++) {
+                const unsigned char* texels = level == 0 ? source : current.data();
+                if (level >= first_level) {
+                    levels.level_offsets.push_back(levels.data.size());
+                    levels.data.insert(levels.data.end(), texels, texels + size_t(width) * height * 4);
+                }
+                if (level + 1 < end_level) {
+                    next.resize(size_t(std::max(width >> 1, 1u)) * std::max(height >> 1, 1u) * 4);
+                    downsample(texels, width, height, next.data());
+                    std::swap(current, next);
+                    width = std::max(width >> 1, 1u);
+                    height = std::max(height >> 1, 1u);
+                }
+            }
+        }
+
+        bool prepareResident(const Streamer& streamer, ResourceManagement::DecodedImage& decoded, Levels& levels) {
+            if (!streamer.settings.enabled) {
+                return false;
+            }
+            uint32_t mip_levels = levelCount(decoded);
+            VkExtent3D extent{static_cast<uint32_t>(decoded.width), static_cast<uint32_t>(decoded.height), 1};
+            uint32_t first_level = coarseLevel(extent, mip_levels, streamer.settings.resident_size);
+            if (mip_levels == 0 || first_level == 0) {
+                return false;
+            }
+            levels.mip_levels = mip_levels;
+            extractLevels(decoded, first_level, mip_levels, levels);
+            ResourceManagement::releaseImage(decoded);
+            return true;
+        }
+
+        static void writeClamps(Streamer& streamer, const MaterialSlot& slot) {
+            for (uint32_t i = 0; i < 3; i++) {
+                uint32_t id = slot.textures[i];
+                slot.constants->min_lod[i] =
+                    id == no_texture ? 0.0f : static_cast<float>(streamer.textures[id].resident_level);
+            }
+        }
+
+        // Linear over the materials, clamps only move when a texture finishes streaming
+        static void writeClamps(Streamer& streamer, uint32_t texture) {
+            for (const MaterialSlot& slot : streamer.materials) {
+                if (slot.constants != nullptr && std::find(std::begin(slot.textures), std::end(slot.textures),
+                                                           texture) != std::end(slot.textures)) {
+                    writeClamps(streamer, slot);
+                }
+            }
+        }
+
+        uint32_t addTexture(const Device& device, VmaAllocator allocator, Upload::Context& uploader,
+                            Streamer& streamer, const Levels& levels, std::span<const unsigned char> encoded,
+                            AllocatedTexture& texture) {
+            VkFormatProperties properties{};
+            vkGetPhysicalDeviceFormatProperties(device.physical_handle, levels.format, &properties);
+            if (!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+                std::cout << "streamed image format " << levels.format << " can't be sampled on this device"
+                          << std::endl;
+                return no_texture;
+            }
+
+            // The whole chain is allocated up front, the finer levels are left undefined until streamed in
+            texture = Texture::createWithLevels(device, allocator, levels.extent, levels.format,
+                                                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                levels.mip_levels);
+            Upload::copyLevelsToImage(device, allocator, uploader, levels.data.data(), levels.data.size(),
+                                      texture.image, levels.extent, levels.level_offsets, levels.first_level,
+                                      levels.mip_levels);
+
+            uint32_t id = static_cast<uint32_t>(streamer.textures.size());
+            if (!streamer.free_textures.empty()) {
+                id = streamer.free_textures.back();
+                streamer.free_textures.pop_back();
+            } else {
+                streamer.textures.emplace_back();
+            }
+            Texture& streamed = streamer.textures[id];
+            uint32_t generation = streamed.generation;
+            streamed = {};
+            streamed.generation = generation;
+            streamed.image = texture.image;
+            streamed.extent = levels.extent;
+            streamed.mip_levels = levels.mip_levels;
+            streamed.coarse_level = levels.first_level;
+            streamed.resident_level = levels.first_level;
+            streamed.wanted_level = levels.first_level;
+            streamed.encoded = std::make_shared<const std::vector<unsigned char>>(encoded.begin(), encoded.end());
+            return id;
+        }
+
+        uint32_t addMaterial(Streamer& streamer, MaterialOperation::MaterialConstants* constants,
+                             const uint32_t textures[3]) {
+            uint32_t id = static_cast<uint32_t>(streamer.materials.size());
+            if (!streamer.free_materials.empty()) {
+                id = streamer.free_materials.back();
+                streamer.free_materials.pop_back();
+            } else {
+                streamer.materials.emplace_back();
+            }
+            MaterialSlot& slot = streamer.materials[id];
+            slot.constants = constants;
+            std::copy(textures, textures + 3, slot.textures);
+            writeClamps(streamer, slot);
+            return id;
+        }
+
+        void release(Streamer& streamer, std::span<const uint32_t> textures, std::span<const uint32_t> materials) {
+            for (uint32_t id : materials) {
+                streamer.materials[id] = {};
+                streamer.free_materials.push_back(id);
+            }
+            for (uint32_t id : textures) {
+                Texture& texture = streamer.textures[id];
+                std::erase_if(streamer.uploads, [id](const PendingUpload& upload) { return upload.texture == id; });
+                uint32_t generation = texture.generation + 1;
+                texture = {};
+                texture.generation = generation;
+                streamer.free_textures.push_back(id);
+            }
+        }
+
+        void gatherDemand(Streamer& streamer, const std::vector<MaterialOperation::RenderObject>& surfaces,
+                          const glm::vec3& camera_position, float projection_scale) {
+            for (const MaterialOperation::RenderObject& surface : surfaces) {
+                if (surface.material == nullptr || surface.material->stream_slot == UINT32_MAX) {
+                    continue;
+                }
+                const MaterialSlot& slot = streamer.materials[surface.material->stream_slot];
+
+                // Projected size of the bounding sphere, taken as the size the texture is stretched over
+                glm::vec3 center = glm::vec3(surface.transform * glm::vec4(surface.bounds.origin, 1.0f));
+                float scale = std::max({glm::length(glm::vec3(surface.transform[0])),
+                                        glm::length(glm::vec3(surface.transform[1])),
+                                        glm::length(glm::vec3(surface.transform[2]))});
+                float radius = surface.bounds.sphere_radius * scale;
+                float distance = glm::length(center - camera_position);
+                float pixels = distance > radius ? 2.0f * radius * projection_scale / distance : FLT_MAX;
+
+                for (uint32_t id : slot.textures) {
+                    if (id == no_texture) {
+                        continue;
+                    }
+                    Texture& texture = streamer.textures[id];
+                    float size = static_cast<float>(std::max(texture.extent.width, texture.extent.height));
+                    uint32_t level = 0;
+                    if (pixels < size) {
+                        level = static_cast<uint32_t>(std::log2(size / std::max(pixels, 1.0f)));
+                    }
+                    texture.wanted_level = std::min({texture.wanted_level, level, texture.mip_levels - 1});
+                }
+            }
+        }
+
+        static void requestLevels(Streamer& streamer, uint32_t id) {
+            Texture& texture = streamer.textures[id];
+            texture.busy = true;
+            streamer.decodes_in_flight++;
+
+            // Decoding again from the encoded bytes is the whole cost, nothing in here touches vulkan
+            Jobs::submit(*streamer.workers, [&streamer, id, generation = texture.generation,
+                                             encoded = texture.encoded, first_level = texture.wanted_level,
+                                             end_level = texture.resident_level]() {
+                Decoded result{id, generation, {}};
+                result.levels.first_level = first_level;
+                ResourceManagement::DecodedImage decoded =
+                    ResourceManagement::decodeImage(*encoded, streamer.targets);
+                if (levelCount(decoded) >= end_level) {
+                    extractLevels(decoded, first_level, end_level, result.levels);
+                }
+                ResourceManagement::releaseImage(decoded);
+
+                std::lock_guard<std::mutex> lock(streamer.mutex);
+                streamer.decoded.push_back(std::move(result));
+            });
+        }
+
+        void update(const Device& device, VmaAllocator allocator, Upload::Context& uploader, Streamer& streamer) {
+            std::vector<Decoded> finished;
+            {
+                std::lock_guard<std::mutex> lock(streamer.mutex);
+                std::swap(finished, streamer.decoded);
+            }
+
+            size_t first_new = streamer.uploads.size();
+            for (Decoded& result : finished) {
+                streamer.decodes_in_flight--;
+                Texture& texture = streamer.textures[result.texture];
+                if (texture.generation != result.generation) {
+                    continue;
+                }
+                if (result.levels.data.empty()) {
+                    std::cout << "streamed texture " << result.texture << " failed to decode, keeping its coarse levels"
+                              << std::endl;
+                    texture.busy = false;
+                    texture.encoded.reset();
+                    continue;
+                }
+                // Only the new levels are touched, the coarse ones stay readable by the frames in flight
+                Upload::copyLevelsToImage(device, allocator, uploader, result.levels.data.data(),
+                                          result.levels.data.size(), texture.image, texture.extent,
+                                          result.levels.level_offsets, result.levels.first_level);
+                streamer.uploads.push_back({result.texture, result.levels.first_level, 0, streamer.frame});
+                streamer.stats.uploaded_bytes += result.levels.data.size();
+            }
+            if (streamer.uploads.size() > first_new) {
+                uint64_t ready_value = Upload::submit(device, uploader);
+                for (size_t i = first_new; i < streamer.uploads.size(); i++) {
+                    streamer.uploads[i].ready_value = ready_value;
+                }
+            }
+
+            // The clamp drops once the levels are on the graphics queue and no frame recorded before them is left
+            std::erase_if(streamer.uploads, [&](const PendingUpload& upload) {
+                if (!Upload::isComplete(device, uploader, upload.ready_value) ||
+                    streamer.frame <= upload.submit_frame + streamer.settings.frames_in_flight) {
+                    return false;
+                }
+                Texture& texture = streamer.textures[upload.texture];
+                texture.resident_level = upload.level;
+                texture.busy = false;
+                writeClamps(streamer, upload.texture);
+                streamer.stats.streamed_in++;
+                return true;
+            });
+
+            // Biggest shortfall first, a texture drawn at full size with only its coarse levels shows the most
+            std::vector<uint32_t> wanted;
+            for (uint32_t id = 0; id < streamer.textures.size(); id++) {
+                const Texture& texture = streamer.textures[id];
+                if (texture.encoded != nullptr && !texture.busy && texture.wanted_level < texture.resident_level) {
+                    wanted.push_back(id);
+                }
+            }
+            std::sort(wanted.begin(), wanted.end(), [&](uint32_t a, uint32_t b) {
+                const Texture& ta = streamer.textures[a];
+                const Texture& tb = streamer.textures[b];
+                return ta.resident_level - ta.wanted_level > tb.resident_level - tb.wanted_level;
+            });
+            for (uint32_t id : wanted) {
+                if (streamer.decodes_in_flight >= max_decodes_in_flight) {
+                    break;
+                }
+                requestLevels(streamer, id);
+            }
+
+            for (Texture& texture : streamer.textures) {
+                texture.wanted_level = texture.coarse_level;
+            }
+            streamer.frame++;
+        }
+
+        void log(const Streamer& streamer) {
+            uint32_t live = 0;
+            uint32_t full = 0;
+            for (const Texture& texture : streamer.textures) {
+                live += texture.image != VK_NULL_HANDLE ? 1 : 0;
+                full += texture.image != VK_NULL_HANDLE && texture.resident_level == 0 ? 1 : 0;
+            }
+            std::cout << "texture streaming: " << live << " textures, " << full << " at full resolution, "
+                      << streamer.stats.streamed_in << " streamed in, "
+                      << streamer.stats.uploaded_bytes / (1024 * 1024) << " MB uploaded" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "material.h"
+#include "resource_manager.h"
+
+#include <mutex>
+
+namespace Vulkan {
+
+    struct ThreadPool;
+
+    namespace Upload {
+        struct Context;
+    }
+
+    namespace TextureStreaming {
+        // Levels at or below this size go up with the scene, anything finer waits until a draw asks for it
+        constexpr uint32_t default_resident_size{128};
+        // Decodes queued on the loader pool at once, a 4k jpeg is tens of milliseconds of a worker
+        constexpr uint32_t max_decodes_in_flight{4};
+        constexpr uint32_t no_texture{UINT32_MAX};
+
+        struct Settings {
+            bool enabled{true};
+            uint32_t resident_size{default_resident_size};
+            // A clamp only moves once every frame that could still read the old one has retired
+            uint32_t frames_in_flight{2};
+        };
+
+        // Levels first_level to mip_levels - 1 packed back to back, what goes to the gpu for one texture
+        struct Levels {
+            VkFormat format{VK_FORMAT_UNDEFINED};
+            VkExtent3D extent{};
+            uint32_t mip_levels{0};
+            uint32_t first_level{0};
+            std::vector<unsigned char> data;
+            std::vector<VkDeviceSize> level_offsets;
+        };
+
+        struct Texture {
+            VkImage image{VK_NULL_HANDLE};
+            VkExtent3D extent{};
+            uint32_t mip_levels{0};
+            // Uploaded with the scene
+            uint32_t coarse_level{0};
+            // Finest level with valid data that the materials' clamps allow
+            uint32_t resident_level{0};
+            // Finest level the draws asked for this frame
+            uint32_t wanted_level{0};
+            // Set while a decode or upload is in flight for the texture
+            bool busy{false};
+            // Bumped on release so a decode finishing late for a reused slot is thrown away
+            uint32_t generation{0};
+            // Still encoded, finer levels are decoded from it again
+            std::shared_ptr<const std::vector<unsigned char>> encoded;
+        };
+
+        // A material's constants and the textures behind its color, metal rough and normal bindings
+        struct MaterialSlot {
+            MaterialOperation::MaterialConstants* constants{nullptr};
+            uint32_t textures[3]{no_texture, no_texture, no_texture};
+        };
+
+        // Finished on a worker, uploaded on the main thread
+        struct Decoded {
+            uint32_t texture{no_texture};
+            uint32_t generation{0};
+            Levels levels;
+        };
+
+        struct PendingUpload {
+            uint32_t texture{no_texture};
+            uint32_t level{0};
+            uint64_t ready_value{0};
+            uint64_t submit_frame{0};
+        };
+
+        struct Stats {
+            uint32_t streamed_in{0};
+            VkDeviceSize uploaded_bytes{0};
+        };
+
+        struct Streamer {
+            Settings settings{};
+            ResourceManagement::TranscodeTargets targets{};
+            ThreadPool* workers{nullptr};
+            std::vector<Texture> textures;
+            std::vector<uint32_t> free_textures;
+            std::vector<MaterialSlot> materials;
+            std::vector<uint32_t> free_materials;
+            std::vector<PendingUpload> uploads;
+            uint32_t decodes_in_flight{0};
+            uint64_t frame{0};
+            Stats stats{};
+
+            std::mutex mutex;
+            std::vector<Decoded> decoded;
+        };
+
+        void create(const Device& device, ThreadPool& workers, const Settings& settings, Streamer& streamer);
+        // Waits out the decodes still running, the textures themselves belong to their scenes
+        void destroy(Streamer& streamer);
+
+        // Runs on the loader workers. Fills levels with the coarse end of the chain when the image is big enough
+        // to stream and frees the decoded image, otherwise returns false and leaves it for the normal upload
+        bool prepareResident(const Streamer& streamer, ResourceManagement::DecodedImage& decoded, Levels& levels);
+        // Creates the image with its whole chain, uploads the coarse levels and registers it, returns the id
+        uint32_t addTexture(const Device& device, VmaAllocator allocator, Upload::Context& uploader,
+                            Streamer& streamer, const Levels& levels, std::span<const unsigned char> encoded,
+                            AllocatedTexture& texture);
+        // Textures are no_texture for bindings that aren't streamed, the clamps are written straight away
+        uint32_t addMaterial(Streamer& streamer, MaterialOperation::MaterialConstants* constants,
+                             const uint32_t textures[3]);
+        // The images are destroyed by the scene, the gpu has to be done with them
+        void release(Streamer& streamer, std::span<const uint32_t> textures, std::span<const uint32_t> materials);
+
+        // Estimates each texture's on screen size from the surfaces about to be drawn. projection_scale is
+        // the projection's y scale times half the viewport height, pixels per unit at distance 1
+        void gatherDemand(Streamer& streamer, const std::vector<MaterialOperation::RenderObject>& surfaces,
+                          const glm::vec3& camera_position, float projection_scale);
+        // Once per frame after the demand is in. Uploads finished decodes, moves clamps of finished uploads
+        // and queues decodes for what is wanted next. Levels only ever go up, the whole chain is allocated
+        // with the image so there's nothing to give back short of releasing the scene
+        void update(const Device& device, VmaAllocator allocator, Upload::Context& uploader, Streamer& streamer);
+        void log(const Streamer& streamer);
+    }
+}
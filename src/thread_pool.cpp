@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+
+#include <exception>
+
+namespace Vulkan {
+    namespace Jobs {
+        static void workerLoop(ThreadPool& pool) {
+            while (true) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(pool.mutex);
+                    pool.job_ready.wait(lock, [&pool]() { return pool.stopping || !pool.jobs.empty(); });
+                    if (pool.stopping && pool.jobs.empty()) {
+                        return;
+                    }
+                    job = std::move(pool.jobs.front());
+                    pool.jobs.pop();
+                    pool.active++;
+                }
+
+                job();
+
+                {
+                    std::lock_guard<std::mutex> lock(pool.mutex);
+                    pool.active--;
+                    if (pool.jobs.empty() && pool.active == 0) {
+                        pool.jobs_done.notify_all();
+                    }
+                }
+            }
+        }
+
+        void create(ThreadPool& pool, uint32_t thread_count) {
+            pool.stopping = false;
+            pool.workers.reserve(thread_count);
+            for (uint32_t i = 0; i < thread_count; i++) {
+                pool.workers.emplace_back(workerLoop, std::ref(pool));
+            }
+        }
+
+        void destroy(ThreadPool& pool) {
+            {
+                std::lock_guard<std::mutex> lock(pool.mutex);
+                pool.stopping = true;
+            }
+            pool.job_ready.notify_all();
+            for (std::thread& worker : pool.workers) {
+                worker.join();
+            }
+            pool.workers.clear();
+        }
+
+        void submit(ThreadPool& pool, std::function<void()> job) {
+            // No workers means nobody would ever pick it up, just run it here
+            if (pool.workers.empty()) {
+                job();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(pool.mutex);
+                pool.jobs.push(std::move(job));
+            }
+            pool.job_ready.notify_one();
+        }
+
+        void wait(ThreadPool& pool) {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.jobs_done.wait(lock, [&pool]() { return pool.jobs.empty() && pool.active == 0; });
+        }
+
+        void parallelFor(ThreadPool& pool, uint32_t count, const std::function<void(uint32_t)>& job) {
+            struct Batch {
+                std::mutex mutex;
+                std::condition_variable done;
+                uint32_t remaining{0};
+                std::exception_ptr error;
+            } batch;
+            batch.remaining = count;
+
+            for (uint32_t i = 0; i < count; i++) {
+                submit(pool, [&batch, &job, i]() {
+                    std::exception_ptr error;
+                    try {
+                        job(i);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    std::lock_guard<std::mutex> lock(batch.mutex);
+                    if (error && !batch.error) {
+                        batch.error = error;
+                    }
+                    if (--batch.remaining == 0) {
+                        batch.done.notify_all();
+                    }
+                });
+            }
+
+            std::unique_lock<std::mutex> lock(batch.mutex);
+            batch.done.wait(lock, [&batch]() { return batch.remaining == 0; });
+            if (batch.error) {
+                std::rethrow_exception(batch.error);
+            }
+        }
+
+        uint32_t threadCount(const ThreadPool& pool) {
+            return static_cast<uint32_t>(pool.workers.size());
+        }
+    }
+}
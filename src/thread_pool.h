@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Vulkan {
+
+    // Fixed size pool of workers pulling from one queue. Nothing fancy, no work stealing, the jobs we give it
+    // are coarse enough that the lock is not where the time goes
+    struct ThreadPool {
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> jobs;
+        std::mutex mutex;
+        std::condition_variable job_ready;
+        std::condition_variable jobs_done;
+        uint32_t active{0};
+        bool stopping{false};
+    };
+
+    namespace Jobs {
+        void create(ThreadPool& pool, uint32_t thread_count);
+        // Finishes whatever is still queued before joining
+        void destroy(ThreadPool& pool);
+        void submit(ThreadPool& pool, std::function<void()> job);
+        // Blocks until the queue is empty and no worker is busy
+        void wait(ThreadPool& pool);
+        // Runs job(i) for i in [0, count) on the pool and returns when those are done, only waits on its own jobs.
+        // The first exception thrown by a job is rethrown on the calling thread
+        void parallelFor(ThreadPool& pool, uint32_t count, const std::function<void(uint32_t)>& job);
+        uint32_t threadCount(const ThreadPool& pool);
+    }
+}
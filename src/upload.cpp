@@ -0,0 +1,463 @@
+#include "upload.h"
+#include "vulkan_operations.h"
+
+#include <algorithm>
+
+namespace Vulkan {
+    namespace Upload {
+        void create(const Device& device, Context& context) {
+            context.transfer_family = device.suitability.queue_fam_indexes.at("transfer");
+            context.graphics_family = device.suitability.queue_fam_indexes.at("draw");
+            context.ownership_transfer = device.dedicated_transfer;
+            context.transfer_pool = CommandPool::createPool(device, context.transfer_family);
+            if (context.ownership_transfer) {
+                context.acquire_pool = CommandPool::createPool(device, context.graphics_family);
+            }
+            Timelines::create(device, context.transfer_timeline);
+            if (context.ownership_transfer) {
+                Timelines::create(device, context.acquire_timeline);
+            }
+        }
+
+        // Where a batch counts as usable on the graphics queue
+        static const Timeline& readyTimeline(const Context& context) {
+            return context.ownership_transfer ? context.acquire_timeline : context.transfer_timeline;
+        }
+
+        void destroy(const Device& device, VmaAllocator allocator, Context& context) {
+            submit(device, context);
+            wait(device, context, readyTimeline(context).last_submitted);
+            collect(device, allocator, context);
+            for (StagingBlock& block : context.free_blocks) {
+                Buffer::destroyBuffer(allocator, block.buffer);
+            }
+
+            CommandPool::destroyPool(device, context.transfer_pool);
+            if (context.acquire_pool) {
+                CommandPool::destroyPool(device, context.acquire_pool);
+            }
+            Timelines::destroy(device, context.transfer_timeline);
+            Timelines::destroy(device, context.acquire_timeline);
+            context = {};
+        }
+
+        static VkCommandBuffer allocateCommand(const Device& device, VkCommandPool pool) {
+            std::vector<VkCommandBuffer> command_buffers{1};
+            CommandPool::createBuffers(device, pool, command_buffers);
+
+            VkCommandBufferBeginInfo begin_info{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkCheck(vkBeginCommandBuffer(command_buffers[0], &begin_info));
+            return command_buffers[0];
+        }
+
+        static VkCommandBuffer recording(const Device& device, Context& context) {
+            if (context.recording == VK_NULL_HANDLE) {
+                context.recording = allocateCommand(device, context.transfer_pool);
+            }
+            return context.recording;
+        }
+
+        struct StagingSlice {
+            VkBuffer buffer;
+            VkDeviceSize offset;
+            unsigned char* mapped;
+        };
+
+        static StagingBlock takeBlock(VmaAllocator allocator, Context& context, VkDeviceSize size) {
+            if (size <= staging_block_size && !context.free_blocks.empty()) {
+                StagingBlock block = context.free_blocks.back();
+                context.free_blocks.pop_back();
+                return block;
+            }
+            StagingBlock block{};
+            block.size = std::max(size, staging_block_size);
+            block.buffer = Buffer::allocateBuffer(allocator, block.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                  VMA_MEMORY_USAGE_CPU_ONLY);
+            return block;
+        }
+
+        static void releaseBlock(VmaAllocator allocator, Context& context, StagingBlock& block) {
+            if (block.size == staging_block_size && context.free_blocks.size() < max_free_blocks) {
+                block.used = 0;
+                context.free_blocks.push_back(block);
+            } else {
+                Buffer::destroyBuffer(allocator, block.buffer);
+            }
+        }
+
+        // Sub allocates from the block being filled, starting a new one when the copy does not fit. Without data
+        // the slice is left for the caller to fill
+        static StagingSlice stage(VmaAllocator allocator, Context& context, const void* data, size_t size) {
+            VkDeviceSize offset = 0;
+            if (!context.staging.empty()) {
+                StagingBlock& block = context.staging.back();
+                offset = (block.used + staging_alignment - 1) & ~(staging_alignment - 1);
+            }
+            if (context.staging.empty() || offset + size > context.staging.back().size) {
+                context.staging.push_back(takeBlock(allocator, context, size));
+                offset = 0;
+            }
+
+            StagingBlock& block = context.staging.back();
+            unsigned char* mapped = static_cast<unsigned char*>(block.buffer.info.pMappedData) + offset;
+            if (data != nullptr) {
+                memcpy(mapped, data, size);
+            }
+            block.used = offset + size;
+            context.pending_bytes += size;
+            return {block.buffer.buffer, offset, mapped};
+        }
+
+        static void recordBufferCopy(const Device& device, Context& context, const StagingSlice& staging,
+                                     size_t size, VkBuffer dst, VkDeviceSize dst_offset) {
+            VkBufferCopy copy{};
+            copy.srcOffset = staging.offset;
+            copy.dstOffset = dst_offset;
+            copy.size = size;
+            vkCmdCopyBuffer(recording(device, context), staging.buffer, dst, 1, &copy);
+
+            // Released to the graphics family at submit, or just made visible when it is the same family
+            VkBufferMemoryBarrier handoff{};
+            handoff.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            handoff.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            handoff.dstAccessMask = context.ownership_transfer ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+            handoff.srcQueueFamilyIndex =
+                context.ownership_transfer ? context.transfer_family : VK_QUEUE_FAMILY_IGNORED;
+            handoff.dstQueueFamilyIndex =
+                context.ownership_transfer ? context.graphics_family : VK_QUEUE_FAMILY_IGNORED;
+            handoff.buffer = dst;
+            handoff.offset = dst_offset;
+            handoff.size = size;
+            context.buffer_handoffs.push_back(handoff);
+            context.pending_copies++;
+        }
+
+        void copyToBuffer(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                          size_t size, VkBuffer dst, VkDeviceSize dst_offset) {
+            if (size == 0) {
+                return;
+            }
+            recordBufferCopy(device, context, stage(allocator, context, data, size), size, dst, dst_offset);
+            if (context.pending_bytes >= max_batch_bytes) {
+                submit(device, context);
+            }
+        }
+
+        void* stageToBuffer(const Device& device, VmaAllocator allocator, Context& context, size_t size, VkBuffer dst,
+                            VkDeviceSize dst_offset) {
+            if (size == 0) {
+                return nullptr;
+            }
+            // A full batch is cut before this copy rather than after it, the slice isn't written yet
+            if (context.pending_bytes >= max_batch_bytes) {
+                submit(device, context);
+            }
+            StagingSlice staging = stage(allocator, context, nullptr, size);
+            recordBufferCopy(device, context, staging, size, dst, dst_offset);
+            return staging.mapped;
+        }
+
+        AllocatedBuffer buffer(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                               size_t size, VkBufferUsageFlags usage) {
+            AllocatedBuffer device_buffer = Buffer::allocateBuffer(
+                allocator, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+            copyToBuffer(device, allocator, context, data, size, device_buffer.buffer);
+            return device_buffer;
+        }
+
+        // Copies levels from first_level on from their offsets in the staged data, the barriers cover base_level
+        // up to mip_levels. Any levels past the copied ones get blitted from the last one given at submit
+        static void recordImageCopy(const Device& device, Context& context, StagingSlice staging, VkImage image,
+                                    VkExtent3D extent, uint32_t base_level, uint32_t mip_levels,
+                                    uint32_t first_level, std::span<const VkDeviceSize> level_offsets,
+                                    VkFilter mip_filter) {
+            VkCommandBuffer cmd = recording(device, context);
+
+            VkImageMemoryBarrier to_transfer{};
+            to_transfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            to_transfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            to_transfer.image = image;
+            to_transfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, base_level, mip_levels - base_level, 0, 1};
+            to_transfer.srcAccessMask = 0;
+            to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                                 nullptr, 0, nullptr, 1, &to_transfer);
+
+            std::vector<VkBufferImageCopy> copy_regions(level_offsets.size());
+            for (uint32_t i = 0; i < copy_regions.size(); i++) {
+                uint32_t level = first_level + i;
+                VkBufferImageCopy& copy_region = copy_regions[i];
+                copy_region.bufferOffset = staging.offset + level_offsets[i];
+                copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                copy_region.imageSubresource.mipLevel = level;
+                copy_region.imageSubresource.baseArrayLayer = 0;
+                copy_region.imageSubresource.layerCount = 1;
+                copy_region.imageExtent = {std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u),
+                                           1};
+            }
+            vkCmdCopyBufferToImage(cmd, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   static_cast<uint32_t>(copy_regions.size()), copy_regions.data());
+
+            // The layout change rides along with the ownership transfer, both halves have to name it
+            VkImageMemoryBarrier handoff = to_transfer;
+            handoff.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            handoff.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            handoff.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            handoff.dstAccessMask = context.ownership_transfer ? 0 : VK_ACCESS_SHADER_READ_BIT;
+            handoff.srcQueueFamilyIndex =
+                context.ownership_transfer ? context.transfer_family : VK_QUEUE_FAMILY_IGNORED;
+            handoff.dstQueueFamilyIndex =
+                context.ownership_transfer ? context.graphics_family : VK_QUEUE_FAMILY_IGNORED;
+            if (mip_levels > first_level + level_offsets.size()) {
+                // Stays a transfer destination through the handoff, the chain does the final transition
+                handoff.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                handoff.dstAccessMask =
+                    context.ownership_transfer ? 0 : VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+                context.mip_chains.push_back({image, extent, mip_levels, mip_filter});
+            }
+            context.image_handoffs.push_back(handoff);
+            context.pending_copies++;
+            if (context.pending_bytes >= max_batch_bytes) {
+                submit(device, context);
+            }
+        }
+
+        void copyToImage(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                         size_t size, VkImage image, VkExtent3D extent, uint32_t mip_levels, VkFilter mip_filter) {
+            StagingSlice staging = stage(allocator, context, data, size);
+            const VkDeviceSize level_offset = 0;
+            recordImageCopy(device, context, staging, image, extent, 0, mip_levels, 0, {&level_offset, 1},
+                            mip_filter);
+        }
+
+        void copyLevelsToImage(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                               size_t size, VkImage image, VkExtent3D extent,
+                               std::span<const VkDeviceSize> level_offsets, uint32_t first_level,
+                               uint32_t mip_levels) {
+            StagingSlice staging = stage(allocator, context, data, size);
+            uint32_t written_end = first_level + static_cast<uint32_t>(level_offsets.size());
+            if (mip_levels == 0) {
+                recordImageCopy(device, context, staging, image, extent, first_level, written_end, first_level,
+                                level_offsets, VK_FILTER_LINEAR);
+            } else {
+                recordImageCopy(device, context, staging, image, extent, 0, std::max(mip_levels, written_end),
+                                first_level, level_offsets, VK_FILTER_LINEAR);
+            }
+        }
+
+        static VkImageMemoryBarrier levelBarrier(VkImage image, uint32_t base_level, uint32_t level_count,
+                                                 VkImageLayout old_layout, VkImageLayout new_layout,
+                                                 VkAccessFlags src_access, VkAccessFlags dst_access) {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = old_layout;
+            barrier.newLayout = new_layout;
+            barrier.srcAccessMask = src_access;
+            barrier.dstAccessMask = dst_access;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, base_level, level_count, 0, 1};
+            return barrier;
+        }
+
+        // Every image goes down one level per step, so a whole batch of textures costs one barrier per level
+        // rather than one per level per texture
+        static void recordMipChains(VkCommandBuffer cmd, const std::vector<MipChain>& chains) {
+            if (chains.empty()) {
+                return;
+            }
+            uint32_t max_levels = 0;
+            for (const MipChain& chain : chains) {
+                max_levels = std::max(max_levels, chain.mip_levels);
+            }
+
+            std::vector<VkImageMemoryBarrier> barriers;
+            barriers.reserve(chains.size() * 2);
+            for (uint32_t level = 1; level < max_levels; level++) {
+                barriers.clear();
+                for (const MipChain& chain : chains) {
+                    if (level < chain.mip_levels) {
+                        barriers.push_back(levelBarrier(chain.image, level - 1, 1,
+                                                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                                        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+                    }
+                }
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                                     nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+                for (const MipChain& chain : chains) {
+                    if (level >= chain.mip_levels) {
+                        continue;
+                    }
+                    VkImageBlit blit{};
+                    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+                    blit.srcOffsets[1] = {static_cast<int32_t>(std::max(chain.extent.width >> (level - 1), 1u)),
+                                          static_cast<int32_t>(std::max(chain.extent.height >> (level - 1), 1u)), 1};
+                    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+                    blit.dstOffsets[1] = {static_cast<int32_t>(std::max(chain.extent.width >> level, 1u)),
+                                          static_cast<int32_t>(std::max(chain.extent.height >> level, 1u)), 1};
+                    vkCmdBlitImage(cmd, chain.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, chain.image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, chain.filter);
+                }
+            }
+
+            // Everything above the last level was a blit source, the last one is still where it was written
+            barriers.clear();
+            for (const MipChain& chain : chains) {
+                uint32_t last = chain.mip_levels - 1;
+                barriers.push_back(levelBarrier(chain.image, 0, last, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                                                VK_ACCESS_SHADER_READ_BIT));
+                barriers.push_back(levelBarrier(chain.image, last, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                VK_ACCESS_SHADER_READ_BIT));
+            }
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0,
+                                 nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+        }
+
+        uint64_t submit(const Device& device, Context& context) {
+            if (context.recording == VK_NULL_HANDLE) {
+                return readyTimeline(context).last_submitted;
+            }
+
+            // The release half when ownership moves, otherwise the only barrier the copies need. The
+            // destination stage is ignored for a release, the acquire on the graphics queue picks it up
+            VkPipelineStageFlags handoff_stage =
+                context.ownership_transfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            vkCmdPipelineBarrier(context.recording, VK_PIPELINE_STAGE_TRANSFER_BIT, handoff_stage, 0, 0, nullptr,
+                                 static_cast<uint32_t>(context.buffer_handoffs.size()),
+                                 context.buffer_handoffs.data(),
+                                 static_cast<uint32_t>(context.image_handoffs.size()),
+                                 context.image_handoffs.data());
+            // Same family means the transfer queue is the graphics queue and can blit
+            if (!context.ownership_transfer) {
+                recordMipChains(context.recording, context.mip_chains);
+            }
+            vkCheck(vkEndCommandBuffer(context.recording));
+
+            context.stats.batches++;
+            context.stats.copies += context.pending_copies;
+            context.stats.staged_bytes += context.pending_bytes;
+            context.stats.staging_blocks += static_cast<uint32_t>(context.staging.size());
+            context.stats.mip_chains += static_cast<uint32_t>(context.mip_chains.size());
+
+            InFlight batch{};
+            batch.transfer_cmd = context.recording;
+            batch.staging = std::move(context.staging);
+
+            uint64_t copied = Timelines::nextValue(context.transfer_timeline);
+            VkTimelineSemaphoreSubmitInfo copy_timeline{};
+            copy_timeline.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            copy_timeline.signalSemaphoreValueCount = 1;
+            copy_timeline.pSignalSemaphoreValues = &copied;
+
+            VkSubmitInfo copy_submit{};
+            copy_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            copy_submit.pNext = &copy_timeline;
+            copy_submit.commandBufferCount = 1;
+            copy_submit.pCommandBuffers = &batch.transfer_cmd;
+            copy_submit.signalSemaphoreCount = 1;
+            copy_submit.pSignalSemaphores = &context.transfer_timeline.semaphore;
+            vkCheck(vkQueueSubmit(device.transfer_queue, 1, &copy_submit, VK_NULL_HANDLE));
+            batch.ready_value = copied;
+
+            if (context.ownership_transfer) {
+                batch.acquire_cmd = allocateCommand(device, context.acquire_pool);
+                for (VkBufferMemoryBarrier& handoff : context.buffer_handoffs) {
+                    handoff.srcAccessMask = 0;
+                    handoff.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+                }
+                for (VkImageMemoryBarrier& handoff : context.image_handoffs) {
+                    handoff.srcAccessMask = 0;
+                    handoff.dstAccessMask = handoff.newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                                ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+                                                : VK_ACCESS_SHADER_READ_BIT;
+                }
+                vkCmdPipelineBarrier(batch.acquire_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+                                     static_cast<uint32_t>(context.buffer_handoffs.size()),
+                                     context.buffer_handoffs.data(),
+                                     static_cast<uint32_t>(context.image_handoffs.size()),
+                                     context.image_handoffs.data());
+                recordMipChains(batch.acquire_cmd, context.mip_chains);
+                vkCheck(vkEndCommandBuffer(batch.acquire_cmd));
+
+                uint64_t acquired = Timelines::nextValue(context.acquire_timeline);
+                VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+                VkTimelineSemaphoreSubmitInfo acquire_timeline{};
+                acquire_timeline.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+                acquire_timeline.waitSemaphoreValueCount = 1;
+                acquire_timeline.pWaitSemaphoreValues = &copied;
+                acquire_timeline.signalSemaphoreValueCount = 1;
+                acquire_timeline.pSignalSemaphoreValues = &acquired;
+
+                VkSubmitInfo acquire_submit{};
+                acquire_submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                acquire_submit.pNext = &acquire_timeline;
+                acquire_submit.waitSemaphoreCount = 1;
+                acquire_submit.pWaitSemaphores = &context.transfer_timeline.semaphore;
+                acquire_submit.pWaitDstStageMask = &wait_stage;
+                acquire_submit.commandBufferCount = 1;
+                acquire_submit.pCommandBuffers = &batch.acquire_cmd;
+                acquire_submit.signalSemaphoreCount = 1;
+                acquire_submit.pSignalSemaphores = &context.acquire_timeline.semaphore;
+                vkCheck(vkQueueSubmit(device.graphics_queue, 1, &acquire_submit, VK_NULL_HANDLE));
+                batch.ready_value = acquired;
+            }
+
+            context.in_flight.push_back(std::move(batch));
+            context.recording = VK_NULL_HANDLE;
+            context.staging.clear();
+            context.buffer_handoffs.clear();
+            context.image_handoffs.clear();
+            context.mip_chains.clear();
+            context.pending_copies = 0;
+            context.pending_bytes = 0;
+            return context.in_flight.back().ready_value;
+        }
+
+        bool isComplete(const Device& device, const Context& context, uint64_t value) {
+            return Timelines::isComplete(device, readyTimeline(context), value);
+        }
+
+        void wait(const Device& device, const Context& context, uint64_t value) {
+            Timelines::wait(device, readyTimeline(context), value);
+        }
+
+        void collect(const Device& device, VmaAllocator allocator, Context& context) {
+            if (context.in_flight.empty()) {
+                return;
+            }
+            uint64_t completed = Timelines::completedValue(device, readyTimeline(context));
+            auto done = [completed](const InFlight& batch) { return batch.ready_value <= completed; };
+            for (InFlight& batch : context.in_flight) {
+                if (!done(batch)) {
+                    continue;
+                }
+                for (StagingBlock& block : batch.staging) {
+                    releaseBlock(allocator, context, block);
+                }
+                vkFreeCommandBuffers(device.logical_handle, context.transfer_pool, 1, &batch.transfer_cmd);
+                if (batch.acquire_cmd) {
+                    vkFreeCommandBuffers(device.logical_handle, context.acquire_pool, 1, &batch.acquire_cmd);
+                }
+            }
+            std::erase_if(context.in_flight, done);
+        }
+
+        void log(const Context& context) {
+            std::cout << "uploads: " << context.stats.batches << " batches, " << context.stats.copies << " copies, "
+                      << context.stats.staged_bytes / (1024 * 1024) << " MB staged in "
+                      << context.stats.staging_blocks << " blocks, " << context.stats.mip_chains << " mip chains"
+                      << std::endl;
+        }
+    }
+}
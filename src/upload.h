@@ -0,0 +1,120 @@
+#pragma once
+
+#include "vulkan_common.h"
+#include "frame_sync.h"
+
+namespace Vulkan {
+
+    struct Device;
+
+    namespace Upload {
+        // Copies are packed into blocks of this size, anything bigger gets a block of its own
+        constexpr VkDeviceSize staging_block_size{64ull * 1024 * 1024};
+        // Empty blocks kept around for the next batch, the rest go back to the allocator
+        constexpr uint32_t max_free_blocks{2};
+        // A batch is submitted early once it has staged this much, so a huge scene doesn't hold all of its
+        // data in host memory at once
+        constexpr VkDeviceSize max_batch_bytes{256ull * 1024 * 1024};
+        // Keeps every copy source offset valid for buffer copies, 4 byte texels and 8 or 16 byte bc blocks
+        constexpr VkDeviceSize staging_alignment{16};
+
+        // Persistently mapped, filled front to back
+        struct StagingBlock {
+            AllocatedBuffer buffer{};
+            VkDeviceSize size{0};
+            VkDeviceSize used{0};
+        };
+
+        // Staging memory and command buffers of a submitted batch, released once the ready timeline passes
+        // ready_value
+        struct InFlight {
+            uint64_t ready_value{0};
+            std::vector<StagingBlock> staging;
+            VkCommandBuffer transfer_cmd{VK_NULL_HANDLE};
+            VkCommandBuffer acquire_cmd{VK_NULL_HANDLE};
+        };
+
+        // An image whose levels below 0 get blitted down from it once the batch's copies are done
+        struct MipChain {
+            VkImage image{VK_NULL_HANDLE};
+            VkExtent3D extent{};
+            uint32_t mip_levels{1};
+            VkFilter filter{VK_FILTER_LINEAR};
+        };
+
+        // Totals over every submitted batch, printed with the other stats instead of once per submit
+        struct Stats {
+            uint32_t batches{0};
+            uint32_t copies{0};
+            VkDeviceSize staged_bytes{0};
+            uint32_t staging_blocks{0};
+            uint32_t mip_chains{0};
+        };
+
+        // Copies are recorded into one transfer command buffer until submit. When the transfer family is
+        // separate the batch ends with release barriers, and a small graphics submit acquires the resources
+        // once the copies are done. That acquire runs ahead of any later frame on the graphics queue, so
+        // drawing with the resources needs no extra wait. Each queue signals its own timeline, batches can
+        // overlap and the two queues finish them in their own order. Ready values are on the acquire timeline
+        // when ownership moves, otherwise on the transfer one
+        struct Context {
+            VkCommandPool transfer_pool{VK_NULL_HANDLE};
+            VkCommandPool acquire_pool{VK_NULL_HANDLE};
+            Timeline transfer_timeline{};
+            Timeline acquire_timeline{};
+            uint32_t transfer_family{0};
+            uint32_t graphics_family{0};
+            bool ownership_transfer{false};
+
+            VkCommandBuffer recording{VK_NULL_HANDLE};
+            // Blocks the current batch is staging into, the last one is the one being filled
+            std::vector<StagingBlock> staging;
+            std::vector<StagingBlock> free_blocks;
+            std::vector<VkBufferMemoryBarrier> buffer_handoffs;
+            std::vector<VkImageMemoryBarrier> image_handoffs;
+            std::vector<MipChain> mip_chains;
+            std::vector<InFlight> in_flight;
+            uint32_t pending_copies{0};
+            VkDeviceSize pending_bytes{0};
+            Stats stats{};
+        };
+
+        void create(const Device& device, Context& context);
+        void destroy(const Device& device, VmaAllocator allocator, Context& context);
+
+        // Stages size bytes from data and records a copy into dst at dst_offset
+        void copyToBuffer(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                          size_t size, VkBuffer dst, VkDeviceSize dst_offset = 0);
+        // Records a copy of size bytes into dst and returns the staging memory it copies from, for data that is
+        // produced in its final layout instead of copied in. Has to be filled before the next submit
+        void* stageToBuffer(const Device& device, VmaAllocator allocator, Context& context, size_t size, VkBuffer dst,
+                            VkDeviceSize dst_offset = 0);
+        // Creates a gpu only buffer with TRANSFER_DST added to usage and records the copy of data into it
+        AllocatedBuffer buffer(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                               size_t size, VkBufferUsageFlags usage);
+        // Copies tightly packed data into mip 0, the other levels are blitted from it with mip_filter as part of
+        // the same batch. Blits need a graphics queue, so with a separate transfer family they run in the
+        // acquire submit. Leaves every level in SHADER_READ_ONLY_OPTIMAL, the image needs TRANSFER_SRC usage
+        // when mip_levels is above 1
+        void copyToImage(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                         size_t size, VkImage image, VkExtent3D extent, uint32_t mip_levels,
+                         VkFilter mip_filter = VK_FILTER_LINEAR);
+        // Data holds the levels from first_level on, level_offsets[i] is where level first_level + i starts in it.
+        // For block compressed formats, which can't be blitted, and for streamed mips. With mip_levels set the
+        // image is fresh and all of its levels go to SHADER_READ_ONLY_OPTIMAL, written or not. Left at 0 only the
+        // written levels are touched and whatever they held is discarded, the rest of the image can stay in use
+        void copyLevelsToImage(const Device& device, VmaAllocator allocator, Context& context, const void* data,
+                               size_t size, VkImage image, VkExtent3D extent,
+                               std::span<const VkDeviceSize> level_offsets, uint32_t first_level = 0,
+                               uint32_t mip_levels = 0);
+
+        // Submits everything recorded so far, returns the timeline value that means it is usable on the
+        // graphics queue. Returns the last value again when there was nothing to submit
+        uint64_t submit(const Device& device, Context& context);
+        bool isComplete(const Device& device, const Context& context, uint64_t value);
+        void wait(const Device& device, const Context& context, uint64_t value);
+        // Frees staging buffers and command buffers of batches the gpu is done with
+        void collect(const Device& device, VmaAllocator allocator, Context& context);
+        void log(const Context& context);
+    }
+}
@@ -24,11 +24,24 @@ namespace Vulkan
         VmaAllocationInfo info;
     };
 
-    struct MeshBuffer {
+    // One persistently mapped buffer split into equal, alignment padded slots, one per frame in flight.
+    // Bound once as a dynamic uniform buffer and addressed per frame by the dynamic offset of the slot
+    struct UniformRing {
+        AllocatedBuffer buffer{};
+        VkDeviceSize stride{0};
+        uint32_t slots{0};
+    };
 
-        AllocatedBuffer index_buffer;
-        AllocatedBuffer vertex_buffer;
-        VkDeviceAddress vertex_buffer_address;
+    // Byte ranges a mesh owns in the shared geometry arenas. Indices are relative to the mesh's first vertex,
+    // vertex_buffer_address already points at it
+    struct MeshBuffer {
+        VkBuffer index_buffer{VK_NULL_HANDLE};
+        uint32_t first_index{0};
+        VkDeviceSize index_offset{0};
+        VkDeviceSize index_size{0};
+        VkDeviceSize vertex_offset{0};
+        VkDeviceSize vertex_size{0};
+        VkDeviceAddress vertex_buffer_address{0};
     };
 
     struct alignas(16) Vertex {
@@ -42,6 +55,24 @@ namespace Vulkan
         glm::vec4 color;
     };
 
+    // Optional import layout, matches CompactVertex in vertex_fetch.glsl. Positions are unorm16 within the
+    // mesh box from CompactVertexHeader, normal and tangent are octahedral snorm16, uvs are half and color unorm8
+    struct CompactVertex {
+        uint32_t position_xy;
+        uint32_t position_z;
+        uint32_t normal;
+        uint32_t tangent;
+        uint32_t uv;
+        uint32_t color;
+    };
+    static_assert(sizeof(CompactVertex) == 24);
+
+    // Sits at the start of a compact mesh's vertex range, position = offset + unorm * scale
+    struct CompactVertexHeader {
+        glm::vec4 position_offset;
+        glm::vec4 position_scale;
+    };
+
     struct GPUDrawPushConstants {
         glm::mat4 worldMatrix;
         VkDeviceAddress vertexBuffer;
@@ -41,12 +41,15 @@ namespace Vulkan {
 
     namespace CommandPool {
         VkCommandPool createPool(const Device& device) {
+            return createPool(device, device.suitability.queue_fam_indexes.at("draw"));
+        }
+
+        VkCommandPool createPool(const Device& device, uint32_t queue_family_index) {
             VkCommandPool handle{};
             VkCommandPoolCreateInfo pool_info{};
             pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
             pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-            pool_info.queueFamilyIndex =
-                device.suitability.queue_fam_indexes.at("draw");
+            pool_info.queueFamilyIndex = queue_family_index;
 
             vkCheck(vkCreateCommandPool(device.logical_handle, &pool_info,
                                         nullptr, &handle));
@@ -136,6 +139,30 @@ namespace Vulkan {
                 vmaDestroyBuffer(handle, buffer.buffer, buffer.allocation);
             }
         }
+
+        UniformRing createRing(const Device& device, VmaAllocator handle, size_t element_size, uint32_t slots) {
+            VkDeviceSize alignment = device.properties.limits.minUniformBufferOffsetAlignment;
+            UniformRing ring{};
+            ring.stride = (element_size + alignment - 1) & ~(alignment - 1);
+            ring.slots = slots;
+            ring.buffer = allocateBuffer(handle, ring.stride * slots, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                         VMA_MEMORY_USAGE_CPU_TO_GPU);
+            return ring;
+        }
+
+        uint32_t writeRing(VmaAllocator handle, UniformRing& ring, uint32_t slot, const void* data, size_t size) {
+            assert(slot < ring.slots && size <= ring.stride);
+            VkDeviceSize offset = ring.stride * slot;
+            memcpy(static_cast<char*>(ring.buffer.info.pMappedData) + offset, data, size);
+            // No op on coherent memory, CPU_TO_GPU does not promise coherent though
+            vmaFlushAllocation(handle, ring.buffer.allocation, offset, ring.stride);
+            return static_cast<uint32_t>(offset);
+        }
+
+        void destroyRing(VmaAllocator handle, UniformRing& ring) {
+            destroyBuffer(handle, ring.buffer);
+            ring = {};
+        }
     }  // namespace Buffer
 
     namespace Immediate {
@@ -384,6 +411,17 @@ namespace Vulkan {
         AllocatedTexture create(const Device& device, VmaAllocator handle,
                                 VkExtent3D size, VkFormat format,
                                 VkImageUsageFlags usage, bool mipmapped) {
+            uint32_t mip_levels = 1;
+            if (mipmapped) {
+                mip_levels = static_cast<uint32_t>(std::floor(std::log2(
+                                 std::max(size.width, size.height)))) +
+                             1;
+            }
+            return createWithLevels(device, handle, size, format, usage, mip_levels);
+        }
+
+        AllocatedTexture createWithLevels(const Device& device, VmaAllocator handle, VkExtent3D size,
+                                          VkFormat format, VkImageUsageFlags usage, uint32_t mip_levels) {
             AllocatedTexture new_image{};
             new_image.format = format;
             new_image.extent = size;
@@ -395,7 +433,7 @@ namespace Vulkan {
             img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
             img_info.pNext = nullptr;
             img_info.imageType = VK_IMAGE_TYPE_2D;
-            img_info.mipLevels = 1;
+            img_info.mipLevels = mip_levels;
             img_info.arrayLayers = 1;
             // img_info.
 
@@ -405,12 +443,6 @@ namespace Vulkan {
             //optimal tiling, which means the image is stored on the best gpu format
             img_info.tiling = VK_IMAGE_TILING_OPTIMAL;
 
-            if (mipmapped) {
-                img_info.mipLevels = static_cast<uint32_t>(std::floor(std::log2(
-                                         std::max(size.width, size.height)))) +
-                                     1;
-            }
-
             VmaAllocationCreateInfo allocinfo = {};
             allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
             allocinfo.requiredFlags =
@@ -443,15 +475,26 @@ namespace Vulkan {
         }
 
         AllocatedTexture upload(const Device& device, VmaAllocator handle,
-                                VkCommandPool pool_handle, void* data,
+                                Upload::Context& uploader, void* data,
                                 VkExtent3D size, VkFormat format,
                                 VkImageUsageFlags usage, bool mipmapped) {
             size_t data_size = size.depth * size.width * size.height * 4;
-            AllocatedBuffer uploadbuffer = Buffer::allocateBuffer(
-                handle, data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VMA_MEMORY_USAGE_CPU_TO_GPU);
 
-            memcpy(uploadbuffer.info.pMappedData, data, data_size);
+            // The chain is built with blits, a format that can't be blitted only gets mip 0 and one without
+            // linear filtering gets a nearest downsample
+            VkFilter mip_filter = VK_FILTER_LINEAR;
+            if (mipmapped) {
+                VkFormatProperties properties{};
+                vkGetPhysicalDeviceFormatProperties(device.physical_handle, format, &properties);
+                VkFormatFeatureFlags features = properties.optimalTilingFeatures;
+                if (!(features & VK_FORMAT_FEATURE_BLIT_SRC_BIT) || !(features & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+                    std::cout << "texture format " << format << " can't be blitted, uploading without mips"
+                              << std::endl;
+                    mipmapped = false;
+                } else if (!(features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+                    mip_filter = VK_FILTER_NEAREST;
+                }
+            }
 
             AllocatedTexture new_image =
                 create(device, handle, size, format,
@@ -459,47 +502,29 @@ namespace Vulkan {
                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                        mipmapped);
 
-            Immediate::Submit(
-                [&](VkCommandBuffer cmd) {
-                    Transition::image(cmd, new_image.image,
-                                      VK_IMAGE_LAYOUT_UNDEFINED,
-                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                                      VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                                      VK_ACCESS_TRANSFER_WRITE_BIT);
-
-                    VkBufferImageCopy copyRegion = {};
-                    copyRegion.bufferOffset = 0;
-                    copyRegion.bufferRowLength = 0;
-                    copyRegion.bufferImageHeight = 0;
-
-                    copyRegion.imageSubresource.aspectMask =
-                        VK_IMAGE_ASPECT_COLOR_BIT;
-                    copyRegion.imageSubresource.mipLevel = 0;
-                    copyRegion.imageSubresource.baseArrayLayer = 0;
-                    copyRegion.imageSubresource.layerCount = 1;
-                    copyRegion.imageExtent = size;
-
-                    // copy the buffer into the image
-                    vkCmdCopyBufferToImage(
-                        cmd, uploadbuffer.buffer, new_image.image,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-                    Transition::image(cmd, new_image.image,
-                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                      VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                                      VK_ACCESS_TRANSFER_WRITE_BIT,
-                                      VK_ACCESS_SHADER_READ_BIT);
-                },
-                pool_handle, device);
-
-            Buffer::destroyBuffer(handle, uploadbuffer);
+            uint32_t mip_levels = 1;
+            if (mipmapped) {
+                mip_levels = static_cast<uint32_t>(std::floor(std::log2(
+                                 std::max(size.width, size.height)))) +
+                             1;
+            }
+            Upload::copyToImage(device, handle, uploader, data, data_size,
+                                new_image.image, size, mip_levels, mip_filter);
 
             return new_image;
         }
 
+        AllocatedTexture uploadLevels(const Device& device, VmaAllocator handle, Upload::Context& uploader,
+                                      const void* data, size_t data_size, VkExtent3D size, VkFormat format,
+                                      VkImageUsageFlags usage, std::span<const VkDeviceSize> level_offsets) {
+            AllocatedTexture new_image =
+                createWithLevels(device, handle, size, format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                 static_cast<uint32_t>(level_offsets.size()));
+            Upload::copyLevelsToImage(device, handle, uploader, data, data_size, new_image.image, size,
+                                      level_offsets);
+            return new_image;
+        }
+
         void destroy(const Device& device, VmaAllocator handle,
                      const AllocatedTexture& img) {
             vkDestroyImageView(device.logical_handle, img.view, nullptr);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "device.h"
+#include "upload.h"
 #include "vulkan_common.h"
 
 namespace Vulkan {
@@ -16,6 +17,7 @@ namespace Vulkan {
 
     namespace CommandPool {
         VkCommandPool createPool(const Device& device);
+        VkCommandPool createPool(const Device& device, uint32_t queue_family_index);
         void createBuffers(const Device& device, VkCommandPool handle,
                            std::vector<VkCommandBuffer>& buffer_handles);
         void freeBuffers(const Device& device, VkCommandPool handle,
@@ -35,44 +37,14 @@ namespace Vulkan {
                                        const VkBufferUsageFlags usage_flag,
                                        const VmaMemoryUsage usage_type);
         void destroyBuffer(VmaAllocator handle, const AllocatedBuffer& buffer);
+
+        UniformRing createRing(const Device& device, VmaAllocator handle, size_t element_size, uint32_t slots);
+        // Copies data into the slot and returns the dynamic offset to bind it with
+        uint32_t writeRing(VmaAllocator handle, UniformRing& ring, uint32_t slot, const void* data, size_t size);
+        void destroyRing(VmaAllocator handle, UniformRing& ring);
     }  // namespace Buffer
 
     namespace Immediate {
-        template <typename T>
-        AllocatedBuffer uploadBuffer(const std::span<T>& data,
-                                     VmaAllocator allocator_handle,
-                                     VkCommandPool pool_handle,
-                                     const Device& device,
-                                     VkBufferUsageFlags usage,
-                                     VmaMemoryUsage memory_usage,
-                                     uint32_t offset = 0) {
-            VkDeviceSize buffer_size = sizeof(T) * data.size();
-
-            AllocatedBuffer staging_buffer = Buffer::allocateBuffer(
-                allocator_handle, buffer_size + offset,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-
-            memcpy((char*)staging_buffer.info.pMappedData + offset, data.data(),
-                   buffer_size);
-            AllocatedBuffer device_buffer = Buffer::allocateBuffer(
-                allocator_handle, buffer_size, usage, memory_usage);
-
-            Submit(
-                [&](VkCommandBuffer cmd) {
-                    VkBufferCopy copy{};
-                    copy.size = buffer_size;
-                    copy.dstOffset = 0;
-                    copy.srcOffset = offset;
-                    vkCmdCopyBuffer(cmd, staging_buffer.buffer,
-                                    device_buffer.buffer, 1, &copy);
-                },
-                pool_handle, device);
-
-            Buffer::destroyBuffer(allocator_handle, staging_buffer);
-
-            return device_buffer;
-        }
-
         void Submit(std::function<void(VkCommandBuffer cmd)>&& function,
                     VkCommandPool pool_handle, const Device& device);
     }  // namespace Immediate
@@ -118,11 +90,20 @@ namespace Vulkan {
                                 VkExtent3D size, VkFormat format,
                                 VkImageUsageFlags usage,
                                 bool mipmapped = false);
+        AllocatedTexture createWithLevels(const Device& device, VmaAllocator handle, VkExtent3D size,
+                                          VkFormat format, VkImageUsageFlags usage, uint32_t mip_levels);
+        // Records the copy into the uploader's batch, usable on the graphics queue once that batch is submitted.
+        // data is tightly packed 4 byte texels, mipmapped fills the full chain from it in the same batch
         AllocatedTexture upload(const Device& device, VmaAllocator handle,
-                                VkCommandPool pool_handle, void* data,
+                                Upload::Context& uploader, void* data,
                                 VkExtent3D size, VkFormat format,
                                 VkImageUsageFlags usage,
                                 bool mipmapped = false);
+        // Every level comes with the data, level_offsets[i] is where level i starts. The path for block
+        // compressed textures, which are uploaded as stored
+        AllocatedTexture uploadLevels(const Device& device, VmaAllocator handle, Upload::Context& uploader,
+                                      const void* data, size_t data_size, VkExtent3D size, VkFormat format,
+                                      VkImageUsageFlags usage, std::span<const VkDeviceSize> level_offsets);
         void destroy(const Device& device, VmaAllocator handle, const AllocatedTexture& img);
     }  // namespace Texture
 }  // namespace Vulkan
\ No newline at end of file